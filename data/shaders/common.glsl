@@ -148,3 +148,9 @@ vec3 diffuse_brdf(float metallic, vec3 albedo, vec3 F) {
 	diffuse_portion *= 1.0 - metallic;
 	return (diffuse_portion * albedo) / PI;
 }
+
+// Normal maps only store X and Y, Z is reconstructed from the unit length
+vec3 decode_normal_map(vec2 encoded) {
+	vec2 xy = encoded * 2.0 - 1.0;
+	return vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+}
@@ -3,34 +3,33 @@
 #include "../common.glsl"
 #include "../../../src/rendering_backend/glsl_common.h"
 
-layout(push_constant) uniform PushConstants { DefaultPushConstants pc; };
-
 layout(set = 3, binding = 0) uniform sampler2D shadow_map;
 
 layout(location = 0) in vec3 in_pos;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec4 in_tangent;
 layout(location = 3) in vec2 in_uv;
+layout(location = 4) flat in int in_object_id;
 
 layout(location = 0) out vec4 out_color;
 
 void main() {
-	Primitive primitive = primitives[pc.object_id];
+	Material material = materials[primitives[in_object_id].material];
 
 	vec4 albedo;
-	if(primitive.material.base_color_texture == -1) {
-		albedo = primitive.material.base_color;
+	if(material.base_color_texture == -1) {
+		albedo = material.base_color;
 	}
 	else {
-		albedo = texture(textures[primitive.material.base_color_texture], in_uv); 
+		albedo = texture(textures[material.base_color_texture], in_uv); 
 	}
-	if(primitive.material.alpha_mask == 1 && albedo.a < primitive.material.alpha_cutoff) {
+	if(material.alpha_mask == 1 && albedo.a < material.alpha_cutoff) {
 		discard;
 	}
 
 	vec3 N = in_normal;
-	if(primitives[pc.object_id].material.normal_map >= 0) {
-		vec3 tangent_space_normal = normalize(texture(textures[primitive.material.normal_map], in_uv).xyz * 2.0 - 1.0);
+	if(material.normal_map >= 0) {
+		vec3 tangent_space_normal = decode_normal_map(texture(textures[material.normal_map], in_uv).xy);
 		vec3 bitangent = cross(tangent_space_normal, in_tangent.xyz) * in_tangent.w;
 		vec3 tangent = normalize(in_tangent.xyz - in_normal * dot(in_tangent.xyz, in_normal));
 		N = tangent * tangent_space_normal.x + bitangent * tangent_space_normal.y + in_normal * tangent_space_normal.z;
@@ -0,0 +1,61 @@
+struct DrawIndexedIndirectCommand {
+	uint index_count;
+	uint instance_count;
+	uint first_index;
+	int vertex_offset;
+	uint first_instance;
+};
+
+// Indices of the primitive records to draw
+layout(set = 3, binding = 0, scalar) readonly buffer DrawList { uint draw_list[]; };
+// max_draw_count commands per stream, stream = (view * 2 + alpha mode) * 2 + index type
+layout(set = 3, binding = 1, scalar) writeonly buffer DrawCommands { DrawIndexedIndirectCommand draw_commands[]; };
+// A count per stream, followed by the CULLING_STATISTICs
+#define CULLING_STATISTICS_OFFSET (CULLING_VIEW_COUNT * CULLING_STREAMS_PER_VIEW)
+layout(set = 3, binding = 2, scalar) buffer DrawCounts { uint draw_counts[]; };
+// Non-zero for the entries of the draw list that passed the occlusion test last frame
+layout(set = 3, binding = 3, scalar) buffer Visibility { uint visibility[]; };
+
+layout(push_constant) uniform PushConstants { CullingPushConstants pc; };
+
+// World space bounding sphere of a primitive record, xyz the center and w the radius
+vec4 get_bounding_sphere(Primitive primitive) {
+	mat4 model = transforms[primitive.transform];
+	vec3 center = vec3(model * vec4(primitive.bounding_sphere.xyz, 1.0));
+	float scale = max(length(model[0].xyz), max(length(model[1].xyz), length(model[2].xyz)));
+	return vec4(center, primitive.bounding_sphere.w * scale);
+}
+
+// Gribb-Hartmann plane extraction, a sphere is culled if it lies entirely outside of one plane.
+// The far plane of the infinite reverse-Z camera projection has no normal and never culls.
+bool sphere_in_frustum(mat4 view_proj, vec3 center, float radius) {
+	mat4 m = transpose(view_proj);
+	vec4 planes[6] = vec4[6](
+		m[3] + m[0],
+		m[3] - m[0],
+		m[3] + m[1],
+		m[3] - m[1],
+		m[2],
+		m[3] - m[2]
+	);
+	for(int i = 0; i < 6; ++i) {
+		if(dot(planes[i].xyz, center) + planes[i].w < -radius * length(planes[i].xyz)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+void write_draw(uint view, uint object_id, Primitive primitive) {
+	uint alpha_mode = materials[primitive.material].alpha_mask == 1 ? CULLING_ALPHA_MODE_ALPHA_TESTED : CULLING_ALPHA_MODE_OPAQUE;
+	uint stream = view * CULLING_STREAMS_PER_VIEW + alpha_mode * 2 + primitive.index_type;
+	uint slot = atomicAdd(draw_counts[stream], 1u);
+	// The record index goes through firstInstance, the vertex shaders read it from gl_InstanceIndex
+	draw_commands[stream * pc.max_draw_count + slot] = DrawIndexedIndirectCommand(
+		primitive.index_count,
+		1u,
+		primitive.index_type == INDEX_TYPE_UINT16 ? primitive.index_offset : primitive.index_offset / 2,
+		int(primitive.vertex_offset),
+		object_id
+	);
+}
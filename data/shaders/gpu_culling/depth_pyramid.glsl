@@ -0,0 +1,12 @@
+// All levels of the depth pyramid share one display sized image. Level 0 is half the display size in the
+// top left corner, the smaller levels are stacked below each other to its right. Every level halves the
+// one above it, rounding up, so texel t of a level covers texels 2t and 2t + 1 of the level above.
+// The pyramid keeps the farthest depth, which is the smallest one with reverse-Z.
+void get_depth_pyramid_level(uint level, out uvec2 offset, out uvec2 size) {
+	size = (uvec2(pfd.display_size) + 1) / 2;
+	offset = uvec2(0);
+	for(uint i = 1; i <= level; ++i) {
+		offset = i == 1 ? uvec2(size.x, 0) : uvec2(offset.x, offset.y + size.y);
+		size = (size + 1) / 2;
+	}
+}
@@ -0,0 +1,16 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#include "../common.glsl"
+#include "../../../src/rendering_backend/glsl_common.h"
+
+layout(location = 0) in vec3 in_pos;
+
+// Same expression as in gbuf.vert, the G-buffer tests for an equal depth after the depth prepass
+invariant gl_Position;
+
+void main() {
+	// Drawn by the GPU culling pass, firstInstance is the primitive record index
+	int object_id = gl_InstanceIndex;
+	mat4 model = transforms[primitives[object_id].transform];
+	gl_Position = (pfd.camera_proj * pfd.camera_view * model) * vec4(in_pos, 1.0);
+}
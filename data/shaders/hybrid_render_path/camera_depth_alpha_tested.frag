@@ -0,0 +1,21 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#include "../common.glsl"
+#include "../../../src/rendering_backend/glsl_common.h"
+
+layout(location = 0) in vec2 in_uv;
+layout(location = 1) flat in int in_object_id;
+
+// Only drawn for alpha tested materials. Uses the same test as gbuf.frag, so the G-buffer finds the
+// same surfaces in the depth buffer.
+void main() {
+	Material material = materials[primitives[in_object_id].material];
+
+	float alpha = material.base_color.a;
+	if(material.base_color_texture != -1) {
+		alpha = texture(textures[material.base_color_texture], in_uv).a;
+	}
+	if(alpha < material.alpha_cutoff) {
+		discard;
+	}
+}
@@ -0,0 +1,21 @@
+#version 460
+#extension GL_GOOGLE_include_directive : require
+#include "../common.glsl"
+#include "../../../src/rendering_backend/glsl_common.h"
+
+layout(location = 0) in vec3 in_pos;
+layout(location = 3) in uint in_uv0;
+
+layout(location = 0) out vec2 out_uv;
+layout(location = 1) flat out int out_object_id;
+
+invariant gl_Position;
+
+void main() {
+	// Drawn by the GPU culling pass, firstInstance is the primitive record index
+	int object_id = gl_InstanceIndex;
+	mat4 model = transforms[primitives[object_id].transform];
+	out_uv = decode_uv(in_uv0);
+	out_object_id = object_id;
+	gl_Position = (pfd.camera_proj * pfd.camera_view * model) * vec4(in_pos, 1.0);
+}
@@ -3,25 +3,30 @@
 #include "../common.glsl"
 #include "../../../src/rendering_backend/glsl_common.h"
 
-layout(push_constant) uniform PushConstants { HybridPushConstants pc; };
-
 layout(location = 0) in vec3 in_pos;
-layout(location = 1) in vec3 in_normal;
-layout(location = 2) in vec4 in_tangent;
-layout(location = 3) in vec2 in_uv0;
-layout(location = 4) in vec2 in_uv1;
+layout(location = 1) in uint in_normal;
+layout(location = 2) in uint in_tangent;
+layout(location = 3) in uint in_uv0;
 
 layout(location = 0) out vec3 out_normal;
 layout(location = 1) out vec4 out_tangent;
 layout(location = 2) out vec2 out_uv;
 layout(location = 3) out vec4 out_reprojected_pos;
+layout(location = 4) flat out int out_object_id;
+
+// The depth prepass computes the same position, the G-buffer tests for an equal depth after it
+invariant gl_Position;
 
 void main() {
-	mat4 model = primitives[pc.object_id].transform;
+	// Drawn by the GPU culling pass, firstInstance is the primitive record index
+	int object_id = gl_InstanceIndex;
+	mat4 model = transforms[primitives[object_id].transform];
 	
-	out_normal = in_normal;
-	out_tangent = in_tangent;
-	out_uv = in_uv0;
+	vec4 tangent = decode_tangent(in_tangent);
+	out_normal = transpose(inverse(mat3(model))) * decode_normal(in_normal);
+	out_tangent = vec4(mat3(model) * tangent.xyz, tangent.w);
+	out_object_id = object_id;
+	out_uv = decode_uv(in_uv0);
 
 	out_reprojected_pos = (pfd.camera_proj_prev_frame * pfd.camera_view_prev_frame * model) * vec4(in_pos, 1.0);
 	gl_Position = (pfd.camera_proj * pfd.camera_view * model) * vec4(in_pos, 1.0);
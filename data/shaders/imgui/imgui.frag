@@ -1,7 +1,7 @@
 #version 460
 #extension GL_EXT_nonuniform_qualifier : require
 
-layout(set = 0, binding = 4) uniform sampler2D textures[];
+layout(set = 0, binding = 6) uniform sampler2D textures[];
 
 layout(push_constant) uniform PushConstants {
 	vec2 scale;
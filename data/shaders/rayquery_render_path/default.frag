@@ -3,28 +3,27 @@
 #include "../common.glsl"
 #include "../../../src/rendering_backend/glsl_common.h"
 
-layout(push_constant) uniform PushConstants { DefaultPushConstants pc; };
-
 layout(location = 0) in vec3 in_pos;
 layout(location = 1) in vec3 in_normal;
 layout(location = 2) in vec4 in_tangent;
 layout(location = 3) in vec2 in_uv;
+layout(location = 4) flat in int in_object_id;
 
 layout(location = 0) out vec4 out_color;
 
 void main() {
-	Primitive primitive = primitives[pc.object_id];
+	Material material = materials[primitives[in_object_id].material];
 	vec3 albedo;
-	if(primitive.material.base_color_texture == -1) {
-		albedo = primitive.material.base_color.rgb;
+	if(material.base_color_texture == -1) {
+		albedo = material.base_color.rgb;
 	}
 	else {
-		albedo = texture(textures[primitive.material.base_color_texture], in_uv).rgb;
+		albedo = texture(textures[material.base_color_texture], in_uv).rgb;
 	}
 
 	vec3 N = in_normal;
-	if(primitive.material.normal_map >= 0) {
-		vec3 tangent_space_normal = normalize(texture(textures[primitive.material.normal_map], in_uv).xyz * 2.0 - 1.0);
+	if(material.normal_map >= 0) {
+		vec3 tangent_space_normal = decode_normal_map(texture(textures[material.normal_map], in_uv).xy);
 		vec3 bitangent = cross(tangent_space_normal, in_tangent.xyz) * in_tangent.w;
 		vec3 tangent = normalize(in_tangent.xyz - in_normal * dot(in_tangent.xyz, in_normal));
 		N = tangent * tangent_space_normal.x + bitangent * tangent_space_normal.y + in_normal * tangent_space_normal.z;
@@ -34,9 +33,19 @@ void main() {
 	vec3 light_color = pfd.directional_light.color.rgb;
 
 	rayQueryEXT ray_query;
-	rayQueryInitializeEXT(ray_query, TLAS, gl_RayFlagsTerminateOnFirstHitEXT, 0xFF, in_pos, 0.1, light_dir, 10000.0);
-
-	while(rayQueryProceedEXT(ray_query)) {}
+	rayQueryInitializeEXT(ray_query, TLAS, gl_RayFlagsTerminateOnFirstHitEXT, INSTANCE_MASK_ALL, in_pos, 0.1, light_dir, 10000.0);
+
+	// Only alpha tested geometry yields non-opaque candidates
+	while(rayQueryProceedEXT(ray_query)) {
+		if(rayQueryGetIntersectionTypeEXT(ray_query, false) == gl_RayQueryCandidateIntersectionTriangleEXT) {
+			Primitive hit_primitive = primitives[rayQueryGetIntersectionInstanceCustomIndexEXT(ray_query, false) +
+				rayQueryGetIntersectionGeometryIndexEXT(ray_query, false)];
+			if(alpha_test_passes(hit_primitive, rayQueryGetIntersectionPrimitiveIndexEXT(ray_query, false),
+				rayQueryGetIntersectionBarycentricsEXT(ray_query, false))) {
+				rayQueryConfirmIntersectionEXT(ray_query);
+			}
+		}
+	}
 
 	vec3 in_shadow = vec3(1.0);
 	if(rayQueryGetIntersectionTypeEXT(ray_query, true) != gl_RayQueryCommittedIntersectionNoneEXT) {
@@ -1,19 +1,31 @@
 #pragma once
 
 #include <cassert>
+#include <cfloat>
 #include <cmath>
 #include <cstdint>
 #include <cstdio>
+#include <cstring>
+#include <immintrin.h>
+#include <omp.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <deque>
 #include <filesystem>
 #include <fstream>
 #include <functional>
+#include <map>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <optional>
 #include <string>
 #include <sstream>
+#include <thread>
 #include <unordered_map>
 #include <unordered_set>
 #include <variant>
@@ -39,6 +51,7 @@
 #include "glm/vec3.hpp"
 #include "glm/vec4.hpp"
 #include "glm/mat4x4.hpp"
+#include "glm/packing.hpp"
 #include "glm/ext/matrix_clip_space.hpp"
 #include "glm/gtx/matrix_decompose.hpp"
 #include "glm/ext/matrix_transform.hpp"
@@ -28,6 +28,26 @@ void ComputeExecutionContext::Dispatch(const char *shader, uint32_t x_groups, ui
 	vkCmdDispatch(command_buffer, x_groups, y_groups, z_groups);
 }
 
+void ComputeExecutionContext::StorageImageBarrier(const char *image) {
+	assert(render_graph.image_access[image].layout == VK_IMAGE_LAYOUT_GENERAL);
+	VkUtils::InsertImageBarrier(
+		command_buffer,
+		render_graph.images[image].handle,
+		VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_GENERAL,
+		VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_ACCESS_SHADER_WRITE_BIT,
+		VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	);
+}
+
+void ComputeExecutionContext::CullOccludedPrimitives(const char *depth_pyramid) {
+	resource_manager.gpu_culling.RecordOcclusionCulling(command_buffer, resource_idx, render_graph.images[depth_pyramid],
+		GPUCulling::GetDepthPyramidLevels(GetDisplaySize()));
+}
+
 void ComputeExecutionContext::BlitImageStorageToTransient(int src, const char *dst) {
 	Image src_image = resource_manager.storage_images[src];
 	Image dst_image = render_graph.images[dst];
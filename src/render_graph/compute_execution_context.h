@@ -26,6 +26,11 @@ public:
 		Dispatch(entry, x_groups, y_groups, z_groups);
 	}
 
+	// Makes the writes of the dispatches so far to a storage image visible to the following ones
+	void StorageImageBarrier(const char *image);
+	// Tests the primitives in the camera frustum against a depth pyramid, see GPUCulling
+	void CullOccludedPrimitives(const char *depth_pyramid);
+
 	void BlitImageStorageToTransient(int src, const char *dst);
 	void BlitImageTransientToStorage(const char *src, int dst);
 	void BlitImageStorageToStorage(int src, int dst);
@@ -5,8 +5,9 @@
 
 void GraphicsExecutionContext::BindGlobalVertexAndIndexBuffers() {
 	VkDeviceSize offset = 0;
-	vkCmdBindVertexBuffers(command_buffer, 0, 1, &resource_manager.global_vertex_buffer.handle, &offset);
-	vkCmdBindIndexBuffer(command_buffer, resource_manager.global_index_buffer.handle, 0, VK_INDEX_TYPE_UINT32);
+	vkCmdBindVertexBuffers(command_buffer, 0, 1, &resource_manager.global_vertex_buffer.buffer.handle, &offset);
+	vkCmdBindIndexBuffer(command_buffer, resource_manager.global_index_buffer.buffer.handle, 0, VK_INDEX_TYPE_UINT16);
+	bound_index_type = VK_INDEX_TYPE_UINT16;
 }
 
 void GraphicsExecutionContext::BindVertexBuffer(VkBuffer buffer, VkDeviceSize offset) {
@@ -15,6 +16,7 @@ void GraphicsExecutionContext::BindVertexBuffer(VkBuffer buffer, VkDeviceSize of
 
 void GraphicsExecutionContext::BindIndexBuffer(VkBuffer buffer, VkDeviceSize offset, VkIndexType type) {
 	vkCmdBindIndexBuffer(command_buffer, buffer, offset, type);
+	bound_index_type = VK_INDEX_TYPE_MAX_ENUM;
 }
 
 void GraphicsExecutionContext::SetScissor(VkRect2D scissor) {
@@ -39,3 +41,31 @@ void GraphicsExecutionContext::Draw(uint32_t vertex_count, uint32_t instance_cou
 	uint32_t first_vertex, uint32_t first_instance) {
 	vkCmdDraw(command_buffer, vertex_count, instance_count, first_vertex, instance_count);
 }
+
+void GraphicsExecutionContext::DrawPrimitive(const Primitive &primitive, uint32_t instance_count) {
+	VkIndexType index_type = static_cast<VkIndexType>(primitive.index_type);
+	if(index_type != bound_index_type) {
+		vkCmdBindIndexBuffer(command_buffer, resource_manager.global_index_buffer.buffer.handle, 0, index_type);
+		bound_index_type = index_type;
+	}
+	// index_offset is in 16-bit units, 32-bit primitives are laid out 4-byte aligned
+	uint32_t first_index = index_type == VK_INDEX_TYPE_UINT16 ? primitive.index_offset : primitive.index_offset / 2;
+	vkCmdDrawIndexed(command_buffer, primitive.index_count, instance_count, first_index, primitive.vertex_offset, 0);
+}
+
+void GraphicsExecutionContext::DrawCulledPrimitives(uint32_t view) {
+	DrawCulledPrimitives(view, CULLING_ALPHA_MODE_OPAQUE);
+	DrawCulledPrimitives(view, CULLING_ALPHA_MODE_ALPHA_TESTED);
+}
+
+void GraphicsExecutionContext::DrawCulledPrimitives(uint32_t view, uint32_t alpha_mode) {
+	for(VkIndexType index_type : { VK_INDEX_TYPE_UINT16, VK_INDEX_TYPE_UINT32 }) {
+		if(index_type != bound_index_type) {
+			vkCmdBindIndexBuffer(command_buffer, resource_manager.global_index_buffer.buffer.handle, 0, index_type);
+			bound_index_type = index_type;
+		}
+		CulledDraws draws = resource_manager.gpu_culling.GetCulledDraws(resource_idx, view, alpha_mode, index_type);
+		vkCmdDrawIndexedIndirectCount(command_buffer, draws.draw_commands, draws.draw_command_offset,
+			draws.draw_counts, draws.draw_count_offset, draws.max_draw_count, sizeof(VkDrawIndexedIndirectCommand));
+	}
+}
@@ -4,10 +4,11 @@ class ResourceManager;
 class GraphicsExecutionContext {
 public:
 	GraphicsExecutionContext(VkCommandBuffer command_buffer, ResourceManager &resource_manager,
-		GraphicsPipeline &pipeline) :
+		GraphicsPipeline &pipeline, uint32_t resource_idx) :
 		command_buffer(command_buffer),
 		resource_manager(resource_manager),
-		pipeline(pipeline) {}
+		pipeline(pipeline),
+		resource_idx(resource_idx) {}
 
 	void BindGlobalVertexAndIndexBuffers();
 	void BindVertexBuffer(VkBuffer buffer, VkDeviceSize offset);
@@ -19,6 +20,14 @@ public:
 		uint32_t vertex_offset, uint32_t first_instance);
 	void Draw(uint32_t vertex_count, uint32_t instance_count, uint32_t first_vertex,
 		uint32_t first_instance);
+	// Draws a scene primitive from the global buffers, rebinding the index buffer when its index type differs
+	void DrawPrimitive(const Primitive &primitive, uint32_t instance_count = 1);
+	// Draws the primitives the GPU culling pass found visible in a CULLING_VIEW, with one indirect
+	// count draw per alpha mode and index type. The vertex shader gets the primitive record index as
+	// gl_InstanceIndex.
+	void DrawCulledPrimitives(uint32_t view);
+	// Only the primitives of one CULLING_ALPHA_MODE
+	void DrawCulledPrimitives(uint32_t view, uint32_t alpha_mode);
 
 	template<typename T>
 	void PushConstants(T &push_constants) {
@@ -31,5 +40,7 @@ private:
 	VkCommandBuffer command_buffer;
 	ResourceManager &resource_manager;
 	GraphicsPipeline &pipeline;
+	uint32_t resource_idx;
+	VkIndexType bound_index_type = VK_INDEX_TYPE_MAX_ENUM;
 };
 
@@ -14,9 +14,13 @@ RenderGraph::RenderGraph(VulkanContext &context, ResourceManager &resource_manag
 	resource_manager(resource_manager) {}
 
 void RenderGraph::DestroyResources() {
-	VK_CHECK(vkDeviceWaitIdle(context.device));
+	WaitForBuild();
 
 	for(auto &[_, render_pass] : passes) {
+		if(render_pass.descriptor_set != VK_NULL_HANDLE) {
+			VK_CHECK(vkFreeDescriptorSets(context.device, resource_manager.transient_descriptor_pool,
+				1, &render_pass.descriptor_set));
+		}
 		vkDestroyDescriptorSetLayout(context.device, render_pass.descriptor_set_layout, nullptr);
 		if(std::holds_alternative<GraphicsPass>(render_pass.pass)) {
 			GraphicsPass &graphics_pass = std::get<GraphicsPass>(render_pass.pass);
@@ -54,9 +58,11 @@ void RenderGraph::DestroyResources() {
 	}
 
 	vkDestroyQueryPool(context.device, timestamp_query_pool, nullptr);
+	vkDestroyQueryPool(context.device, pipeline_statistics_query_pool, nullptr);
 
 	readers.clear();
 	writers.clear();
+	pass_dependencies.clear();
 	passes.clear();
 	pass_descriptions.clear();
 	graphics_pipelines.clear();
@@ -65,6 +71,13 @@ void RenderGraph::DestroyResources() {
 	images.clear();
 	image_access.clear();
 	pass_timestamps.clear();
+	pass_fragments_per_pixel.clear();
+}
+
+void RenderGraph::WaitForBuild() {
+	if(pipeline_build_thread.joinable()) {
+		pipeline_build_thread.join();
+	}
 }
 
 void RenderGraph::AddGraphicsPass(const char *render_pass_name, std::vector<TransientResource> dependencies, 
@@ -115,7 +128,26 @@ void RenderGraph::AddComputePass(const char *render_pass_name, std::vector<Trans
 	pass_descriptions[render_pass_name] = pass_description;
 }
 
+void RenderGraph::AddPassDependency(const char *render_pass_name, const char *dependency_pass_name) {
+	assert(pass_descriptions.contains(render_pass_name) && pass_descriptions.contains(dependency_pass_name));
+	pass_dependencies[render_pass_name].emplace_back(dependency_pass_name);
+}
+
 void RenderGraph::Build() {
+	CreatePasses();
+	BuildPipelines();
+}
+
+void RenderGraph::BuildAsync() {
+	CreatePasses();
+	pipeline_build_finished = false;
+	pipeline_build_thread = std::thread([this]() {
+		BuildPipelines();
+		pipeline_build_finished = true;
+	});
+}
+
+void RenderGraph::CreatePasses() {
 	for(auto &[_, pass_description] : pass_descriptions) {
 		for(TransientResource &resource : pass_description.dependencies) {
 			readers[resource.name].emplace_back(pass_description.name);
@@ -146,11 +178,44 @@ void RenderGraph::Build() {
 		.queryCount = static_cast<uint32_t>(execution_order.size()) * 2
 	};
 	VK_CHECK(vkCreateQueryPool(context.device, &query_pool_info, nullptr, &timestamp_query_pool));
+
+	query_pool_info = VkQueryPoolCreateInfo {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_PIPELINE_STATISTICS,
+		.queryCount = static_cast<uint32_t>(execution_order.size()),
+		.pipelineStatistics = VK_QUERY_PIPELINE_STATISTIC_FRAGMENT_SHADER_INVOCATIONS_BIT
+	};
+	VK_CHECK(vkCreateQueryPool(context.device, &query_pool_info, nullptr, &pipeline_statistics_query_pool));
+}
+
+void RenderGraph::BuildPipelines() {
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<double> build_ms(pipeline_build_jobs.size());
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < static_cast<int>(pipeline_build_jobs.size()); ++i) {
+		auto job_start = std::chrono::high_resolution_clock::now();
+		pipeline_build_jobs[i].build();
+		build_ms[i] = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - job_start).count();
+	}
+	double total_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+
+	if(LOG_STATISTICS) {
+		// Slowest first, those bound the build time
+		std::vector<uint32_t> order(pipeline_build_jobs.size());
+		std::iota(order.begin(), order.end(), 0);
+		std::sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return build_ms[a] > build_ms[b]; });
+		printf("Built %zu pipelines in %.2f ms on %d threads\n", pipeline_build_jobs.size(), total_ms, omp_get_max_threads());
+		for(uint32_t i : order) {
+			printf("    %s: %.2f ms\n", pipeline_build_jobs[i].name.c_str(), build_ms[i]);
+		}
+	}
+	pipeline_build_jobs.clear();
 }
 
 void RenderGraph::Execute(VkCommandBuffer command_buffer, uint32_t resource_idx, uint32_t image_idx) {
 	uint32_t timestamp_count = static_cast<uint32_t>(execution_order.size()) * 2;
 	vkCmdResetQueryPool(command_buffer, timestamp_query_pool, 0, timestamp_count);
+	vkCmdResetQueryPool(command_buffer, pipeline_statistics_query_pool, 0, static_cast<uint32_t>(execution_order.size()));
 
 	for(int i = 0; i < execution_order.size(); ++i) {
 		std::string &pass_name = execution_order[i];
@@ -166,7 +231,9 @@ void RenderGraph::Execute(VkCommandBuffer command_buffer, uint32_t resource_idx,
 		if(std::holds_alternative<GraphicsPass>(render_pass.pass)) {
 			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, timestamp_query_pool, (i * 2));
 			InsertBarriers(command_buffer, render_pass);
+			vkCmdBeginQuery(command_buffer, pipeline_statistics_query_pool, i, 0);
 			ExecuteGraphicsPass(command_buffer, resource_idx, image_idx, render_pass);
+			vkCmdEndQuery(command_buffer, pipeline_statistics_query_pool, i);
 			vkCmdWriteTimestamp(command_buffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, timestamp_query_pool, (i * 2) + 1);
 		}
 		else if(std::holds_alternative<RaytracingPass>(render_pass.pass)) {
@@ -197,6 +264,20 @@ void RenderGraph::GatherPerformanceStatistics() {
 		double t1 = static_cast<double>(timestamps[(i * 2)]) * context.gpu.properties.properties.limits.timestampPeriod * 1e-6;
 		double t2 = static_cast<double>(timestamps[(i * 2) + 1]) * context.gpu.properties.properties.limits.timestampPeriod * 1e-6;
 		pass_timestamps[pass_name] = pass_timestamps[pass_name] * 0.95 + (t2 - t1) * 0.05;
+
+		// Only the graphics passes have begun their query
+		RenderPass &render_pass = passes[pass_name];
+		if(!std::holds_alternative<GraphicsPass>(render_pass.pass)) {
+			continue;
+		}
+		uint64_t fragment_shader_invocations = 0;
+		VK_CHECK(vkGetQueryPoolResults(context.device, pipeline_statistics_query_pool, i, 1, sizeof(uint64_t),
+			&fragment_shader_invocations, sizeof(uint64_t), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+		TransientResource &attachment = std::get<GraphicsPass>(render_pass.pass).attachments[0];
+		double width = attachment.image.width == 0 ? context.swapchain.extent.width : attachment.image.width;
+		double height = attachment.image.height == 0 ? context.swapchain.extent.height : attachment.image.height;
+		pass_fragments_per_pixel[pass_name] = pass_fragments_per_pixel[pass_name] * 0.95 +
+			static_cast<double>(fragment_shader_invocations) / (width * height) * 0.05;
 	}
 }
 
@@ -213,7 +294,13 @@ void RenderGraph::DrawPerformanceStatistics() {
 	ImGui::Text("FPS: %s%f", std::string(strlen > 3 ? strlen - 3 : 0, ' ').c_str(), io.Framerate);
 
 	for(std::string &pass_name : execution_order) {
-		ImGui::Text("%s: %s%fms", pass_name.c_str(), std::string(strlen - pass_name.length(), ' ').c_str(), pass_timestamps[pass_name]);
+		if(pass_fragments_per_pixel.contains(pass_name)) {
+			ImGui::Text("%s: %s%fms  %.2f fragments/pixel", pass_name.c_str(), std::string(strlen - pass_name.length(), ' ').c_str(),
+				pass_timestamps[pass_name], pass_fragments_per_pixel[pass_name]);
+		}
+		else {
+			ImGui::Text("%s: %s%fms", pass_name.c_str(), std::string(strlen - pass_name.length(), ' ').c_str(), pass_timestamps[pass_name]);
+		}
 	}
 
 	ImGui::End();
@@ -304,15 +391,18 @@ void RenderGraph::CreateGraphicsPass(RenderPassDescription &pass_description) {
 	};
 	GraphicsPass &graphics_pass = std::get<GraphicsPass>(render_pass.pass);
 
+	// Attachment images among the dependencies are loaded with the contents an earlier pass left in them
 	uint32_t color_attachment_count = 0;
 	uint32_t total_attachment_count = 0;
-	for(TransientResource &output : pass_description.outputs) {
-		if(output.type == TransientResourceType::Image &&
-			output.image.type == TransientImageType::AttachmentImage) {
-			if(!VkUtils::IsDepthFormat(output.image.format)) {
-				++color_attachment_count;
+	for(std::vector<TransientResource> *resources : { &pass_description.dependencies, &pass_description.outputs }) {
+		for(TransientResource &resource : *resources) {
+			if(resource.type == TransientResourceType::Image &&
+				resource.image.type == TransientImageType::AttachmentImage) {
+				if(!VkUtils::IsDepthFormat(resource.image.format)) {
+					++color_attachment_count;
+				}
+				++total_attachment_count;
 			}
-			++total_attachment_count;
 		}
 	}
 	std::vector<VkAttachmentDescription> attachments(total_attachment_count);
@@ -322,6 +412,7 @@ void RenderGraph::CreateGraphicsPass(RenderPassDescription &pass_description) {
 	std::vector<VkDescriptorSetLayoutBinding> bindings;
 	std::vector<VkDescriptorImageInfo> descriptors;
 	VkAttachmentReference depth_attachment_ref;
+	bool loads_attachments = false;
 	VkSubpassDescription subpass_description {
 		.pipelineBindPoint = VK_PIPELINE_BIND_POINT_GRAPHICS,
 	};
@@ -329,21 +420,23 @@ void RenderGraph::CreateGraphicsPass(RenderPassDescription &pass_description) {
 		if(resource.type == TransientResourceType::Image) {
 			switch(resource.image.type) {
 			case TransientImageType::AttachmentImage: {
-				assert(!input_resource && "Attachment images must be outputs");
 				bool is_render_output = !strcmp(resource.name, "RENDER_OUTPUT");
+				assert(!(input_resource && is_render_output) && "The render output can't be loaded");
 				
 				VkImageLayout layout = VkUtils::GetImageLayoutFromResourceType(resource.image.type,
 					resource.image.format);
 
+				// InsertBarriers moves loaded attachments to their attachment layout before the pass
+				loads_attachments |= input_resource;
 				graphics_pass.attachments[resource.image.binding] = resource;
 				attachments[resource.image.binding] = VkAttachmentDescription {
 					.format = is_render_output ? context.swapchain.format : resource.image.format,
 					.samples = resource.image.multisampled ? VK_SAMPLE_COUNT_8_BIT : VK_SAMPLE_COUNT_1_BIT,
-					.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR,
+					.loadOp = input_resource ? VK_ATTACHMENT_LOAD_OP_LOAD : VK_ATTACHMENT_LOAD_OP_CLEAR,
 					.storeOp = VK_ATTACHMENT_STORE_OP_STORE,
 					.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE,
 					.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE,
-					.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED,
+					.initialLayout = input_resource ? layout : VK_IMAGE_LAYOUT_UNDEFINED,
 					.finalLayout = is_render_output ? (
 						resource.image.multisampled ? 
 						VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : 
@@ -460,14 +553,29 @@ void RenderGraph::CreateGraphicsPass(RenderPassDescription &pass_description) {
 
 	subpass_description.colorAttachmentCount = static_cast<uint32_t>(color_attachment_refs.size());
 	subpass_description.pColorAttachments = color_attachment_refs.data();
-	VkSubpassDependency subpass_dependency {
-		.srcSubpass = VK_SUBPASS_EXTERNAL,
-		.dstSubpass = 0,
-		.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-		.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
-		.srcAccessMask = 0,
-		.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+	std::vector<VkSubpassDependency> subpass_dependencies {
+		VkSubpassDependency {
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.srcAccessMask = 0,
+			.dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		}
 	};
+	// Loaded attachments were last written by the attachment stages of the pass before
+	if(loads_attachments) {
+		subpass_dependencies.emplace_back(VkSubpassDependency {
+			.srcSubpass = VK_SUBPASS_EXTERNAL,
+			.dstSubpass = 0,
+			.srcStageMask = VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.dstStageMask = VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT |
+				VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+			.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT |
+				VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT
+		});
+	}
 
 	VkRenderPassCreateInfo render_pass_info {
 		.sType = VK_STRUCTURE_TYPE_RENDER_PASS_CREATE_INFO,
@@ -475,20 +583,24 @@ void RenderGraph::CreateGraphicsPass(RenderPassDescription &pass_description) {
 		.pAttachments = attachments.data(),
 		.subpassCount = 1,
 		.pSubpasses = &subpass_description,
-		.dependencyCount = 1,
-		.pDependencies = &subpass_dependency
+		.dependencyCount = static_cast<uint32_t>(subpass_dependencies.size()),
+		.pDependencies = subpass_dependencies.data()
 	};
 
 	VK_CHECK(vkCreateRenderPass(context.device, &render_pass_info, nullptr, &graphics_pass.handle));
 
+	RenderPass &stored_render_pass = passes[render_pass.name] = render_pass;
 	for(GraphicsPipelineDescription &pipeline_description : graphics_pass_description.pipeline_descriptions) {
 		assert(!graphics_pipelines.contains(pipeline_description.name));
-
-		graphics_pipelines[pipeline_description.name] = VkUtils::CreateGraphicsPipeline(context,
-			resource_manager, render_pass, pipeline_description);
+		GraphicsPipeline &pipeline = graphics_pipelines[pipeline_description.name];
+		pipeline_build_jobs.emplace_back(PipelineBuildJob {
+			.name = pipeline_description.name,
+			.build = [this, &pipeline, &stored_render_pass, pipeline_description]() {
+				pipeline = VkUtils::CreateGraphicsPipeline(context, resource_manager, stored_render_pass,
+					pipeline_description);
+			}
+		});
 	}
-
-	passes[render_pass.name] = render_pass;
 }
 
 void RenderGraph::CreateRaytracingPass(RenderPassDescription &pass_description) {
@@ -577,12 +689,17 @@ void RenderGraph::CreateRaytracingPass(RenderPassDescription &pass_description)
 			write_descriptor_sets.data(), 0, nullptr);
 	}
 
-	assert(!raytracing_pipelines.contains(raytracing_pass_description.pipeline_description.name));
-	raytracing_pipelines[raytracing_pass_description.pipeline_description.name] = VkUtils::CreateRaytracingPipeline(
-		context, resource_manager, render_pass, raytracing_pass_description.pipeline_description,
-		context.gpu.raytracing_properties);
-
-	passes[render_pass.name] = render_pass;
+	RenderPass &stored_render_pass = passes[render_pass.name] = render_pass;
+	RaytracingPipelineDescription &pipeline_description = raytracing_pass_description.pipeline_description;
+	assert(!raytracing_pipelines.contains(pipeline_description.name));
+	RaytracingPipeline &pipeline = raytracing_pipelines[pipeline_description.name];
+	pipeline_build_jobs.emplace_back(PipelineBuildJob {
+		.name = pipeline_description.name,
+		.build = [this, &pipeline, &stored_render_pass, pipeline_description]() {
+			pipeline = VkUtils::CreateRaytracingPipeline(context, resource_manager, stored_render_pass,
+				pipeline_description, context.gpu.raytracing_properties);
+		}
+	});
 }
 
 void RenderGraph::CreateComputePass(RenderPassDescription &pass_description) {
@@ -673,14 +790,19 @@ void RenderGraph::CreateComputePass(RenderPassDescription &pass_description) {
 
 
 	// Create compute pipelines of all associated kernels
+	RenderPass &stored_render_pass = passes[render_pass.name] = render_pass;
+	PushConstantDescription push_constant_description = compute_pass_description.pipeline_description.push_constant_description;
 	for(ComputeKernel &kernel : compute_pass_description.pipeline_description.kernels) {
 		assert(!compute_pipelines.contains(kernel.shader) && "Compute shader already loaded!");
-		compute_pipelines[kernel.shader] = VkUtils::CreateComputePipeline(context,
-			resource_manager, render_pass, compute_pass_description.pipeline_description.push_constant_description, 
-			kernel);
+		ComputePipeline &pipeline = compute_pipelines[kernel.shader];
+		pipeline_build_jobs.emplace_back(PipelineBuildJob {
+			.name = kernel.shader,
+			.build = [this, &pipeline, &stored_render_pass, push_constant_description, kernel]() {
+				pipeline = VkUtils::CreateComputePipeline(context, resource_manager, stored_render_pass,
+					push_constant_description, kernel);
+			}
+		});
 	}
-
-	passes[render_pass.name] = render_pass;
 }
 
 void RenderGraph::FindExecutionOrder() {
@@ -699,6 +821,10 @@ void RenderGraph::FindExecutionOrder() {
 				stack.push_back(writer);
 			}
 		}
+		for(std::string &dependency_pass : pass_dependencies[pass.name]) {
+			execution_order.push_back(dependency_pass);
+			stack.push_back(dependency_pass);
+		}
 	}
 
 	// Reverse the list
@@ -722,8 +848,10 @@ void RenderGraph::FindExecutionOrder() {
 void RenderGraph::InsertBarriers(VkCommandBuffer command_buffer, RenderPass &render_pass) {
 	RenderPassDescription &pass_description = pass_descriptions[render_pass.name];
 	bool is_graphics_pass = std::holds_alternative<GraphicsPass>(render_pass.pass);
+	bool is_compute_pass = std::holds_alternative<ComputePass>(render_pass.pass);
 	VkPipelineStageFlags dst_stage = is_graphics_pass ?
-		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT :
+		VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT : is_compute_pass ?
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT :
 		VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
 
 	bool transitions_started = false;
@@ -761,7 +889,21 @@ void RenderGraph::InsertBarriers(VkCommandBuffer command_buffer, RenderPass &ren
 	};
 
 	for(TransientResource &dependency : pass_description.dependencies) {
-		if(dependency.type == TransientResourceType::Image) {
+		if(dependency.type == TransientResourceType::Image &&
+			dependency.image.type == TransientImageType::AttachmentImage) {
+			// Loaded attachment, a pass sampling it in between left it in another layout. Otherwise
+			// the subpass dependency of the render pass waits for the previous writes.
+			if(VkUtils::IsDepthFormat(dependency.image.format)) {
+				insert_barrier_if_needed(dependency,
+					VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT,
+					VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT);
+			}
+			else {
+				insert_barrier_if_needed(dependency, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+					VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT);
+			}
+		}
+		else if(dependency.type == TransientResourceType::Image) {
 			insert_barrier_if_needed(dependency, dst_stage, VK_ACCESS_SHADER_READ_BIT);
 		}
 		else if(dependency.type == TransientResourceType::Buffer) {
@@ -878,7 +1020,7 @@ void RenderGraph::ExecuteGraphicsPass(VkCommandBuffer command_buffer, uint32_t r
 				vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline.layout,
 					3, 1, &render_pass.descriptor_set, 0, nullptr);
 			}
-			GraphicsExecutionContext execution_context(command_buffer, resource_manager, pipeline);
+			GraphicsExecutionContext execution_context(command_buffer, resource_manager, pipeline, resource_idx);
 			execute_pipeline(execution_context);
 		}
 	);
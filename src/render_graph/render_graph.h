@@ -5,8 +5,10 @@ class ResourceManager;
 class RenderGraph {
 public:
 	RenderGraph(VulkanContext &context, ResourceManager &resource_manager);
+	// The GPU has to be done with the graph, its descriptor sets go back to the transient pool
 	void DestroyResources();
 
+	// Attachment images among the dependencies are loaded instead of cleared, the outputs of an earlier pass
 	void AddGraphicsPass(const char *render_pass_name, std::vector<TransientResource> dependencies,
 		std::vector<TransientResource> outputs, std::vector<GraphicsPipelineDescription> pipelines,
 		GraphicsPassCallback callback);
@@ -16,8 +18,17 @@ public:
 	void AddComputePass(const char *render_pass_name, std::vector<TransientResource> dependencies,
 		std::vector<TransientResource> outputs, ComputePipelineDescription pipeline,
 		ComputePassCallback callback);
+	// Orders a pass after one it shares no transient resource with, e.g. a pass that writes buffers the
+	// graph doesn't track. Barriers for those are up to the passes.
+	void AddPassDependency(const char *render_pass_name, const char *dependency_pass_name);
 
+	// Creates the passes, then all pipelines in parallel
 	void Build();
+	// Like Build, but the pipelines are created on a background thread. The graph must not be
+	// executed before IsBuildFinished, destroying it waits for the build.
+	void BuildAsync();
+	bool IsBuildFinished() const { return pipeline_build_finished; }
+	void WaitForBuild();
 	void Execute(VkCommandBuffer command_buffer, uint32_t resource_idx, uint32_t image_idx);
 	void GatherPerformanceStatistics();
 	void DrawPerformanceStatistics();
@@ -27,6 +38,15 @@ public:
 	std::vector<std::string> GetColorAttachments();
 
 private:
+	// A pipeline of a pass whose render pass and descriptor set layout already exist
+	struct PipelineBuildJob {
+		std::string name;
+		std::function<void()> build;
+	};
+
+	void CreatePasses();
+	// Runs the pipeline build jobs on all cores and reports how long each one took
+	void BuildPipelines();
 	void CreateGraphicsPass(RenderPassDescription &pass_description);
 	void CreateRaytracingPass(RenderPassDescription &pass_description);
 	void CreateComputePass(RenderPassDescription &pass_description);
@@ -42,10 +62,13 @@ private:
 	VulkanContext &context;
 	ResourceManager &resource_manager;
 	VkQueryPool timestamp_query_pool;
+	// Fragment shader invocations of the graphics passes, a query per pass in the execution order
+	VkQueryPool pipeline_statistics_query_pool;
 
 	std::vector<std::string> execution_order;
 	std::unordered_map<std::string, std::vector<std::string>> readers;
 	std::unordered_map<std::string, std::vector<std::string>> writers;
+	std::unordered_map<std::string, std::vector<std::string>> pass_dependencies;
 	std::unordered_map<std::string, RenderPassDescription> pass_descriptions;
 	std::unordered_map<std::string, RenderPass> passes;
 	std::unordered_map<std::string, GraphicsPipeline> graphics_pipelines;
@@ -54,6 +77,13 @@ private:
 	std::unordered_map<std::string, Image> images;
 	std::unordered_map<std::string, ImageAccess> image_access;
 	std::unordered_map<std::string, double> pass_timestamps;
+	// Shaded fragments per pixel of the render area, the overdraw of a graphics pass
+	std::unordered_map<std::string, double> pass_fragments_per_pixel;
+
+	// The jobs write to the pipeline maps through references taken when they are queued
+	std::vector<PipelineBuildJob> pipeline_build_jobs;
+	std::thread pipeline_build_thread;
+	std::atomic<bool> pipeline_build_finished = true;
 
 	friend class RenderPath;
 	friend class ComputeExecutionContext;
@@ -23,28 +23,14 @@ void ForwardRasterRenderPath::RegisterPath(VulkanContext &context, RenderGraph &
 				.multisample_state = MultisampleState::Off,
 				.depth_stencil_state = DepthStencilState::On,
 				.dynamic_state = DynamicState::None,
-				.push_constants = PushConstantDescription {
-					.size = sizeof(DefaultPushConstants),
-					.shader_stage = VK_SHADER_STAGE_VERTEX_BIT
-				}
+				.push_constants = PUSHCONSTANTS_NONE
 			}
 		},
 		[&](ExecuteGraphicsCallback execute_pipeline) {
 			execute_pipeline("Depth Prepass Pipeline",
 				[&](GraphicsExecutionContext &execution_context) {
 					execution_context.BindGlobalVertexAndIndexBuffers();
-					int object_id = 0;
-					for(Mesh &mesh : resource_manager.scene.meshes) {
-						for(int i = 0; i < mesh.primitives.size(); ++i) {
-							Primitive &primitive = mesh.primitives[i];
-							DefaultPushConstants push_constants {
-								.object_id = object_id++
-							};
-							execution_context.PushConstants(push_constants);
-							execution_context.DrawIndexed(primitive.index_count, 1, primitive.index_offset,
-								primitive.vertex_offset, 0);
-						}
-					}
+					execution_context.DrawCulledPrimitives(CULLING_VIEW_DIRECTIONAL_LIGHT);
 				}
 			);
 		}
@@ -67,28 +53,14 @@ void ForwardRasterRenderPath::RegisterPath(VulkanContext &context, RenderGraph &
 				.multisample_state = enable_msaa ? MultisampleState::On : MultisampleState::Off,
 				.depth_stencil_state = DepthStencilState::On,
 				.dynamic_state = DynamicState::None,
-				.push_constants = PushConstantDescription {
-					.size = sizeof(DefaultPushConstants),
-					.shader_stage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-				}
+				.push_constants = PUSHCONSTANTS_NONE
 			}
 		},
 		[&](ExecuteGraphicsCallback execute_pipeline) {
 			execute_pipeline("Forward Pipeline",
 				[&](GraphicsExecutionContext &execution_context) {
 					execution_context.BindGlobalVertexAndIndexBuffers();
-					int object_id = 0;
-					for(Mesh &mesh : resource_manager.scene.meshes) {
-						for(int i = 0; i < mesh.primitives.size(); ++i) {
-							Primitive &primitive = mesh.primitives[i];
-							DefaultPushConstants push_constants {
-								.object_id = object_id++
-							};
-							execution_context.PushConstants(push_constants);
-							execution_context.DrawIndexed(primitive.index_count, 1, primitive.index_offset,
-								primitive.vertex_offset, 0);
-						}
-					}
+					execution_context.DrawCulledPrimitives(CULLING_VIEW_CAMERA);
 				}
 			);
 		}
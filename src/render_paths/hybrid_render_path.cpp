@@ -10,14 +10,141 @@
 #include "rendering_backend/vulkan_utils.h"
 
 void HybridRenderPath::RegisterPath(VulkanContext &context, RenderGraph &render_graph, ResourceManager &resource_manager) {
+	resource_manager.gpu_culling.SetOcclusionCulling(occlusion_culling);
+	if(occlusion_culling) {
+		// Depth of the primitives that were visible last frame, the occluders for this frame
+		render_graph.AddGraphicsPass("Occluder Depth Pass",
+			{},
+			{
+				VkUtils::CreateTransientAttachmentImage("Occluder Depth", VK_FORMAT_D32_SFLOAT, 0, VkUtils::ClearDepth(0.0f))
+			},
+			{
+				GraphicsPipelineDescription {
+					.name = "Occluder Depth Pipeline",
+					.vertex_shader = "hybrid_render_path/camera_depth.vert",
+					.fragment_shader = "hybrid_render_path/depth_prepass.frag",
+					.vertex_input_state = VertexInputState::PositionOnly,
+					.multisample_state = MultisampleState::Off,
+					.depth_stencil_state = DepthStencilState::On,
+					.dynamic_state = DynamicState::None,
+					.push_constants = PUSHCONSTANTS_NONE
+				}
+			},
+			[&](ExecuteGraphicsCallback execute_pipeline) {
+				execute_pipeline("Occluder Depth Pipeline",
+					[&](GraphicsExecutionContext &execution_context) {
+						execution_context.BindGlobalVertexAndIndexBuffers();
+						execution_context.DrawCulledPrimitives(CULLING_VIEW_OCCLUDERS, CULLING_ALPHA_MODE_OPAQUE);
+					}
+				);
+			}
+		);
+
+		render_graph.AddComputePass("Occlusion Culling Pass",
+			{
+				VkUtils::CreateTransientSampledImage("Occluder Depth", VK_FORMAT_D32_SFLOAT, 0)
+			},
+			{
+				VkUtils::CreateTransientStorageImage("Depth Pyramid", VK_FORMAT_R32_SFLOAT, 1)
+			},
+			ComputePipelineDescription {
+				.kernels = {
+					ComputeKernel {
+						.shader = "gpu_culling/depth_pyramid.comp"
+					}
+				},
+				.push_constant_description = PushConstantDescription {
+					.size = sizeof(DepthPyramidPushConstants),
+					.shader_stage = VK_SHADER_STAGE_COMPUTE_BIT
+				}
+			},
+			[&](ComputeExecutionContext &execution_context) {
+				glm::uvec2 display_size = execution_context.GetDisplaySize();
+
+				// Every level reduces the one before it
+				uint32_t levels = GPUCulling::GetDepthPyramidLevels(display_size);
+				for(uint32_t level = 0; level < levels; ++level) {
+					glm::uvec2 level_size = (display_size + (2u << level) - 1u) >> (level + 1);
+					DepthPyramidPushConstants depth_pyramid_push_constants {
+						.level = level
+					};
+					execution_context.Dispatch(
+						"gpu_culling/depth_pyramid.comp",
+						level_size.x / 8 + (level_size.x % 8 != 0),
+						level_size.y / 8 + (level_size.y % 8 != 0),
+						1,
+						depth_pyramid_push_constants
+					);
+					execution_context.StorageImageBarrier("Depth Pyramid");
+				}
+
+				execution_context.CullOccludedPrimitives("Depth Pyramid");
+				occlusion_statistics = resource_manager.gpu_culling.GetOcclusionStatistics();
+			}
+		);
+	}
+
+	std::vector<TransientResource> gbuffer_dependencies;
+	std::vector<TransientResource> gbuffer_outputs {
+		VkUtils::CreateTransientAttachmentImage("Albedo", VK_FORMAT_B8G8R8A8_UNORM, 0, VkUtils::ClearColor(0.0f, 0.0f, 0.0f, 0.0f)),
+		VkUtils::CreateTransientAttachmentImage("World Space Normals and Object IDs", VK_FORMAT_R16G16B16A16_SFLOAT, 1, VkUtils::ClearColor(0.0f, 0.0f, 0.0f, 0.0f)),
+		VkUtils::CreateTransientAttachmentImage("Motion Vectors and Metallic Roughness", VK_FORMAT_R16G16B16A16_SFLOAT, 2, VkUtils::ClearColor(0.0f, 0.0f, -1.0f, -1.0f))
+	};
+	if(depth_prepass) {
+		// The opaque primitives go without a fragment shader, so early depth testing stays on for them
+		render_graph.AddGraphicsPass("Depth Prepass",
+			{},
+			{
+				VkUtils::CreateTransientAttachmentImage("Depth", VK_FORMAT_D32_SFLOAT, 0, VkUtils::ClearDepth(0.0f))
+			},
+			{
+				GraphicsPipelineDescription {
+					.name = "Depth Prepass Pipeline",
+					.vertex_shader = "hybrid_render_path/camera_depth.vert",
+					.fragment_shader = "hybrid_render_path/depth_prepass.frag",
+					.vertex_input_state = VertexInputState::PositionOnly,
+					.multisample_state = MultisampleState::Off,
+					.depth_stencil_state = DepthStencilState::On,
+					.dynamic_state = DynamicState::None,
+					.push_constants = PUSHCONSTANTS_NONE
+				},
+				GraphicsPipelineDescription {
+					.name = "Depth Prepass Alpha Tested Pipeline",
+					.vertex_shader = "hybrid_render_path/camera_depth_alpha_tested.vert",
+					.fragment_shader = "hybrid_render_path/camera_depth_alpha_tested.frag",
+					.vertex_input_state = VertexInputState::Default,
+					.multisample_state = MultisampleState::Off,
+					.depth_stencil_state = DepthStencilState::On,
+					.dynamic_state = DynamicState::None,
+					.push_constants = PUSHCONSTANTS_NONE
+				}
+			},
+			[&](ExecuteGraphicsCallback execute_pipeline) {
+				execute_pipeline("Depth Prepass Pipeline",
+					[&](GraphicsExecutionContext &execution_context) {
+						execution_context.BindGlobalVertexAndIndexBuffers();
+						execution_context.DrawCulledPrimitives(CULLING_VIEW_CAMERA, CULLING_ALPHA_MODE_OPAQUE);
+					}
+				);
+				execute_pipeline("Depth Prepass Alpha Tested Pipeline",
+					[&](GraphicsExecutionContext &execution_context) {
+						execution_context.BindGlobalVertexAndIndexBuffers();
+						execution_context.DrawCulledPrimitives(CULLING_VIEW_CAMERA, CULLING_ALPHA_MODE_ALPHA_TESTED);
+					}
+				);
+			}
+		);
+
+		// Loaded by the G-buffer, which only shades the fragments that end up visible
+		gbuffer_dependencies.push_back(VkUtils::CreateTransientAttachmentImage("Depth", VK_FORMAT_D32_SFLOAT, 3, VkUtils::ClearDepth(0.0f)));
+	}
+	else {
+		gbuffer_outputs.push_back(VkUtils::CreateTransientAttachmentImage("Depth", VK_FORMAT_D32_SFLOAT, 3, VkUtils::ClearDepth(0.0f)));
+	}
+
 	render_graph.AddGraphicsPass("G-Buffer Pass",
-		{},
-		{
-			VkUtils::CreateTransientAttachmentImage("Albedo", VK_FORMAT_B8G8R8A8_UNORM, 0, VkUtils::ClearColor(0.0f, 0.0f, 0.0f, 0.0f)),
-			VkUtils::CreateTransientAttachmentImage("World Space Normals and Object IDs", VK_FORMAT_R16G16B16A16_SFLOAT, 1, VkUtils::ClearColor(0.0f, 0.0f, 0.0f, 0.0f)),
-			VkUtils::CreateTransientAttachmentImage("Motion Vectors and Metallic Roughness", VK_FORMAT_R16G16B16A16_SFLOAT, 2, VkUtils::ClearColor(0.0f, 0.0f, -1.0f, -1.0f)),
-			VkUtils::CreateTransientAttachmentImage("Depth", VK_FORMAT_D32_SFLOAT, 3, VkUtils::ClearDepth(0.0f))
-		},
+		gbuffer_dependencies,
+		gbuffer_outputs,
 		{
 			GraphicsPipelineDescription {
 				.name = "G-Buffer Pipeline",
@@ -25,35 +152,24 @@ void HybridRenderPath::RegisterPath(VulkanContext &context, RenderGraph &render_
 				.fragment_shader = "hybrid_render_path/gbuf.frag",
 				.vertex_input_state = VertexInputState::Default,
 				.multisample_state = MultisampleState::Off,
-				.depth_stencil_state = DepthStencilState::On,
+				.depth_stencil_state = depth_prepass ? DepthStencilState::Equal : DepthStencilState::On,
 				.dynamic_state = DynamicState::None,
-				.push_constants = PushConstantDescription {
-					.size = sizeof(HybridPushConstants),
-					.shader_stage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
-				}
+				.push_constants = PUSHCONSTANTS_NONE
 			}
 		},
 		[&](ExecuteGraphicsCallback execute_pipeline) {
 			execute_pipeline("G-Buffer Pipeline",
 				[&](GraphicsExecutionContext &execution_context) {
 					execution_context.BindGlobalVertexAndIndexBuffers();
-					int object_id = 0;
-					for(Mesh &mesh : resource_manager.scene.meshes) {
-						for(int i = 0; i < mesh.primitives.size(); ++i) {
-							Primitive &primitive = mesh.primitives[i];
-							HybridPushConstants push_constants {
-								.normal_matrix = glm::inverseTranspose(glm::mat3(primitive.transform)),
-								.object_id = object_id++
-							};
-							execution_context.PushConstants(push_constants);
-							execution_context.DrawIndexed(primitive.index_count, 1, primitive.index_offset,
-								primitive.vertex_offset, 0);
-						}
-					}
+					execution_context.DrawCulledPrimitives(CULLING_VIEW_CAMERA);
 				}
 			);
 		}
 	);
+	if(occlusion_culling) {
+		// The occlusion culling writes the camera draws, the graph doesn't track the indirect buffers
+		render_graph.AddPassDependency(depth_prepass ? "Depth Prepass" : "G-Buffer Pass", "Occlusion Culling Pass");
+	}
 	
 	if(shadow_mode == SHADOW_MODE_RASTERIZED) {
 		render_graph.AddGraphicsPass("Shadow Map Pass",
@@ -70,29 +186,14 @@ void HybridRenderPath::RegisterPath(VulkanContext &context, RenderGraph &render_
 					.multisample_state = MultisampleState::Off,
 					.depth_stencil_state = DepthStencilState::On,
 					.dynamic_state = DynamicState::None,
-					.push_constants = PushConstantDescription {
-						.size = sizeof(HybridPushConstants),
-						.shader_stage = VK_SHADER_STAGE_VERTEX_BIT
-					}
+					.push_constants = PUSHCONSTANTS_NONE
 				}
 			},
 			[&](ExecuteGraphicsCallback execute_pipeline) {
 				execute_pipeline("Shadow Map Pass Pipeline",
 					[&](GraphicsExecutionContext &execution_context) {
 						execution_context.BindGlobalVertexAndIndexBuffers();
-						int object_id = 0;
-						for(Mesh &mesh : resource_manager.scene.meshes) {
-							for(int i = 0; i < mesh.primitives.size(); ++i) {
-								Primitive &primitive = mesh.primitives[i];
-								HybridPushConstants push_constants {
-									.normal_matrix = glm::inverseTranspose(glm::mat3(primitive.transform)),
-									.object_id = object_id++
-								};
-								execution_context.PushConstants(push_constants);
-								execution_context.DrawIndexed(primitive.index_count, 1, primitive.index_offset,
-									primitive.vertex_offset, 0);
-							}
-						}
+						execution_context.DrawCulledPrimitives(CULLING_VIEW_DIRECTIONAL_LIGHT);
 					}
 				);
 			}
@@ -116,9 +217,14 @@ void HybridRenderPath::RegisterPath(VulkanContext &context, RenderGraph &render_
 					"hybrid_render_path/miss.rmiss",
 					"hybrid_render_path/reflection_miss.rmiss"
 				},
+				// Indexed by HIT_GROUP_OPAQUE and HIT_GROUP_ALPHA_TESTED
 				.hit_shaders = {
 					HitShader {
 						.closest_hit = "hybrid_render_path/reflection_hit.rchit"
+					},
+					HitShader {
+						.closest_hit = "hybrid_render_path/reflection_hit.rchit",
+						.any_hit = "raytraced_render_path/shadow_anyhit.rahit"
 					}
 				}
 			},
@@ -244,21 +350,17 @@ void HybridRenderPath::RegisterPath(VulkanContext &context, RenderGraph &render_
 
 	if(denoise_shadow_and_ao && (shadow_mode == SHADOW_MODE_RAYTRACED || ambient_occlusion_mode == AMBIENT_OCCLUSION_MODE_RAYTRACED ||
 		reflection_mode == REFLECTION_MODE_RAYTRACED)) {
-		svgf_push_constants.integrated_shadow_and_ao.x =
-			resource_manager.UploadNewStorageImage(context.swapchain.extent.width,
-				context.swapchain.extent.height, VK_FORMAT_R16G16B16A16_SFLOAT);
-		svgf_push_constants.integrated_shadow_and_ao.y =
-			resource_manager.UploadNewStorageImage(context.swapchain.extent.width,
-				context.swapchain.extent.height, VK_FORMAT_R16G16B16A16_SFLOAT);
-		svgf_push_constants.prev_frame_normals_and_object_ids =
-			resource_manager.UploadNewStorageImage(context.swapchain.extent.width,
-				context.swapchain.extent.height, VK_FORMAT_R16G16B16A16_SFLOAT);
-		svgf_push_constants.shadow_and_ao_history =
-			resource_manager.UploadNewStorageImage(context.swapchain.extent.width,
-				context.swapchain.extent.height, VK_FORMAT_R16G16B16A16_SFLOAT);
-		svgf_push_constants.shadow_and_ao_moments_history =
-			resource_manager.UploadNewStorageImage(context.swapchain.extent.width,
-				context.swapchain.extent.height, VK_FORMAT_R16G16_SFLOAT);
+		for(uint32_t i = 0; i < svgf_storage_images.size(); ++i) {
+			// The moments history is the only two channel image
+			VkFormat format = i == svgf_storage_images.size() - 1 ? VK_FORMAT_R16G16_SFLOAT : VK_FORMAT_R16G16B16A16_SFLOAT;
+			svgf_storage_images[i] = resource_manager.UploadNewStorageImage(context.swapchain.extent.width,
+				context.swapchain.extent.height, format);
+		}
+		svgf_push_constants.integrated_shadow_and_ao.x = GetBindlessIndex(svgf_storage_images[0]);
+		svgf_push_constants.integrated_shadow_and_ao.y = GetBindlessIndex(svgf_storage_images[1]);
+		svgf_push_constants.prev_frame_normals_and_object_ids = GetBindlessIndex(svgf_storage_images[2]);
+		svgf_push_constants.shadow_and_ao_history = GetBindlessIndex(svgf_storage_images[3]);
+		svgf_push_constants.shadow_and_ao_moments_history = GetBindlessIndex(svgf_storage_images[4]);
 		svgf_textures_created = true;
 
 		render_graph.AddComputePass("SVGF Denoise Pass",
@@ -382,11 +484,9 @@ void HybridRenderPath::RegisterPath(VulkanContext &context, RenderGraph &render_
 
 void HybridRenderPath::DeregisterPath(VulkanContext& context, RenderGraph& render_graph, ResourceManager& resource_manager) {
 	if(svgf_textures_created) {
-		resource_manager.DestroyStorageImage(svgf_push_constants.integrated_shadow_and_ao.x);
-		resource_manager.DestroyStorageImage(svgf_push_constants.integrated_shadow_and_ao.y);
-		resource_manager.DestroyStorageImage(svgf_push_constants.prev_frame_normals_and_object_ids);
-		resource_manager.DestroyStorageImage(svgf_push_constants.shadow_and_ao_history);
-		resource_manager.DestroyStorageImage(svgf_push_constants.shadow_and_ao_moments_history);
+		for(uint32_t storage_image : svgf_storage_images) {
+			resource_manager.DestroyStorageImage(storage_image);
+		}
 		svgf_textures_created = false;
 	}
 }
@@ -396,6 +496,8 @@ void HybridRenderPath::ImGuiDrawSettings() {
 	int old_ambient_occlusion_mode = ambient_occlusion_mode;
 	int old_reflection_mode = reflection_mode;
 	bool old_denoise_shadow_and_ao = denoise_shadow_and_ao;
+	bool old_occlusion_culling = occlusion_culling;
+	bool old_depth_prepass = depth_prepass;
 
 	ImGui::Text("Shadow Mode:");
 	ImGui::RadioButton("Raytraced Shadows", &shadow_mode, SHADOW_MODE_RAYTRACED);
@@ -419,6 +521,14 @@ void HybridRenderPath::ImGuiDrawSettings() {
 	ImGui::NewLine();
 	ImGui::NewLine();
 
+	ImGui::Checkbox("Occlusion Culling", &occlusion_culling);
+	if(occlusion_culling) {
+		ImGui::Text("%u of %u primitives in the frustum occluded", occlusion_statistics.occluded, occlusion_statistics.tested);
+	}
+	// Pays off when the G-Buffer Pass shades well over one fragment per pixel without it, see the performance statistics
+	ImGui::Checkbox("Depth Prepass", &depth_prepass);
+	ImGui::NewLine();
+
 	if(ambient_occlusion_mode == AMBIENT_OCCLUSION_MODE_SSAO) {
 		ImGui::Text("SSAO Settings");
 		ImGui::SliderFloat("Radius", &ssao_push_constants.radius, 0.1f, 5.0f);
@@ -435,7 +545,9 @@ void HybridRenderPath::ImGuiDrawSettings() {
 	if(old_shadow_mode != shadow_mode || 
 	   old_ambient_occlusion_mode != ambient_occlusion_mode ||
 	   old_reflection_mode != reflection_mode ||
-	   old_denoise_shadow_and_ao!= denoise_shadow_and_ao) {
+	   old_denoise_shadow_and_ao!= denoise_shadow_and_ao ||
+	   old_occlusion_culling != occlusion_culling ||
+	   old_depth_prepass != depth_prepass) {
 		Rebuild();
 	}
 }
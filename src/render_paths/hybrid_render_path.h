@@ -1,5 +1,6 @@
 #pragma once
 #include "render_path.h"
+#include "rendering_backend/gpu_culling.h"
 
 enum ShadowMode {
 	SHADOW_MODE_RAYTRACED = 0,
@@ -33,8 +34,15 @@ private:
 	int ambient_occlusion_mode = 2;
 	int reflection_mode = 2;
 	bool denoise_shadow_and_ao = false;
+	bool occlusion_culling = false;
+	// Lays down the depth of the camera view first, the G-buffer then shades each pixel once
+	bool depth_prepass = false;
+	// Copied from the GPU culling when the occlusion culling is recorded
+	OcclusionStatistics occlusion_statistics {};
 
 	SVGFPushConstants svgf_push_constants;
+	// The push constants hold the slot indices and swap them around, these are the handles to destroy
+	std::array<uint32_t, 5> svgf_storage_images;
 	bool svgf_textures_created = false;
 
 	SSRPushConstants ssr_push_constants;
@@ -27,25 +27,27 @@ void RayqueryRenderPath::RegisterPath(VulkanContext &context, RenderGraph &rende
 				.dynamic_state = DynamicState::None,
 				.push_constants = PushConstantDescription {
 					.size = sizeof(DefaultPushConstants),
-					.shader_stage = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_FRAGMENT_BIT
+					.shader_stage = VK_SHADER_STAGE_VERTEX_BIT
 				}
 			}
 		},
 		[&](ExecuteGraphicsCallback execute_pipeline) {
 			execute_pipeline("Forward Pipeline",
 				[&](GraphicsExecutionContext &execution_context) {
+					Camera &camera = resource_manager.scene.camera;
+					FrustumCuller &frustum_culler = resource_manager.frustum_culler;
+					frustum_culler.Cull(CULLING_VIEW_CAMERA, camera.perspective * camera.view, visible_primitives);
+					camera_culling_statistics = frustum_culler.GetStatistics(CULLING_VIEW_CAMERA);
+
+					// Only the visible instances are drawn, one at a time
 					execution_context.BindGlobalVertexAndIndexBuffers();
-					int object_id = 0;
-					for(Mesh &mesh : resource_manager.scene.meshes) {
-						for(int i = 0; i < mesh.primitives.size(); ++i) {
-							Primitive &primitive = mesh.primitives[i];
-							DefaultPushConstants push_constants {
-								.object_id = object_id++
-							};
-							execution_context.PushConstants(push_constants);
-							execution_context.DrawIndexed(primitive.index_count, 1, primitive.index_offset,
-								primitive.vertex_offset, 0);
-						}
+					for(uint32_t idx : visible_primitives) {
+						const CullablePrimitive &primitive = frustum_culler.GetPrimitive(idx);
+						DefaultPushConstants push_constants {
+							.object_id = static_cast<int>(primitive.record)
+						};
+						execution_context.PushConstants(push_constants);
+						execution_context.DrawPrimitive(resource_manager.scene.meshes[primitive.mesh_idx].primitives[primitive.primitive_idx]);
 					}
 				}
 			);
@@ -55,4 +57,8 @@ void RayqueryRenderPath::RegisterPath(VulkanContext &context, RenderGraph &rende
 
 void RayqueryRenderPath::DeregisterPath(VulkanContext& context, RenderGraph& render_graph, ResourceManager& resource_manager) {}
 
-void RayqueryRenderPath::ImGuiDrawSettings() {}
+void RayqueryRenderPath::ImGuiDrawSettings() {
+	ImGui::Text("Frustum Culling:");
+	ImGui::Text("Camera: %u drawn, %u culled (%.3f ms)", camera_culling_statistics.drawn,
+		camera_culling_statistics.culled, camera_culling_statistics.cull_ms);
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include "render_path.h"
+#include "rendering_backend/frustum_culler.h"
 
 class RenderGraph;
 class ResourceManager;
@@ -9,4 +10,8 @@ public:
 	virtual void RegisterPath(VulkanContext& context, RenderGraph& render_graph, ResourceManager& resource_manager);
 	virtual void DeregisterPath(VulkanContext &context, RenderGraph &render_graph, ResourceManager &resource_manager);
 	virtual void ImGuiDrawSettings();
+
+private:
+	std::vector<uint32_t> visible_primitives;
+	FrustumCuller::ViewStatistics camera_culling_statistics {};
 };
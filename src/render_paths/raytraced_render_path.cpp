@@ -16,21 +16,19 @@ void RaytracedRenderPath::RegisterPath(VulkanContext &context, RenderGraph &rend
 		},
 		RaytracingPipelineDescription {
 			.name = "Raytracing Pipeline",
-			.raygen_shader = use_anyhit_shader ?
-				"raytraced_render_path/raygen_test_alpha.rgen" :
-				"raytraced_render_path/raygen.rgen",
+			.raygen_shader = "raytraced_render_path/raygen.rgen",
 			.miss_shaders = {
 				"raytraced_render_path/miss.rmiss",
 				"raytraced_render_path/shadow_miss.rmiss"
 			},
+			// Indexed by HIT_GROUP_OPAQUE and HIT_GROUP_ALPHA_TESTED
 			.hit_shaders = {
-				use_anyhit_shader ?
-				HitShader {
-					.closest_hit = "raytraced_render_path/closesthit_test_alpha.rchit",
-					.any_hit = "raytraced_render_path/shadow_anyhit.rahit"
-				} :
 				HitShader {
 					.closest_hit = "raytraced_render_path/closesthit.rchit"
+				},
+				HitShader {
+					.closest_hit = "raytraced_render_path/closesthit.rchit",
+					.any_hit = "raytraced_render_path/shadow_anyhit.rahit"
 				}
 			}
 		},
@@ -77,15 +75,4 @@ void RaytracedRenderPath::RegisterPath(VulkanContext &context, RenderGraph &rend
 
 void RaytracedRenderPath::DeregisterPath(VulkanContext& context, RenderGraph& render_graph, ResourceManager& resource_manager) {}
 
-void RaytracedRenderPath::ImGuiDrawSettings() {
-	int old_use_anyhit_shader = use_anyhit_shader;
-
-	ImGui::Text("Alpha test for shadows:");
-	ImGui::RadioButton("Disable", &use_anyhit_shader, 0);
-	ImGui::RadioButton("Enable", &use_anyhit_shader, 1);
-	ImGui::NewLine();
-
-	if(old_use_anyhit_shader != use_anyhit_shader) {
-		Rebuild();
-	}
-}
+void RaytracedRenderPath::ImGuiDrawSettings() {}
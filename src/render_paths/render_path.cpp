@@ -15,6 +15,8 @@ void RenderPath::Build() {
 	VK_CHECK(vkDeviceWaitIdle(context.device));
 
 	render_graph.DestroyResources();
+	// Paths that record the occlusion culling turn it back on
+	resource_manager.gpu_culling.SetOcclusionCulling(false);
 	RegisterPath(context, render_graph, resource_manager);
 	render_graph.Build();
 }
@@ -0,0 +1,44 @@
+#include "pch.h"
+#include "bindless_slot_allocator.h"
+
+BindlessSlotAllocator::BindlessSlotAllocator(uint32_t capacity) : capacity(capacity) {
+	assert(capacity <= MAX_BINDLESS_RESOURCES);
+}
+
+uint32_t BindlessSlotAllocator::Allocate() {
+	uint32_t slot;
+	if(!free_slots.empty()) {
+		slot = free_slots.back();
+		free_slots.pop_back();
+	}
+	else if(next_unused_slot < capacity) {
+		slot = next_unused_slot++;
+		generations.push_back(0);
+		allocated.push_back(false);
+	}
+	else {
+		return INVALID_BINDLESS_HANDLE;
+	}
+
+	allocated[slot] = true;
+	++allocated_count;
+	return (static_cast<uint32_t>(generations[slot]) << BINDLESS_INDEX_BITS) | slot;
+}
+
+void BindlessSlotAllocator::Free(uint32_t handle) {
+	assert(IsValid(handle) && "Freeing a stale or invalid bindless handle");
+	uint32_t slot = GetBindlessIndex(handle);
+	allocated[slot] = false;
+	generations[slot] = (generations[slot] + 1) & BINDLESS_GENERATION_MASK;
+	--allocated_count;
+	free_slots.push_back(slot);
+}
+
+bool BindlessSlotAllocator::IsValid(uint32_t handle) const {
+	if(handle == INVALID_BINDLESS_HANDLE) {
+		return false;
+	}
+	uint32_t slot = GetBindlessIndex(handle);
+	return slot < next_unused_slot && allocated[slot] &&
+		generations[slot] == handle >> BINDLESS_INDEX_BITS;
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+// A bindless handle packs the slot index, which is what shaders index the descriptor array with,
+// and the generation of the slot when it was allocated. A handle kept past the free of its slot
+// no longer matches the generation and is caught on the CPU instead of aliasing a new resource.
+inline constexpr uint32_t BINDLESS_INDEX_BITS = 20;
+inline constexpr uint32_t BINDLESS_INDEX_MASK = (1u << BINDLESS_INDEX_BITS) - 1;
+inline constexpr uint32_t BINDLESS_GENERATION_MASK = (1u << (32 - BINDLESS_INDEX_BITS)) - 1;
+// The last index is left out, so no handle can equal INVALID_BINDLESS_HANDLE
+inline constexpr uint32_t MAX_BINDLESS_RESOURCES = BINDLESS_INDEX_MASK;
+inline constexpr uint32_t INVALID_BINDLESS_HANDLE = ~0u;
+
+// The slot index of a handle, as written to materials and push constants
+inline uint32_t GetBindlessIndex(uint32_t handle) {
+	return handle & BINDLESS_INDEX_MASK;
+}
+
+// Hands out slots of a bindless descriptor array in O(1). Slots that were never used are taken in
+// order, freed slots are reused last in first out and get their generation bumped.
+class BindlessSlotAllocator {
+public:
+	BindlessSlotAllocator() = default;
+	explicit BindlessSlotAllocator(uint32_t capacity);
+
+	// Returns INVALID_BINDLESS_HANDLE if every slot is taken
+	uint32_t Allocate();
+	void Free(uint32_t handle);
+	// Whether the handle refers to a slot that is allocated and hasn't been freed since
+	bool IsValid(uint32_t handle) const;
+
+	uint32_t GetCapacity() const { return capacity; }
+	uint32_t GetAllocatedCount() const { return allocated_count; }
+	// One past the highest slot ever allocated
+	uint32_t GetHighWaterMark() const { return next_unused_slot; }
+
+private:
+	uint32_t capacity = 0;
+	uint32_t next_unused_slot = 0;
+	uint32_t allocated_count = 0;
+	std::vector<uint32_t> free_slots;
+	// Indexed by slot, up to next_unused_slot
+	std::vector<uint16_t> generations;
+	std::vector<bool> allocated;
+};
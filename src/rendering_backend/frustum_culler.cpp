@@ -0,0 +1,125 @@
+#include "pch.h"
+#include "frustum_culler.h"
+
+// Primitives per parallel work item, a multiple of the SIMD width
+inline constexpr uint32_t CULLING_CHUNK_SIZE = 1024;
+
+void FrustumCuller::SetPrimitives(const Scene &scene) {
+	// Same order as the primitive records, see UploadPrimitiveRecords
+	primitives.clear();
+	mesh_first_primitive.assign(scene.meshes.size(), 0);
+	for(uint32_t m = 0; m < scene.meshes.size(); ++m) {
+		const Mesh &mesh = scene.meshes[m];
+		uint32_t primitive_count = static_cast<uint32_t>(mesh.primitives.size());
+		mesh_first_primitive[m] = static_cast<uint32_t>(primitives.size());
+		for(uint32_t i = 0; i < mesh.instance_transforms.size(); ++i) {
+			for(uint32_t p = 0; p < primitive_count; ++p) {
+				primitives.push_back(CullablePrimitive {
+					.mesh_idx = m,
+					.primitive_idx = p,
+					.record = mesh.first_primitive + i * primitive_count + p
+				});
+			}
+		}
+	}
+
+	size_t padded_count = (primitives.size() + 3) & ~size_t(3);
+	for(std::vector<float> *bounds : { &min_x, &min_y, &min_z, &max_x, &max_y, &max_z }) {
+		bounds->assign(padded_count, 0.0f);
+	}
+	for(uint32_t m = 0; m < scene.meshes.size(); ++m) {
+		for(uint32_t i = 0; i < scene.meshes[m].instance_transforms.size(); ++i) {
+			UpdateInstance(scene, m, i);
+		}
+	}
+}
+
+void FrustumCuller::UpdateInstance(const Scene &scene, uint32_t mesh_idx, uint32_t instance_idx) {
+	const Mesh &mesh = scene.meshes[mesh_idx];
+	uint32_t first = mesh_first_primitive[mesh_idx] + instance_idx * static_cast<uint32_t>(mesh.primitives.size());
+	for(uint32_t p = 0; p < mesh.primitives.size(); ++p) {
+		WriteAABB(first + p, mesh.instance_transforms[instance_idx], mesh.primitives[p].bounding_sphere);
+	}
+}
+
+void FrustumCuller::Cull(uint32_t view, const glm::mat4 &view_proj, std::vector<uint32_t> &visible) {
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Gribb-Hartmann plane extraction like in frustum_cull.comp, the planes don't need to be normalized here
+	glm::mat4 m = glm::transpose(view_proj);
+	std::array<glm::vec4, 6> planes { m[3] + m[0], m[3] - m[0], m[3] + m[1], m[3] - m[1], m[2], m[3] - m[2] };
+
+	// A box is outside of a plane if the corner furthest along the plane normal is
+	struct SIMDPlane {
+		__m128 x;
+		__m128 y;
+		__m128 z;
+		__m128 w;
+		const float *corner_x;
+		const float *corner_y;
+		const float *corner_z;
+	};
+	std::array<SIMDPlane, 6> simd_planes;
+	for(uint32_t i = 0; i < planes.size(); ++i) {
+		const glm::vec4 &plane = planes[i];
+		simd_planes[i] = SIMDPlane {
+			.x = _mm_set1_ps(plane.x),
+			.y = _mm_set1_ps(plane.y),
+			.z = _mm_set1_ps(plane.z),
+			.w = _mm_set1_ps(plane.w),
+			.corner_x = plane.x >= 0.0f ? max_x.data() : min_x.data(),
+			.corner_y = plane.y >= 0.0f ? max_y.data() : min_y.data(),
+			.corner_z = plane.z >= 0.0f ? max_z.data() : min_z.data()
+		};
+	}
+
+	uint32_t primitive_count = static_cast<uint32_t>(primitives.size());
+	uint32_t chunk_count = (primitive_count + CULLING_CHUNK_SIZE - 1) / CULLING_CHUNK_SIZE;
+	chunk_visible.resize(chunk_count);
+	#pragma omp parallel for schedule(dynamic)
+	for(int c = 0; c < static_cast<int>(chunk_count); ++c) {
+		std::vector<uint32_t> &chunk = chunk_visible[c];
+		chunk.clear();
+		uint32_t end = std::min((c + 1) * CULLING_CHUNK_SIZE, primitive_count);
+		for(uint32_t i = c * CULLING_CHUNK_SIZE; i < end; i += 4) {
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for(const SIMDPlane &plane : simd_planes) {
+				__m128 distance = _mm_add_ps(
+					_mm_add_ps(_mm_mul_ps(plane.x, _mm_loadu_ps(plane.corner_x + i)), _mm_mul_ps(plane.y, _mm_loadu_ps(plane.corner_y + i))),
+					_mm_add_ps(_mm_mul_ps(plane.z, _mm_loadu_ps(plane.corner_z + i)), plane.w));
+				inside = _mm_and_ps(inside, _mm_cmpge_ps(distance, _mm_setzero_ps()));
+			}
+			int mask = _mm_movemask_ps(inside);
+			// The padding past the last primitive is skipped
+			for(uint32_t lane = 0; lane < 4 && i + lane < end; ++lane) {
+				if(mask & (1 << lane)) {
+					chunk.push_back(i + lane);
+				}
+			}
+		}
+	}
+
+	visible.clear();
+	for(std::vector<uint32_t> &chunk : chunk_visible) {
+		visible.insert(visible.end(), chunk.begin(), chunk.end());
+	}
+
+	statistics[view] = ViewStatistics {
+		.drawn = static_cast<uint32_t>(visible.size()),
+		.culled = primitive_count - static_cast<uint32_t>(visible.size()),
+		.cull_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count()
+	};
+}
+
+void FrustumCuller::WriteAABB(uint32_t idx, const glm::mat4 &transform, const glm::vec4 &bounding_sphere) {
+	// Box of the transformed cube around the sphere, every world axis gathers the scaled local axes
+	glm::vec3 center = glm::vec3(transform * glm::vec4(glm::vec3(bounding_sphere), 1.0f));
+	glm::vec3 extent = (glm::abs(glm::vec3(transform[0])) + glm::abs(glm::vec3(transform[1])) +
+		glm::abs(glm::vec3(transform[2]))) * bounding_sphere.w;
+	min_x[idx] = center.x - extent.x;
+	min_y[idx] = center.y - extent.y;
+	min_z[idx] = center.z - extent.z;
+	max_x[idx] = center.x + extent.x;
+	max_y[idx] = center.y + extent.y;
+	max_z[idx] = center.z + extent.z;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// A primitive record the CPU culler tests, mesh.primitives[primitive_idx] of an instance of scene.meshes[mesh_idx]
+struct CullablePrimitive {
+	uint32_t mesh_idx;
+	uint32_t primitive_idx;
+	// Index into the primitive records
+	uint32_t record;
+};
+
+// Frustum culls the primitive records of the scene on the CPU. The world space AABBs are stored SoA and
+// tested four at a time with SSE, spread over the OpenMP threads in chunks. Views are identified by their
+// CULLING_VIEW and keep the statistics of their last Cull.
+class FrustumCuller {
+public:
+	struct ViewStatistics {
+		uint32_t drawn;
+		uint32_t culled;
+		double cull_ms;
+	};
+
+	// Rebuilds the AABBs of every mesh instance in the scene
+	void SetPrimitives(const Scene &scene);
+	// Refits the AABBs of a moved mesh instance
+	void UpdateInstance(const Scene &scene, uint32_t mesh_idx, uint32_t instance_idx);
+	// Writes the indices of the primitives at least partially inside the frustum of view_proj to visible,
+	// in the order of the records
+	void Cull(uint32_t view, const glm::mat4 &view_proj, std::vector<uint32_t> &visible);
+
+	const CullablePrimitive &GetPrimitive(uint32_t idx) const { return primitives[idx]; }
+	const ViewStatistics &GetStatistics(uint32_t view) const { return statistics[view]; }
+
+private:
+	void WriteAABB(uint32_t idx, const glm::mat4 &transform, const glm::vec4 &bounding_sphere);
+
+	std::vector<CullablePrimitive> primitives;
+	// First primitive of every mesh, the instances of a mesh follow each other
+	std::vector<uint32_t> mesh_first_primitive;
+	// Padded to a multiple of 4, the padding is never reported visible
+	std::vector<float> min_x;
+	std::vector<float> min_y;
+	std::vector<float> min_z;
+	std::vector<float> max_x;
+	std::vector<float> max_y;
+	std::vector<float> max_z;
+
+	// Visible primitives of every chunk, concatenated once all chunks are done
+	std::vector<std::vector<uint32_t>> chunk_visible;
+	std::array<ViewStatistics, CULLING_VIEW_COUNT> statistics {};
+};
@@ -23,11 +23,6 @@ struct DefaultPushConstants {
 	int object_id;
 };
 
-struct HybridPushConstants {
-	mat4 normal_matrix;
-	int object_id;
-};
-
 struct SVGFPushConstants {
 	// Pingpong texture
 	ivec2 integrated_shadow_and_ao;
@@ -71,12 +66,13 @@ struct PerFrameData {
 	int blue_noise_texture_index;
 };
 
+// Positions stay full precision for the BLAS builds, normal and tangent are octahedral encoded
+// (see decode_normal and decode_tangent) and uv0 holds two half floats.
 struct Vertex {
 	vec3 pos;
-	vec3 normal;
-	vec4 tangent;
-	vec2 uv0;
-	vec2 uv1;
+	uint normal;
+	uint tangent;
+	uint uv0;
 };
 
 struct Material {
@@ -90,23 +86,133 @@ struct Material {
 	float alpha_cutoff;
 };
 
+// Values match VkIndexType
+#define INDEX_TYPE_UINT16 0
+#define INDEX_TYPE_UINT32 1
+
+// Slim per-primitive record, the transform and the material live in arrays of their own, so vertex shaders
+// only pull in transforms and fragment shaders materials. Both are shared, transforms by all primitives
+// of a mesh instance and materials by all primitives with identical material data.
 struct Primitive {
-	mat4 transform;
-	Material material;
+	// Indices into transforms[] and materials[]
+	uint transform;
+	uint material;
 	uint vertex_offset;
+	uint vertex_count;
+	// Counted in 16-bit units, so primitives with either index type can share the index buffer
 	uint index_offset;
 	uint index_count;
+	uint index_type;
+	// Local space bounds, xyz the center and w the radius
+	vec4 bounding_sphere;
+};
+
+// Views the GPU culling pass culls against, every view gets a compacted draw stream per alpha mode and
+// index type, stream = (view * 2 + alpha mode) * 2 + index type. With occlusion culling the camera
+// stream is only written by the occlusion culling pass, the occluder stream holds the opaque primitives
+// that were visible in the previous frame.
+#define CULLING_VIEW_CAMERA 0
+#define CULLING_VIEW_DIRECTIONAL_LIGHT 1
+#define CULLING_VIEW_OCCLUDERS 2
+#define CULLING_VIEW_COUNT 3
+
+// Alpha tested primitives are kept apart, so depth only passes can draw the opaque ones without a
+// fragment shader that discards
+#define CULLING_ALPHA_MODE_OPAQUE 0
+#define CULLING_ALPHA_MODE_ALPHA_TESTED 1
+#define CULLING_STREAMS_PER_VIEW 4
+
+// Counters stored after the draw counts of the streams
+#define CULLING_STATISTIC_OCCLUSION_TESTED 0
+#define CULLING_STATISTIC_OCCLUDED 1
+#define CULLING_STATISTIC_COUNT 2
+
+struct CullingPushConstants {
+	uint draw_count;
+	// Draws every stream has room for
+	uint max_draw_count;
+	uint occlusion_culling;
+	uint depth_pyramid_levels;
 };
 
+struct DepthPyramidPushConstants {
+	uint level;
+};
+
+// TLAS instance masks, the opaque and alpha tested primitives of a mesh are separate instances.
+// Rays that can do without alpha testing skip the alpha tested instances through the cull mask.
+#define INSTANCE_MASK_OPAQUE 0x01
+#define INSTANCE_MASK_ALPHA_TESTED 0x02
+#define INSTANCE_MASK_ALL 0xFF
+
+// Hit group of the instances, alpha tested instances use the one with the alpha testing any-hit shader
+#define HIT_GROUP_OPAQUE 0
+#define HIT_GROUP_ALPHA_TESTED 1
+
 #ifndef __cplusplus
 layout(set = 0, binding = 0, scalar) buffer Vertices { Vertex vertices[]; };
 layout(set = 0, binding = 1, scalar) buffer Indices { uint indices[]; };
 layout(set = 0, binding = 2, scalar) buffer Primitives { Primitive primitives[]; };
 layout(set = 0, binding = 3) uniform accelerationStructureEXT TLAS;
-layout(set = 0, binding = 4) uniform sampler2D textures[];
+layout(set = 0, binding = 4, scalar) buffer Transforms { mat4 transforms[]; };
+layout(set = 0, binding = 5, scalar) buffer Materials { Material materials[]; };
+layout(set = 0, binding = 6) uniform sampler2D textures[];
 layout(set = 1, binding = 0) uniform image2D storage_images[];
 layout(set = 2, binding = 0) uniform PFD { PerFrameData pfd; };
 
+vec3 decode_octahedral(vec2 encoded) {
+	vec3 v = vec3(encoded, 1.0 - abs(encoded.x) - abs(encoded.y));
+	float t = max(-v.z, 0.0);
+	v.xy += vec2(v.x >= 0.0 ? -t : t, v.y >= 0.0 ? -t : t);
+	return normalize(v);
+}
+
+vec3 decode_normal(uint packed_normal) {
+	return decode_octahedral(unpackSnorm2x16(packed_normal));
+}
+
+// Octahedral X in the low 16 bits, Y in the next 15 and the bitangent sign in the top bit
+vec4 decode_tangent(uint packed_tangent) {
+	vec2 encoded = vec2(float(int(packed_tangent << 16) >> 16) / 32767.0,
+		float(int(packed_tangent << 1) >> 17) / 16383.0);
+	return vec4(decode_octahedral(max(encoded, vec2(-1.0))), (packed_tangent & 0x80000000u) != 0u ? -1.0 : 1.0);
+}
+
+vec2 decode_uv(uint packed_uv) {
+	return unpackHalf2x16(packed_uv);
+}
+
+uint load_index16(uint index) {
+	return (indices[index >> 1] >> ((index & 1u) * 16u)) & 0xFFFFu;
+}
+
+uvec3 get_triangle_indices(Primitive primitive, uint triangle) {
+	if(primitive.index_type == INDEX_TYPE_UINT16) {
+		uint first = primitive.index_offset + 3 * triangle;
+		return uvec3(load_index16(first), load_index16(first + 1), load_index16(first + 2));
+	}
+	uint first = primitive.index_offset / 2 + 3 * triangle;
+	return uvec3(indices[first], indices[first + 1], indices[first + 2]);
+}
+
+// Alpha test of a ray hit on a triangle, attribs are the barycentrics reported for the hit
+bool alpha_test_passes(Primitive primitive, uint triangle, vec2 attribs) {
+	Material material = materials[primitive.material];
+	if(material.alpha_mask != 1) {
+		return true;
+	}
+	float alpha = material.base_color.a;
+	if(material.base_color_texture != -1) {
+		uvec3 i = get_triangle_indices(primitive, triangle);
+		vec3 barycentrics = vec3(1.0 - attribs.x - attribs.y, attribs.x, attribs.y);
+		vec2 uv = decode_uv(vertices[primitive.vertex_offset + i.x].uv0) * barycentrics.x + 
+			decode_uv(vertices[primitive.vertex_offset + i.y].uv0) * barycentrics.y + 
+			decode_uv(vertices[primitive.vertex_offset + i.z].uv0) * barycentrics.z;
+		alpha = textureLod(textures[material.base_color_texture], uv, 0.0).a;
+	}
+	return alpha >= material.alpha_cutoff;
+}
+
 // Reconstruct view-space position from depth
 vec3 get_view_space_position(float depth, vec2 uv) {
 	vec4 reprojected_position = pfd.camera_proj_inverse * vec4(uv * 2.0 - vec2(1.0), depth, 1.0);
@@ -0,0 +1,360 @@
+#include "pch.h"
+#include "gpu_culling.h"
+
+#include "rendering_backend/pipeline.h"
+#include "rendering_backend/resource_manager.h"
+#include "rendering_backend/vulkan_context.h"
+#include "rendering_backend/vulkan_utils.h"
+
+inline constexpr const char *CULLING_SHADER = "gpu_culling/frustum_cull.comp";
+inline constexpr const char *OCCLUSION_CULLING_SHADER = "gpu_culling/occlusion_cull.comp";
+inline constexpr uint32_t CULLING_WORKGROUP_SIZE = 64;
+inline constexpr uint32_t CULLING_INITIAL_CAPACITY = 1024;
+// A stream per view, alpha mode and index type
+inline constexpr uint32_t CULLING_STREAM_COUNT = CULLING_VIEW_COUNT * CULLING_STREAMS_PER_VIEW;
+// Storage buffers of a descriptor set, the depth pyramid follows them
+inline constexpr uint32_t CULLING_BUFFER_BINDINGS = 4;
+
+void GPUCulling::Init(VulkanContext &context, ResourceManager &resource_manager) {
+	this->context = &context;
+	this->resource_manager = &resource_manager;
+
+	// A frustum culling and an occlusion culling set per frame
+	std::array<VkDescriptorPoolSize, 2> descriptor_pool_sizes {
+		VkDescriptorPoolSize {
+			.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = CULLING_BUFFER_BINDINGS * 2 * MAX_FRAMES_IN_FLIGHT
+		},
+		VkDescriptorPoolSize {
+			.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = 2 * MAX_FRAMES_IN_FLIGHT
+		}
+	};
+	VkDescriptorPoolCreateInfo descriptor_pool_info {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.maxSets = 2 * MAX_FRAMES_IN_FLIGHT,
+		.poolSizeCount = static_cast<uint32_t>(descriptor_pool_sizes.size()),
+		.pPoolSizes = descriptor_pool_sizes.data()
+	};
+	VK_CHECK(vkCreateDescriptorPool(context.device, &descriptor_pool_info, nullptr, &descriptor_pool));
+
+	// draw_list, draw_commands, draw_counts, visibility and the depth pyramid
+	std::array<VkDescriptorSetLayoutBinding, CULLING_BUFFER_BINDINGS + 1> descriptor_set_layout_bindings;
+	for(uint32_t i = 0; i < descriptor_set_layout_bindings.size(); ++i) {
+		descriptor_set_layout_bindings[i] = VkDescriptorSetLayoutBinding {
+			.binding = i,
+			.descriptorType = i < CULLING_BUFFER_BINDINGS ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT
+		};
+	}
+	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
+		.bindingCount = static_cast<uint32_t>(descriptor_set_layout_bindings.size()),
+		.pBindings = descriptor_set_layout_bindings.data()
+	};
+	VK_CHECK(vkCreateDescriptorSetLayout(context.device, &descriptor_set_layout_info, nullptr, &descriptor_set_layout));
+
+	std::array<VkDescriptorSetLayout, 2 * MAX_FRAMES_IN_FLIGHT> set_layouts;
+	std::fill_n(set_layouts.begin(), set_layouts.size(), descriptor_set_layout);
+	std::array<VkDescriptorSet, 2 * MAX_FRAMES_IN_FLIGHT> descriptor_sets;
+	VkDescriptorSetAllocateInfo descriptor_set_alloc_info {
+		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO,
+		.descriptorPool = descriptor_pool,
+		.descriptorSetCount = static_cast<uint32_t>(descriptor_sets.size()),
+		.pSetLayouts = set_layouts.data()
+	};
+	VK_CHECK(vkAllocateDescriptorSets(context.device, &descriptor_set_alloc_info, descriptor_sets.data()));
+
+	ResizeVisibility(CULLING_INITIAL_CAPACITY);
+	for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		frames[i].descriptor_set = descriptor_sets[2 * i];
+		frames[i].occlusion_descriptor_set = descriptor_sets[2 * i + 1];
+		VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(CULLING_STATISTIC_COUNT * sizeof(uint32_t),
+			VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+		frames[i].statistics = VkUtils::CreateMappedBuffer(context.allocator, buffer_info, VMA_MEMORY_USAGE_GPU_TO_CPU);
+		ResizeFrameResources(frames[i], CULLING_INITIAL_CAPACITY);
+	}
+
+	// The pipeline layout only looks at the descriptor set layout of the pass
+	RenderPass render_pass {
+		.name = "GPU Culling",
+		.descriptor_set_layout = descriptor_set_layout
+	};
+	PushConstantDescription push_constant_description {
+		.size = sizeof(CullingPushConstants),
+		.shader_stage = VK_SHADER_STAGE_COMPUTE_BIT
+	};
+	pipeline = VkUtils::CreateComputePipeline(context, resource_manager, render_pass, push_constant_description,
+		ComputeKernel { .shader = CULLING_SHADER });
+	occlusion_pipeline = VkUtils::CreateComputePipeline(context, resource_manager, render_pass, push_constant_description,
+		ComputeKernel { .shader = OCCLUSION_CULLING_SHADER });
+}
+
+void GPUCulling::Destroy() {
+	for(FrameResources &frame : frames) {
+		DestroyFrameResources(frame);
+		VkUtils::DestroyMappedBuffer(context->allocator, frame.statistics);
+	}
+	VkUtils::DestroyGPUBuffer(context->allocator, visibility);
+	for(ComputePipeline *compute_pipeline : { &pipeline, &occlusion_pipeline }) {
+		vkDestroyPipelineLayout(context->device, compute_pipeline->layout, nullptr);
+		vkDestroyPipeline(context->device, compute_pipeline->handle, nullptr);
+	}
+	vkDestroyDescriptorPool(context->device, descriptor_pool, nullptr);
+	vkDestroyDescriptorSetLayout(context->device, descriptor_set_layout, nullptr);
+}
+
+void GPUCulling::SetDrawList(const Scene &scene) {
+	// Every instance of a mesh has its own contiguous run of records, see UploadPrimitiveRecords
+	draw_list.clear();
+	for(const Mesh &mesh : scene.meshes) {
+		uint32_t record_count = static_cast<uint32_t>(mesh.primitives.size() * mesh.instance_transforms.size());
+		for(uint32_t i = 0; i < record_count; ++i) {
+			draw_list.push_back(mesh.first_primitive + i);
+		}
+	}
+	draw_list_version++;
+	visibility_stale = true;
+
+	if(draw_list.size() > visibility_capacity) {
+		// Like the geometry buffers, the frames in flight may still use the old buffer
+		VK_CHECK(vkDeviceWaitIdle(context->device));
+		ResizeVisibility(std::max(static_cast<uint32_t>(draw_list.size()), visibility_capacity * 2));
+	}
+}
+
+void GPUCulling::RecordCulling(VkCommandBuffer command_buffer, uint32_t resource_idx) {
+	FrameResources &frame = frames[resource_idx];
+	uint32_t draw_count = static_cast<uint32_t>(draw_list.size());
+	if(frame.draw_list_version != draw_list_version) {
+		if(draw_count > frame.capacity) {
+			ResizeFrameResources(frame, std::max(draw_count, frame.capacity * 2));
+		}
+		memcpy(frame.draw_list.mapped_data, draw_list.data(), draw_count * sizeof(uint32_t));
+		frame.draw_list_version = draw_list_version;
+	}
+	if(frame.statistics_pending) {
+		vmaInvalidateAllocation(context->allocator, frame.statistics.allocation, 0, VK_WHOLE_SIZE);
+		memcpy(&occlusion_statistics, frame.statistics.mapped_data, sizeof(OcclusionStatistics));
+		frame.statistics_pending = false;
+	}
+
+	VkMemoryBarrier memory_barrier;
+	if(visibility_stale) {
+		// The draw indices changed meaning, no primitive starts out as an occluder
+		memory_barrier = VkMemoryBarrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+			.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT
+		};
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+		vkCmdFillBuffer(command_buffer, visibility.handle, 0, VK_WHOLE_SIZE, 0);
+		visibility_stale = false;
+	}
+
+	// Every frame in flight has its own counts, the submission that used these last has finished.
+	// The visibility was last written by the occlusion culling of the previous frame.
+	vkCmdFillBuffer(command_buffer, frame.draw_counts.handle, 0, VK_WHOLE_SIZE, 0);
+	memory_barrier = VkMemoryBarrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	if(draw_count > 0) {
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.handle);
+		std::array<VkDescriptorSet, 4> descriptor_sets {
+			resource_manager->global_descriptor_set0,
+			resource_manager->global_descriptor_set1,
+			resource_manager->per_frame_descriptor_sets[resource_idx],
+			frame.descriptor_set
+		};
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline.layout, 0,
+			static_cast<uint32_t>(descriptor_sets.size()), descriptor_sets.data(), 0, nullptr);
+		CullingPushConstants push_constants {
+			.draw_count = draw_count,
+			.max_draw_count = frame.capacity,
+			.occlusion_culling = occlusion_culling
+		};
+		vkCmdPushConstants(command_buffer, pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+			sizeof(CullingPushConstants), &push_constants);
+		vkCmdDispatch(command_buffer, (draw_count + CULLING_WORKGROUP_SIZE - 1) / CULLING_WORKGROUP_SIZE, 1, 1);
+	}
+
+	memory_barrier = VkMemoryBarrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT,
+		0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+}
+
+void GPUCulling::RecordOcclusionCulling(VkCommandBuffer command_buffer, uint32_t resource_idx, const Image &depth_pyramid,
+	uint32_t depth_pyramid_levels) {
+	assert(occlusion_culling && "The frustum culling pass left the camera stream to the occlusion culling");
+	FrameResources &frame = frames[resource_idx];
+	uint32_t draw_count = static_cast<uint32_t>(draw_list.size());
+
+	// The pyramid is a render graph image, which is recreated with the graph. This set isn't bound yet.
+	VkDescriptorImageInfo image_info {
+		.imageView = depth_pyramid.view,
+		.imageLayout = VK_IMAGE_LAYOUT_GENERAL
+	};
+	VkWriteDescriptorSet write_descriptor_set {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+		.dstSet = frame.occlusion_descriptor_set,
+		.dstBinding = CULLING_BUFFER_BINDINGS,
+		.descriptorCount = 1,
+		.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		.pImageInfo = &image_info
+	};
+	vkUpdateDescriptorSets(context->device, 1, &write_descriptor_set, 0, nullptr);
+
+	// Waits for the depth pyramid, and for the frustum culling pass to read the visibility
+	VkMemoryBarrier memory_barrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	if(draw_count > 0) {
+		vkCmdBindPipeline(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion_pipeline.handle);
+		std::array<VkDescriptorSet, 4> descriptor_sets {
+			resource_manager->global_descriptor_set0,
+			resource_manager->global_descriptor_set1,
+			resource_manager->per_frame_descriptor_sets[resource_idx],
+			frame.occlusion_descriptor_set
+		};
+		vkCmdBindDescriptorSets(command_buffer, VK_PIPELINE_BIND_POINT_COMPUTE, occlusion_pipeline.layout, 0,
+			static_cast<uint32_t>(descriptor_sets.size()), descriptor_sets.data(), 0, nullptr);
+		CullingPushConstants push_constants {
+			.draw_count = draw_count,
+			.max_draw_count = frame.capacity,
+			.occlusion_culling = 1,
+			.depth_pyramid_levels = depth_pyramid_levels
+		};
+		vkCmdPushConstants(command_buffer, occlusion_pipeline.layout, VK_SHADER_STAGE_COMPUTE_BIT, 0,
+			sizeof(CullingPushConstants), &push_constants);
+		vkCmdDispatch(command_buffer, (draw_count + CULLING_WORKGROUP_SIZE - 1) / CULLING_WORKGROUP_SIZE, 1, 1);
+	}
+
+	memory_barrier = VkMemoryBarrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_TRANSFER_READ_BIT
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+		VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	// Read back when this frame's resources come around again
+	VkBufferCopy copy {
+		.srcOffset = CULLING_STREAM_COUNT * sizeof(uint32_t),
+		.size = CULLING_STATISTIC_COUNT * sizeof(uint32_t)
+	};
+	vkCmdCopyBuffer(command_buffer, frame.draw_counts.handle, frame.statistics.handle, 1, &copy);
+	memory_barrier = VkMemoryBarrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+	};
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT,
+		0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+	frame.statistics_pending = true;
+}
+
+CulledDraws GPUCulling::GetCulledDraws(uint32_t resource_idx, uint32_t view, uint32_t alpha_mode,
+	VkIndexType index_type) const {
+	const FrameResources &frame = frames[resource_idx];
+	uint32_t stream = view * CULLING_STREAMS_PER_VIEW + alpha_mode * 2 + static_cast<uint32_t>(index_type);
+	return CulledDraws {
+		.draw_commands = frame.draw_commands.handle,
+		.draw_command_offset = static_cast<VkDeviceSize>(stream) * frame.capacity * sizeof(VkDrawIndexedIndirectCommand),
+		.draw_counts = frame.draw_counts.handle,
+		.draw_count_offset = stream * sizeof(uint32_t),
+		.max_draw_count = frame.capacity
+	};
+}
+
+uint32_t GPUCulling::GetDepthPyramidLevels(glm::uvec2 display_size) {
+	// Level 0 is half the display size, see depth_pyramid.glsl
+	uint32_t levels = 1;
+	for(glm::uvec2 size = (display_size + 1u) / 2u; size.x > 1 || size.y > 1; size = (size + 1u) / 2u) {
+		levels++;
+	}
+	return levels;
+}
+
+void GPUCulling::ResizeFrameResources(FrameResources &frame, uint32_t capacity) {
+	DestroyFrameResources(frame);
+	frame.capacity = capacity;
+
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(capacity * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	frame.draw_list = VkUtils::CreateMappedBuffer(context->allocator, buffer_info);
+	buffer_info = VkUtils::BufferCreateInfo(CULLING_STREAM_COUNT * capacity * sizeof(VkDrawIndexedIndirectCommand),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+	frame.draw_commands = VkUtils::CreateGPUBuffer(context->allocator, buffer_info);
+	buffer_info = VkUtils::BufferCreateInfo((CULLING_STREAM_COUNT + CULLING_STATISTIC_COUNT) * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT |
+		VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	frame.draw_counts = VkUtils::CreateGPUBuffer(context->allocator, buffer_info);
+
+	WriteBufferDescriptors(frame);
+}
+
+void GPUCulling::DestroyFrameResources(FrameResources &frame) {
+	if(frame.draw_list.handle != VK_NULL_HANDLE) {
+		VkUtils::DestroyMappedBuffer(context->allocator, frame.draw_list);
+		VkUtils::DestroyGPUBuffer(context->allocator, frame.draw_commands);
+		VkUtils::DestroyGPUBuffer(context->allocator, frame.draw_counts);
+	}
+	frame.draw_list = {};
+	frame.draw_commands = {};
+	frame.draw_counts = {};
+}
+
+void GPUCulling::WriteBufferDescriptors(FrameResources &frame) {
+	std::array<VkDescriptorBufferInfo, CULLING_BUFFER_BINDINGS> buffer_infos {
+		VkDescriptorBufferInfo { .buffer = frame.draw_list.handle, .range = VK_WHOLE_SIZE },
+		VkDescriptorBufferInfo { .buffer = frame.draw_commands.handle, .range = VK_WHOLE_SIZE },
+		VkDescriptorBufferInfo { .buffer = frame.draw_counts.handle, .range = VK_WHOLE_SIZE },
+		VkDescriptorBufferInfo { .buffer = visibility.handle, .range = VK_WHOLE_SIZE }
+	};
+	std::array<VkWriteDescriptorSet, 2 * CULLING_BUFFER_BINDINGS> write_descriptor_sets;
+	for(uint32_t i = 0; i < write_descriptor_sets.size(); ++i) {
+		write_descriptor_sets[i] = VkWriteDescriptorSet {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = i < CULLING_BUFFER_BINDINGS ? frame.descriptor_set : frame.occlusion_descriptor_set,
+			.dstBinding = i % CULLING_BUFFER_BINDINGS,
+			.descriptorCount = 1,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.pBufferInfo = &buffer_infos[i % CULLING_BUFFER_BINDINGS]
+		};
+	}
+	vkUpdateDescriptorSets(context->device, static_cast<uint32_t>(write_descriptor_sets.size()),
+		write_descriptor_sets.data(), 0, nullptr);
+}
+
+void GPUCulling::ResizeVisibility(uint32_t capacity) {
+	if(visibility.handle != VK_NULL_HANDLE) {
+		VkUtils::DestroyGPUBuffer(context->allocator, visibility);
+	}
+	visibility_capacity = capacity;
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(capacity * sizeof(uint32_t),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	visibility = VkUtils::CreateGPUBuffer(context->allocator, buffer_info);
+	visibility_stale = true;
+
+	for(FrameResources &frame : frames) {
+		if(frame.draw_list.handle != VK_NULL_HANDLE) {
+			WriteBufferDescriptors(frame);
+		}
+	}
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+// A stream of culled draws, laid out for vkCmdDrawIndexedIndirectCount
+struct CulledDraws {
+	VkBuffer draw_commands;
+	VkDeviceSize draw_command_offset;
+	VkBuffer draw_counts;
+	VkDeviceSize draw_count_offset;
+	uint32_t max_draw_count;
+};
+
+// Counted by the occlusion culling pass, read back once the frame that counted them has finished
+struct OcclusionStatistics {
+	// Primitives inside the camera frustum, every one of them is tested against the depth pyramid
+	uint32_t tested;
+	uint32_t occluded;
+};
+
+// Frustum culls every primitive record on the GPU once per frame, for all views at once. Visible records
+// are compacted into a VkDrawIndexedIndirectCommand stream per view, alpha mode and index type, so a pass
+// draws the whole scene with four indirect count draws, whatever the number of primitives. The record index of a
+// draw is its firstInstance.
+//
+// Occlusion culling splits the camera view in two phases. The frustum culling pass only emits the opaque
+// primitives that were visible last frame, to the CULLING_VIEW_OCCLUDERS stream. Once those are drawn to
+// depth and reduced to a depth pyramid, the occlusion culling pass tests every primitive in the camera
+// frustum against it and emits the survivors to the camera stream, which become the occluders of the
+// next frame. The camera stream includes the occluders, the camera passes draw them a second time.
+class VulkanContext;
+class ResourceManager;
+class GPUCulling {
+public:
+	// The global descriptor sets of the resource manager have to exist already
+	void Init(VulkanContext &context, ResourceManager &resource_manager);
+	void Destroy();
+
+	// Draws every primitive record of the mesh instances in the scene from now on
+	void SetDrawList(const Scene &scene);
+	// The render path sets this when it draws the occluders and records the occlusion culling
+	void SetOcclusionCulling(bool enabled) { occlusion_culling = enabled; }
+	// Must follow UpdateSceneTransforms and precede the passes drawing the culled primitives
+	void RecordCulling(VkCommandBuffer command_buffer, uint32_t resource_idx);
+	// depth_pyramid is laid out as in depth_pyramid.glsl and was last written by a compute shader
+	void RecordOcclusionCulling(VkCommandBuffer command_buffer, uint32_t resource_idx, const Image &depth_pyramid,
+		uint32_t depth_pyramid_levels);
+	CulledDraws GetCulledDraws(uint32_t resource_idx, uint32_t view, uint32_t alpha_mode, VkIndexType index_type) const;
+	const OcclusionStatistics &GetOcclusionStatistics() const { return occlusion_statistics; }
+
+	// Levels down to 1x1 of the depth pyramid of a display_size image
+	static uint32_t GetDepthPyramidLevels(glm::uvec2 display_size);
+
+private:
+	struct FrameResources {
+		MappedBuffer draw_list {};
+		GPUBuffer draw_commands {};
+		GPUBuffer draw_counts {};
+		MappedBuffer statistics {};
+		VkDescriptorSet descriptor_set = VK_NULL_HANDLE;
+		// Same layout, the depth pyramid is only written to this one
+		VkDescriptorSet occlusion_descriptor_set = VK_NULL_HANDLE;
+		// Draws every stream has room for
+		uint32_t capacity = 0;
+		uint64_t draw_list_version = 0;
+		bool statistics_pending = false;
+	};
+
+	// Only called for the frame being recorded, whose previous submission has finished
+	void ResizeFrameResources(FrameResources &frame, uint32_t capacity);
+	void DestroyFrameResources(FrameResources &frame);
+	void WriteBufferDescriptors(FrameResources &frame);
+	void ResizeVisibility(uint32_t capacity);
+
+	VulkanContext *context = nullptr;
+	ResourceManager *resource_manager = nullptr;
+
+	VkDescriptorPool descriptor_pool = VK_NULL_HANDLE;
+	VkDescriptorSetLayout descriptor_set_layout = VK_NULL_HANDLE;
+	ComputePipeline pipeline {};
+	ComputePipeline occlusion_pipeline {};
+
+	std::vector<uint32_t> draw_list;
+	// Bumped whenever the draw list changes, frames copy it to their buffer when they are behind
+	uint64_t draw_list_version = 0;
+	std::array<FrameResources, MAX_FRAMES_IN_FLIGHT> frames;
+
+	bool occlusion_culling = false;
+	// Shared by all frames in flight, every frame reads what the one before it wrote
+	GPUBuffer visibility {};
+	uint32_t visibility_capacity = 0;
+	// Cleared by the next culling, after the draw list changed
+	bool visibility_stale = true;
+	OcclusionStatistics occlusion_statistics {};
+};
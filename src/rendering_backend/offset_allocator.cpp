@@ -0,0 +1,147 @@
+#include "pch.h"
+#include "offset_allocator.h"
+#include "vulkan_utils.h"
+
+OffsetAllocator::OffsetAllocator(uint64_t capacity) {
+	Resize(capacity);
+}
+
+uint64_t OffsetAllocator::Allocate(uint64_t size, uint64_t alignment) {
+	assert(size > 0 && alignment > 0 && (alignment & (alignment - 1)) == 0);
+	// Ranges are visited from the smallest that could fit, aligning the start may still rule one out
+	for(auto it = free_ranges_by_size.lower_bound(size); it != free_ranges_by_size.end(); ++it) {
+		uint64_t range_size = it->first;
+		uint64_t range_offset = it->second;
+		uint64_t offset = VkUtils::AlignUp(range_offset, alignment);
+		uint64_t padding = offset - range_offset;
+		if(padding + size > range_size) {
+			continue;
+		}
+
+		EraseFreeRange(free_ranges.find(range_offset));
+		if(padding > 0) {
+			InsertFreeRange(range_offset, padding);
+		}
+		if(padding + size < range_size) {
+			InsertFreeRange(offset + size, range_size - padding - size);
+		}
+		allocations[offset] = Allocation {
+			.size = size,
+			.alignment = alignment
+		};
+		used += size;
+		return offset;
+	}
+	return INVALID_OFFSET;
+}
+
+void OffsetAllocator::Free(uint64_t offset) {
+	auto allocation = allocations.find(offset);
+	if(allocation == allocations.end()) {
+		assert(false && "Freeing an offset that wasn't allocated");
+		return;
+	}
+	used -= allocation->second.size;
+	InsertFreeRange(offset, allocation->second.size);
+	allocations.erase(allocation);
+}
+
+void OffsetAllocator::Resize(uint64_t new_capacity) {
+	assert(new_capacity >= GetUsedEnd() && "Resizing would cut off allocations");
+	// The free range at the end, if any, is replaced by one reaching up to the new capacity
+	uint64_t tail_offset = capacity;
+	if(!free_ranges.empty()) {
+		auto last = std::prev(free_ranges.end());
+		if(last->first + last->second == capacity) {
+			tail_offset = last->first;
+			EraseFreeRange(last);
+		}
+	}
+	capacity = new_capacity;
+	if(tail_offset < capacity) {
+		InsertFreeRange(tail_offset, capacity - tail_offset);
+	}
+}
+
+std::vector<OffsetAllocator::Relocation> OffsetAllocator::Compact() {
+	free_ranges.clear();
+	free_ranges_by_size.clear();
+
+	std::vector<Relocation> relocations;
+	std::map<uint64_t, Allocation> compacted_allocations;
+	uint64_t end = 0;
+	for(auto &[offset, allocation] : allocations) {
+		// Only the padding needed for alignment stays free between the allocations
+		uint64_t dst_offset = VkUtils::AlignUp(end, allocation.alignment);
+		if(dst_offset > end) {
+			InsertFreeRange(end, dst_offset - end);
+		}
+		relocations.emplace_back(Relocation {
+			.src_offset = offset,
+			.dst_offset = dst_offset,
+			.size = allocation.size
+		});
+		compacted_allocations[dst_offset] = allocation;
+		end = dst_offset + allocation.size;
+	}
+	allocations.swap(compacted_allocations);
+	if(end < capacity) {
+		InsertFreeRange(end, capacity - end);
+	}
+	return relocations;
+}
+
+uint64_t OffsetAllocator::GetUsedEnd() const {
+	if(allocations.empty()) {
+		return 0;
+	}
+	auto last = std::prev(allocations.end());
+	return last->first + last->second.size;
+}
+
+OffsetAllocator::Statistics OffsetAllocator::GetStatistics() const {
+	uint64_t free_size = 0;
+	for(auto &[offset, size] : free_ranges) {
+		free_size += size;
+	}
+	uint64_t largest_free_range = free_ranges_by_size.empty() ? 0 : std::prev(free_ranges_by_size.end())->first;
+	return Statistics {
+		.capacity = capacity,
+		.used = used,
+		.largest_free_range = largest_free_range,
+		.allocation_count = static_cast<uint32_t>(allocations.size()),
+		.free_range_count = static_cast<uint32_t>(free_ranges.size()),
+		.fragmentation = free_size ? 1.0f - static_cast<float>(largest_free_range) / free_size : 0.0f
+	};
+}
+
+void OffsetAllocator::InsertFreeRange(uint64_t offset, uint64_t size) {
+	// Merge with the free neighbours on both sides
+	auto next = free_ranges.find(offset + size);
+	if(next != free_ranges.end()) {
+		size += next->second;
+		EraseFreeRange(next);
+	}
+	auto previous = free_ranges.lower_bound(offset);
+	if(previous != free_ranges.begin()) {
+		--previous;
+		if(previous->first + previous->second == offset) {
+			offset = previous->first;
+			size += previous->second;
+			EraseFreeRange(previous);
+		}
+	}
+	free_ranges[offset] = size;
+	free_ranges_by_size.emplace(size, offset);
+}
+
+void OffsetAllocator::EraseFreeRange(std::map<uint64_t, uint64_t>::iterator range) {
+	auto [first, last] = free_ranges_by_size.equal_range(range->second);
+	for(auto it = first; it != last; ++it) {
+		if(it->second == range->first) {
+			free_ranges_by_size.erase(it);
+			break;
+		}
+	}
+	free_ranges.erase(range);
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+// Hands out ranges of a linear address space, e.g. of a GPU buffer. Offsets and sizes are in
+// whatever unit the caller uses. Free ranges are kept sorted by offset and merged with their
+// neighbours when a range is freed, allocations take the smallest free range they fit in.
+class OffsetAllocator {
+public:
+	static constexpr uint64_t INVALID_OFFSET = ~0ull;
+
+	struct Statistics {
+		uint64_t capacity;
+		uint64_t used;
+		uint64_t largest_free_range;
+		uint32_t allocation_count;
+		uint32_t free_range_count;
+		// 0 when all free space is one range, approaching 1 as it is split into many small ones
+		float fragmentation;
+	};
+
+	// A range moved by Compact
+	struct Relocation {
+		uint64_t src_offset;
+		uint64_t dst_offset;
+		uint64_t size;
+	};
+
+	OffsetAllocator() = default;
+	explicit OffsetAllocator(uint64_t capacity);
+
+	// Returns INVALID_OFFSET if there is no free range large enough
+	uint64_t Allocate(uint64_t size, uint64_t alignment = 1);
+	void Free(uint64_t offset);
+	// Grows or shrinks the address space at its end, it can't shrink below GetUsedEnd
+	void Resize(uint64_t new_capacity);
+	// Moves all allocations to the front in offset order, keeping their alignment.
+	// Returns where every allocation went, including the ones that stayed in place.
+	std::vector<Relocation> Compact();
+
+	uint64_t GetCapacity() const { return capacity; }
+	// End of the last allocation, capacity can shrink down to it
+	uint64_t GetUsedEnd() const;
+	Statistics GetStatistics() const;
+
+private:
+	struct Allocation {
+		uint64_t size;
+		uint64_t alignment;
+	};
+
+	void InsertFreeRange(uint64_t offset, uint64_t size);
+	void EraseFreeRange(std::map<uint64_t, uint64_t>::iterator range);
+
+	uint64_t capacity = 0;
+	uint64_t used = 0;
+	// offset -> size, for merging neighbours
+	std::map<uint64_t, uint64_t> free_ranges;
+	// size -> offset, for best fit
+	std::multimap<uint64_t, uint64_t> free_ranges_by_size;
+	// Sorted by offset, so Compact can move them in order
+	std::map<uint64_t, Allocation> allocations;
+};
@@ -7,6 +7,31 @@
 #include "rendering_backend/vulkan_utils.h"
 
 namespace VkUtils {
+void RecordPipelineCreationFeedback(VulkanContext &context, const PipelineCreationFeedback &feedback) {
+	const VkPipelineCreationFeedbackEXT &pipeline_feedback = feedback.pipeline_feedback;
+	if(!(pipeline_feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_VALID_BIT_EXT)) {
+		return;
+	}
+	std::scoped_lock lock(context.pipeline_cache_statistics_mutex);
+	PipelineCacheStatistics &statistics = context.pipeline_cache_statistics;
+	++statistics.pipeline_count;
+	if(pipeline_feedback.flags & VK_PIPELINE_CREATION_FEEDBACK_APPLICATION_PIPELINE_CACHE_HIT_BIT_EXT) {
+		++statistics.cache_hits;
+	}
+	statistics.creation_ms += static_cast<double>(pipeline_feedback.duration) / 1e6;
+}
+
+void PrintPipelineCacheStatistics(VulkanContext &context) {
+	if(!LOG_STATISTICS) {
+		return;
+	}
+	std::scoped_lock lock(context.pipeline_cache_statistics_mutex);
+	const PipelineCacheStatistics &statistics = context.pipeline_cache_statistics;
+	printf("Pipeline cache: %u of %u pipelines hit the cache, %.2f ms spent creating pipelines (%s cache)\n",
+		statistics.cache_hits, statistics.pipeline_count, statistics.creation_ms,
+		context.pipeline_cache_loaded ? "warm" : "cold");
+}
+
 GraphicsPipeline CreateGraphicsPipeline(VulkanContext &context, ResourceManager &resource_manager, 
 	RenderPass &render_pass, GraphicsPipelineDescription description) {
 	assert(std::holds_alternative<GraphicsPass>(render_pass.pass));
@@ -16,9 +41,9 @@ GraphicsPipeline CreateGraphicsPipeline(VulkanContext &context, ResourceManager
 	};
 
 	std::array<VkPipelineShaderStageCreateInfo, 2> shader_stage_infos {
-		VkUtils::PipelineShaderStageCreateInfo(context.device, description.vertex_shader,
+		VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule(description.vertex_shader),
 			VK_SHADER_STAGE_VERTEX_BIT),
-		VkUtils::PipelineShaderStageCreateInfo(context.device, description.fragment_shader,
+		VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule(description.fragment_shader),
 			VK_SHADER_STAGE_FRAGMENT_BIT)
 	};
 
@@ -48,6 +73,9 @@ GraphicsPipeline CreateGraphicsPipeline(VulkanContext &context, ResourceManager
 	if(description.vertex_input_state == VertexInputState::Default) {
 		vertex_input_state_info = VERTEX_INPUT_STATE_DEFAULT;
 	}
+	else if(description.vertex_input_state == VertexInputState::PositionOnly) {
+		vertex_input_state_info = VERTEX_INPUT_STATE_POSITION_ONLY;
+	}
 	else if(description.vertex_input_state == VertexInputState::ImGui) {
 		vertex_input_state_info = VERTEX_INPUT_STATE_IMGUI;
 	}
@@ -113,6 +141,8 @@ GraphicsPipeline CreateGraphicsPipeline(VulkanContext &context, ResourceManager
 	switch(description.depth_stencil_state) {
 	case DepthStencilState::On:
 		pipeline_info.pDepthStencilState = &DEPTH_STENCIL_STATE_ON; break;
+	case DepthStencilState::Equal:
+		pipeline_info.pDepthStencilState = &DEPTH_STENCIL_STATE_EQUAL; break;
 	case DepthStencilState::Off:
 		pipeline_info.pDepthStencilState = &DEPTH_STENCIL_STATE_OFF; break;
 	}
@@ -186,13 +216,11 @@ GraphicsPipeline CreateGraphicsPipeline(VulkanContext &context, ResourceManager
 	};
 	pipeline_info.pViewportState = &viewport_state_info;
 
-
-	VK_CHECK(vkCreateGraphicsPipelines(context.device, VK_NULL_HANDLE, 1, &pipeline_info,
+	PipelineCreationFeedback creation_feedback(pipeline_info.stageCount);
+	pipeline_info.pNext = &creation_feedback.create_info;
+	VK_CHECK(vkCreateGraphicsPipelines(context.device, context.pipeline_cache, 1, &pipeline_info,
 		nullptr, &pipeline.handle));
-
-	for(VkPipelineShaderStageCreateInfo &pipeline_shader_stage_info : shader_stage_infos) {
-		vkDestroyShaderModule(context.device, pipeline_shader_stage_info.module, nullptr);
-	}
+	RecordPipelineCreationFeedback(context, creation_feedback);
 
 	return pipeline;
 }
@@ -206,7 +234,7 @@ RaytracingPipeline CreateRaytracingPipeline(VulkanContext &context, ResourceMana
 
 	uint32_t shader_slot = 0;
 	std::vector<VkPipelineShaderStageCreateInfo> shader_stage_infos {
-		VkUtils::PipelineShaderStageCreateInfo(context.device, description.raygen_shader,
+		VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule(description.raygen_shader),
 			VK_SHADER_STAGE_RAYGEN_BIT_KHR),
 	};
 	std::vector<VkRayTracingShaderGroupCreateInfoKHR> shader_groups {
@@ -222,7 +250,7 @@ RaytracingPipeline CreateRaytracingPipeline(VulkanContext &context, ResourceMana
 
 	for(const char *miss_shader : description.miss_shaders) {
 		shader_stage_infos.emplace_back(
-			VkUtils::PipelineShaderStageCreateInfo(context.device, miss_shader, VK_SHADER_STAGE_MISS_BIT_KHR)
+			VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule(miss_shader), VK_SHADER_STAGE_MISS_BIT_KHR)
 		);
 		shader_groups.emplace_back(VkRayTracingShaderGroupCreateInfoKHR {
 			.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
@@ -233,23 +261,20 @@ RaytracingPipeline CreateRaytracingPipeline(VulkanContext &context, ResourceMana
 			.intersectionShader = VK_SHADER_UNUSED_KHR
 		});
 	}
-	uint32_t hit_shader_count = 0;
 	for(HitShader hit_shader : description.hit_shaders) {
 		uint32_t closest_hit_shader_slot = VK_SHADER_UNUSED_KHR;
 		uint32_t any_hit_shader_slot = VK_SHADER_UNUSED_KHR;
 		if(hit_shader.closest_hit) {
 			shader_stage_infos.emplace_back(
-				VkUtils::PipelineShaderStageCreateInfo(context.device, hit_shader.closest_hit, VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)
+				VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule(hit_shader.closest_hit), VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR)
 			);
 			closest_hit_shader_slot = shader_slot++;
-			++hit_shader_count;
 		}
 		if(hit_shader.any_hit) {
 			shader_stage_infos.emplace_back(
-				VkUtils::PipelineShaderStageCreateInfo(context.device, hit_shader.any_hit, VK_SHADER_STAGE_ANY_HIT_BIT_KHR)
+				VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule(hit_shader.any_hit), VK_SHADER_STAGE_ANY_HIT_BIT_KHR)
 			);
 			any_hit_shader_slot = shader_slot++;
-			++hit_shader_count;
 		}
 		shader_groups.emplace_back(VkRayTracingShaderGroupCreateInfoKHR {
 			.sType = VK_STRUCTURE_TYPE_RAY_TRACING_SHADER_GROUP_CREATE_INFO_KHR,
@@ -276,8 +301,10 @@ RaytracingPipeline CreateRaytracingPipeline(VulkanContext &context, ResourceMana
 	};
 	VK_CHECK(vkCreatePipelineLayout(context.device, &layout_info, nullptr, &pipeline.layout));
 
+	PipelineCreationFeedback creation_feedback(static_cast<uint32_t>(shader_stage_infos.size()));
 	VkRayTracingPipelineCreateInfoKHR raytracing_pipeline_info {
 		.sType = VK_STRUCTURE_TYPE_RAY_TRACING_PIPELINE_CREATE_INFO_KHR,
+		.pNext = &creation_feedback.create_info,
 		.stageCount = static_cast<uint32_t>(shader_stage_infos.size()),
 		.pStages = shader_stage_infos.data(),
 		.groupCount = static_cast<uint32_t>(shader_groups.size()),
@@ -285,8 +312,9 @@ RaytracingPipeline CreateRaytracingPipeline(VulkanContext &context, ResourceMana
 		.maxPipelineRayRecursionDepth = 2,
 		.layout = pipeline.layout
 	};
-	VK_CHECK(vkCreateRayTracingPipelinesKHR(context.device, VK_NULL_HANDLE, VK_NULL_HANDLE, 1,
+	VK_CHECK(vkCreateRayTracingPipelinesKHR(context.device, VK_NULL_HANDLE, context.pipeline_cache, 1,
 		&raytracing_pipeline_info, nullptr, &pipeline.handle));
+	RecordPipelineCreationFeedback(context, creation_feedback);
 
 	uint32_t group_count = static_cast<uint32_t>(shader_groups.size());
 	uint32_t group_handle_size = raytracing_properties.shaderGroupHandleSize;
@@ -327,11 +355,8 @@ RaytracingPipeline CreateRaytracingPipeline(VulkanContext &context, ResourceMana
 
 	pipeline.raygen_sbt = create_shader_binding_table(0, 1);
 	pipeline.miss_sbt = create_shader_binding_table(1, description.miss_shaders.size());
-	pipeline.hit_sbt = create_shader_binding_table(1 + description.miss_shaders.size(), hit_shader_count);
-
-	for(VkPipelineShaderStageCreateInfo &pipeline_shader_stage_info : shader_stage_infos) {
-		vkDestroyShaderModule(context.device, pipeline_shader_stage_info.module, nullptr);
-	}
+	// One record per hit group, a group may hold both a closest-hit and an any-hit shader
+	pipeline.hit_sbt = create_shader_binding_table(1 + description.miss_shaders.size(), description.hit_shaders.size());
 
 	return pipeline;
 }
@@ -371,16 +396,18 @@ ComputePipeline CreateComputePipeline(VulkanContext &context, ResourceManager &r
 	VK_CHECK(vkCreatePipelineLayout(context.device, &layout_info, nullptr, &pipeline.layout));
 
 	VkPipelineShaderStageCreateInfo shader_stage_info = VkUtils::PipelineShaderStageCreateInfo(
-		context.device, kernel.shader, VK_SHADER_STAGE_COMPUTE_BIT);
+		context.shader_cache.GetModule(kernel.shader), VK_SHADER_STAGE_COMPUTE_BIT);
 
+	PipelineCreationFeedback creation_feedback(1);
 	VkComputePipelineCreateInfo compute_pipeline_info {
 		.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO,
+		.pNext = &creation_feedback.create_info,
 		.stage = shader_stage_info,
 		.layout = pipeline.layout,
 	};
-	vkCreateComputePipelines(context.device, nullptr, 1, &compute_pipeline_info, nullptr, &pipeline.handle);
-
-	vkDestroyShaderModule(context.device, shader_stage_info.module, nullptr);
+	VK_CHECK(vkCreateComputePipelines(context.device, context.pipeline_cache, 1, &compute_pipeline_info,
+		nullptr, &pipeline.handle));
+	RecordPipelineCreationFeedback(context, creation_feedback);
 	return pipeline;
 }
 }
@@ -3,6 +3,28 @@
 class VulkanContext;
 class ResourceManager;
 namespace VkUtils {
+// Chained into a pipeline create info to find out whether the pipeline came from the pipeline cache.
+// Points into itself, so it has to stay in place until the pipeline is created.
+struct PipelineCreationFeedback {
+	explicit PipelineCreationFeedback(uint32_t stage_count) : stage_feedbacks(stage_count) {
+		create_info = VkPipelineCreationFeedbackCreateInfoEXT {
+			.sType = VK_STRUCTURE_TYPE_PIPELINE_CREATION_FEEDBACK_CREATE_INFO_EXT,
+			.pPipelineCreationFeedback = &pipeline_feedback,
+			.pipelineStageCreationFeedbackCount = stage_count,
+			.pPipelineStageCreationFeedbacks = stage_feedbacks.data()
+		};
+	}
+	PipelineCreationFeedback(const PipelineCreationFeedback &) = delete;
+	PipelineCreationFeedback &operator=(const PipelineCreationFeedback &) = delete;
+
+	VkPipelineCreationFeedbackEXT pipeline_feedback {};
+	std::vector<VkPipelineCreationFeedbackEXT> stage_feedbacks;
+	VkPipelineCreationFeedbackCreateInfoEXT create_info;
+};
+// Adds a created pipeline to the pipeline cache statistics of the context
+void RecordPipelineCreationFeedback(VulkanContext &context, const PipelineCreationFeedback &feedback);
+void PrintPipelineCacheStatistics(VulkanContext &context);
+
 GraphicsPipeline CreateGraphicsPipeline(VulkanContext &context, ResourceManager &resource_manager,
 	RenderPass &render_pass, GraphicsPipelineDescription description);
 RaytracingPipeline CreateRaytracingPipeline(VulkanContext &context, ResourceManager &resource_manager,
@@ -15,28 +15,49 @@
 #include "render_paths/raytraced_render_path.h"
 #include "scene/scene_loader.h"
 
+// Builds the other render paths at startup with their pipelines created in the background. Their
+// graphs only live until the pipelines are in the pipeline cache, switching to them then only hits it.
+inline constexpr bool WARM_UP_RENDER_PATHS = true;
+
 Renderer::Renderer(HINSTANCE hinstance, HWND hwnd) : context(std::make_unique<VulkanContext>(hinstance, hwnd)) {
 	resource_manager = std::make_unique<ResourceManager>(*context);
 	render_graph = std::make_unique<RenderGraph>(*context, *resource_manager);
 	user_interface = std::make_unique<UserInterface>(*context, *resource_manager);
 	resource_manager->LoadScene("Pica.glb");
 
+	// Pipeline creation is what the pipeline cache speeds up, compare cold and warm runs here
+	auto start = std::chrono::high_resolution_clock::now();
 	active_render_path = std::make_unique<HybridRenderPath>(*context, *render_graph, *resource_manager);
 	active_render_path->Build();
+	double build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if(LOG_STATISTICS) {
+		printf("Initial render path build: %.2f ms\n", build_ms);
+	}
+	VkUtils::PrintPipelineCacheStatistics(*context);
+	if(WARM_UP_RENDER_PATHS) {
+		StartPipelineWarmUp();
+	}
 
 	user_interface_state = {
 		.render_path_state = RenderPathState::Idle,
-		.debug_texture = ""
+		.debug_texture = "",
+		.animate_mesh_instance = false,
+		.free_mesh_idx = -1
 	};
 
 	int _, x, y;
 	uint8_t *image_data;
 	image_data = stbi_load("data/misc/blue_noise/LDR_RGBA_0.png", &x, &y, &_, STBI_rgb_alpha);
-	blue_noise_texture_index = resource_manager->UploadTextureFromData(x, y, image_data);
+	blue_noise_texture_index = GetBindlessIndex(resource_manager->UploadTextureFromData(x, y, image_data));
 	free(image_data);
 }
 
 Renderer::~Renderer() {
+	VK_CHECK(vkDeviceWaitIdle(context->device));
+	FinishPipelineWarmUp(0, true);
+	for(uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i) {
+		DestroyRetiredWarmUps(i);
+	}
 	user_interface->DestroyResources();
 	render_graph->DestroyResources();
 	resource_manager->DestroyResources();
@@ -98,6 +119,30 @@ void Renderer::Update() {
 		camera.transform = T * R;
 		camera.view = glm::inverse(camera.transform);
 	}
+
+	Scene &scene = resource_manager->scene;
+	if(user_interface_state.free_mesh_idx >= 0 && user_interface_state.free_mesh_idx < static_cast<int32_t>(scene.meshes.size())) {
+		resource_manager->FreeMeshGeometry(static_cast<uint32_t>(user_interface_state.free_mesh_idx));
+	}
+
+	// Spins the first instance of the first mesh around its up axis. The TLAS is refit every frame and
+	// rebuilt after MAX_TLAS_REFITS_BEFORE_REBUILD refits, the instance returns to its place when stopped.
+	if(user_interface_state.animate_mesh_instance && !scene.meshes.empty() && !scene.meshes[0].instance_transforms.empty()) {
+		if(!animated_instance_transform) {
+			animated_instance_transform = scene.meshes[0].instance_transforms[0];
+			animation_time = 0.0f;
+		}
+		animation_time += io.DeltaTime;
+		glm::mat4 rotation = glm::rotate(glm::mat4(1.0f), animation_time, glm::vec3(0.0f, 1.0f, 0.0f));
+		resource_manager->SetMeshInstanceTransform(0, 0, *animated_instance_transform * rotation);
+	}
+	else if(animated_instance_transform) {
+		// Nothing to restore once the mesh has been freed
+		if(!scene.meshes[0].instance_transforms.empty()) {
+			resource_manager->SetMeshInstanceTransform(0, 0, *animated_instance_transform);
+		}
+		animated_instance_transform.reset();
+	}
 }
 
 void Renderer::Present(HWND hwnd) {
@@ -106,6 +151,8 @@ void Renderer::Present(HWND hwnd) {
 
 	VK_CHECK(vkWaitForFences(context->device, 1, &resources.fence, VK_TRUE, UINT64_MAX));
 	VK_CHECK(vkResetFences(context->device, 1, &resources.fence));
+	resource_manager->ReleaseDestroyedImages(resource_idx);
+	DestroyRetiredWarmUps(resource_idx);
 
 	uint32_t image_idx;
 	VkResult result = vkAcquireNextImageKHR(context->device, context->swapchain.handle, 
@@ -119,13 +166,32 @@ void Renderer::Present(HWND hwnd) {
 	VK_CHECK(result);
 
 	Render(resources, resource_idx, image_idx);
+	// Resources created since the last frame may still have their uploads and descriptor writes batched up
+	resource_manager->FlushUploads();
+	resource_manager->FlushDescriptorWrites();
 
-	VkPipelineStageFlags wait_stage = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+	// The frame acquires streamed resources, so it waits for the transfers it acquired. The value of the
+	// binary image_available semaphore is ignored.
+	std::array<VkSemaphore, 2> wait_semaphores {
+		resources.image_available,
+		resource_manager->GetStreamingSemaphore()
+	};
+	std::array<uint64_t, 2> wait_values { 0, resource_manager->GetStreamingWaitValue() };
+	std::array<VkPipelineStageFlags, 2> wait_stages {
+		VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT,
+		VK_PIPELINE_STAGE_ALL_COMMANDS_BIT
+	};
+	VkTimelineSemaphoreSubmitInfo timeline_submit_info {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.waitSemaphoreValueCount = static_cast<uint32_t>(wait_values.size()),
+		.pWaitSemaphoreValues = wait_values.data()
+	};
 	VkSubmitInfo submit_info {
 		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
-		.waitSemaphoreCount	= 1,
-		.pWaitSemaphores = &resources.image_available,
-		.pWaitDstStageMask = &wait_stage,
+		.pNext = &timeline_submit_info,
+		.waitSemaphoreCount	= static_cast<uint32_t>(wait_semaphores.size()),
+		.pWaitSemaphores = wait_semaphores.data(),
+		.pWaitDstStageMask = wait_stages.data(),
 		.commandBufferCount = 1,
 		.pCommandBuffers = &resources.command_buffer,
 		.signalSemaphoreCount = 1,
@@ -154,6 +220,8 @@ void Renderer::Present(HWND hwnd) {
 	}
 	VK_CHECK(result);
 
+	// A switch waits for the warm-up, the render path it switches to may still be compiling
+	FinishPipelineWarmUp(resource_idx, user_interface_state.render_path_state != RenderPathState::Idle);
 	resource_idx = (resource_idx + 1) % MAX_FRAMES_IN_FLIGHT;
 
 	switch(user_interface_state.render_path_state) {
@@ -181,6 +249,48 @@ void Renderer::Present(HWND hwnd) {
 
 }
 
+void Renderer::StartPipelineWarmUp() {
+	std::array<std::function<std::unique_ptr<RenderPath>(RenderGraph &)>, 3> create_render_paths {
+		[&](RenderGraph &graph) -> std::unique_ptr<RenderPath> {
+			return std::make_unique<RayqueryRenderPath>(*context, graph, *resource_manager);
+		},
+		[&](RenderGraph &graph) -> std::unique_ptr<RenderPath> {
+			return std::make_unique<RaytracedRenderPath>(*context, graph, *resource_manager);
+		},
+		[&](RenderGraph &graph) -> std::unique_ptr<RenderPath> {
+			return std::make_unique<ForwardRasterRenderPath>(*context, graph, *resource_manager);
+		}
+	};
+	for(auto &create_render_path : create_render_paths) {
+		std::unique_ptr<RenderGraph> graph = std::make_unique<RenderGraph>(*context, *resource_manager);
+		std::unique_ptr<RenderPath> render_path = create_render_path(*graph);
+		render_path->RegisterPath(*context, *graph, *resource_manager);
+		graph->BuildAsync();
+		warm_up_render_paths.emplace_back(std::move(graph), std::move(render_path));
+	}
+}
+
+void Renderer::FinishPipelineWarmUp(uint32_t resource_idx, bool wait) {
+	std::erase_if(warm_up_render_paths, [&](WarmUpRenderPath &warm_up_render_path) {
+		if(wait) {
+			warm_up_render_path.first->WaitForBuild();
+		}
+		else if(!warm_up_render_path.first->IsBuildFinished()) {
+			return false;
+		}
+		retired_warm_up_render_paths[resource_idx].push_back(std::move(warm_up_render_path));
+		return true;
+	});
+}
+
+void Renderer::DestroyRetiredWarmUps(uint32_t resource_idx) {
+	for(auto &[graph, render_path] : retired_warm_up_render_paths[resource_idx]) {
+		render_path->DeregisterPath(*context, *graph, *resource_manager);
+		graph->DestroyResources();
+	}
+	retired_warm_up_render_paths[resource_idx].clear();
+}
+
 void Renderer::Render(FrameResources &resources, uint32_t resource_idx, uint32_t image_idx) {
 	Camera &camera = resource_manager->scene.camera;
 
@@ -209,7 +319,10 @@ void Renderer::Render(FrameResources &resources, uint32_t resource_idx, uint32_t
 		.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
 	};
 	VK_CHECK(vkBeginCommandBuffer(resources.command_buffer, &command_buffer_begin_info));
-	
+
+	resource_manager->RecordStreamingAcquires(resources.command_buffer);
+	resource_manager->UpdateSceneTransforms(resources.command_buffer, resource_idx);
+	resource_manager->gpu_culling.RecordCulling(resources.command_buffer, resource_idx);
 	render_graph->Execute(resources.command_buffer, resource_idx, image_idx);
 
 	if(!user_interface_state.debug_texture.empty() && 
@@ -219,7 +332,7 @@ void Renderer::Render(FrameResources &resources, uint32_t resource_idx, uint32_t
 		render_graph->CopyImage(
 			resources.command_buffer,
 			user_interface_state.debug_texture,
-			resource_manager->textures[active_debug_texture]
+			resource_manager->GetTexture(active_debug_texture)
 		);
 	}
 
@@ -18,12 +18,24 @@ public:
 
 private:
 	void Render(FrameResources &resources, uint32_t resource_idx, uint32_t image_idx);
+	void StartPipelineWarmUp();
+	// Retires the warm-up graphs whose pipelines are done, or waits for all of them. The initializations of
+	// their images are part of the frame submitted last, they are destroyed once its fence is signaled.
+	void FinishPipelineWarmUp(uint32_t resource_idx, bool wait);
+	void DestroyRetiredWarmUps(uint32_t resource_idx);
 
 	std::unique_ptr<VulkanContext> context;
 	std::unique_ptr<ResourceManager> resource_manager;
 	std::unique_ptr<RenderGraph> render_graph;
 	std::unique_ptr<RenderPath> active_render_path;
+	// Render paths that aren't active, built into graphs of their own only to fill the pipeline cache
+	using WarmUpRenderPath = std::pair<std::unique_ptr<RenderGraph>, std::unique_ptr<RenderPath>>;
+	std::vector<WarmUpRenderPath> warm_up_render_paths;
+	std::array<std::vector<WarmUpRenderPath>, MAX_FRAMES_IN_FLIGHT> retired_warm_up_render_paths;
 	UserInterfaceState user_interface_state;
+	// Transform of the animated mesh instance before the animation started
+	std::optional<glm::mat4> animated_instance_transform;
+	float animation_time = 0.0f;
 	int blue_noise_texture_index;
 };
 
@@ -10,22 +10,203 @@ inline constexpr uint32_t MAX_TRANSIENT_SETS = 128;
 
 inline constexpr uint32_t MAX_PER_FRAME_UBOS = MAX_FRAMES_IN_FLIGHT;
 
-inline constexpr uint32_t MAX_VERTEX_AND_INDEX_BUFSIZE = 256 * 1024 * 1024; // 256MB
+// Variable count bindings have to come last in their set
+inline constexpr uint32_t GLOBAL_TEXTURES_BINDING = 6;
+
+// Upper bounds of the bindless descriptor arrays, they are clamped further to the device limits
+inline constexpr uint32_t MAX_BINDLESS_TEXTURES = 256 * 1024;
+inline constexpr uint32_t MAX_BINDLESS_STORAGE_IMAGES = 16 * 1024;
+
+// The geometry buffers start out small and grow with the meshes loaded into them
+inline constexpr VkDeviceSize GEOMETRY_BUFFER_INITIAL_SIZE = 1024 * 1024; // 1MB
+// Freeing a mesh defragments the geometry buffers once this much of their free space is outside the largest free range
+inline constexpr float GEOMETRY_DEFRAGMENTATION_THRESHOLD = 0.5f;
+
+// Persistently mapped staging memory shared by all uploads, larger payloads get their own buffer
+inline constexpr VkDeviceSize STAGING_RING_SIZE = 64 * 1024 * 1024; // 64MB
+inline constexpr VkDeviceSize STREAMING_RING_SIZE = 32 * 1024 * 1024; // 32MB
+inline constexpr VkDeviceSize MAX_QUEUED_TEXTURE_UPLOAD_BYTES = 256 * 1024 * 1024; // 256MB
+
+inline constexpr VkDeviceSize BLAS_SCRATCH_POOL_SIZE = 64 * 1024 * 1024; // 64MB
+inline constexpr uint32_t MAX_TLAS_REFITS_BEFORE_REBUILD = 64;
+// Static BLASes are copied into buffers of their compacted size after they are built
+inline constexpr bool COMPACT_BLASES = true;
+
+// Compacted BLASes are serialized to disk and loaded instead of built on the next run,
+// as long as the driver reports the serialized data as compatible
+inline constexpr bool CACHE_BLASES = true;
+inline constexpr const char *BLAS_CACHE_DIRECTORY = "data/cooked_acceleration_structures/";
+inline constexpr uint32_t BLAS_CACHE_MAGIC = 0x53415248; // "HRAS"
+// Bump whenever the BLAS build inputs or flags change, so stale cache entries get rebuilt
+inline constexpr uint32_t BLAS_CACHE_VERSION = 2;
+// Required alignment of the memory acceleration structures are serialized to and from
+inline constexpr VkDeviceSize SERIALIZED_AS_ALIGNMENT = 256;
+
+// Optionally builds the BLASes on the CPU during scene load, through deferred host operations spread
+// over the OpenMP threads, when the device supports it. The load waits for the builds. The host
+// BLASes are serialized and deserialized into device memory.
+inline constexpr bool HOST_BUILD_BLASES = false;
+// When enabled, every scene load also builds all BLASes on the device and the host and prints the timings
+inline constexpr bool BENCHMARK_BLAS_BUILDS = false;
+
+struct SerializedBLASHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t size;
+};
+
+// Cache entries are keyed on the geometry of the BLAS and the GPU it was built on
+std::string GetBLASCachePath(const Mesh &mesh, const MeshAllocation &mesh_allocation, const BLASGeometry &blas_geometry,
+	const MeshGeometryData &mesh_data, const VkPhysicalDeviceProperties &properties) {
+	uint64_t hash = 0xcbf29ce484222325;
+	auto hash_bytes = [&hash](const void *data, size_t size) {
+		const uint8_t *bytes = static_cast<const uint8_t *>(data);
+		for(size_t i = 0; i < size; ++i) {
+			hash ^= bytes[i];
+			hash *= 0x100000001b3;
+		}
+	};
+	for(uint32_t p = 0; p < blas_geometry.primitive_count; ++p) {
+		const Primitive &primitive = mesh.primitives[blas_geometry.first_primitive + p];
+		uint32_t index_units = primitive.index_type == INDEX_TYPE_UINT16 ? 1 : 2;
+		hash_bytes(&mesh_data.vertices[primitive.vertex_offset - mesh_allocation.vertex_offset], primitive.vertex_count * sizeof(Vertex));
+		hash_bytes(&mesh_data.indices[primitive.index_offset - mesh_allocation.index_offset], 
+			primitive.index_count * index_units * sizeof(uint16_t));
+		hash_bytes(&primitive.index_type, sizeof(primitive.index_type));
+	}
+	hash_bytes(&blas_geometry.alpha_tested, sizeof(blas_geometry.alpha_tested));
+	hash_bytes(&properties.vendorID, sizeof(properties.vendorID));
+	hash_bytes(&properties.deviceID, sizeof(properties.deviceID));
+	hash_bytes(&BLAS_CACHE_VERSION, sizeof(BLAS_CACHE_VERSION));
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.blas", static_cast<unsigned long long>(hash));
+	return std::string(BLAS_CACHE_DIRECTORY) + name;
+}
+
+bool ReadSerializedBLAS(const char *path, std::vector<uint8_t> &serialized_blas) {
+	std::ifstream file(path, std::ios::binary);
+	if(!file) {
+		return false;
+	}
+
+	SerializedBLASHeader header;
+	if(!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		header.magic != BLAS_CACHE_MAGIC || header.version != BLAS_CACHE_VERSION ||
+		header.size < 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t)) {
+		return false;
+	}
+
+	serialized_blas.resize(header.size);
+	if(!file.read(reinterpret_cast<char *>(serialized_blas.data()), header.size)) {
+		serialized_blas.clear();
+		return false;
+	}
+	return true;
+}
+
+// Serialized BLASes only deserialize on devices with a matching driver and acceleration structure format
+bool IsSerializedBLASCompatible(VkDevice device, const std::vector<uint8_t> &serialized_blas) {
+	if(serialized_blas.size() < 2 * VK_UUID_SIZE + 3 * sizeof(uint64_t)) {
+		return false;
+	}
+	VkAccelerationStructureVersionInfoKHR version_info {
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_VERSION_INFO_KHR,
+		.pVersionData = serialized_blas.data()
+	};
+	VkAccelerationStructureCompatibilityKHR compatibility;
+	vkGetDeviceAccelerationStructureCompatibilityKHR(device, &version_info, &compatibility);
+	return compatibility == VK_ACCELERATION_STRUCTURE_COMPATIBILITY_COMPATIBLE_KHR;
+}
+
+void WriteSerializedBLAS(const char *path, const uint8_t *serialized_blas, uint64_t size) {
+	SerializedBLASHeader header {
+		.magic = BLAS_CACHE_MAGIC,
+		.version = BLAS_CACHE_VERSION,
+		.size = size
+	};
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(serialized_blas), size);
+}
+
+// Describes the primitives of a BLAS as geometries. Instance transforms are applied by the
+// TLAS, so the geometry stays in mesh space. The addresses are device or host addresses of the
+// first vertex and index of the mesh allocations, depending on where the BLAS is built.
+void GetBLASGeometries(const Mesh &mesh, const MeshAllocation &mesh_allocation, const BLASGeometry &blas_geometry,
+	VkDeviceOrHostAddressConstKHR vertex_data, VkDeviceOrHostAddressConstKHR index_data, std::vector<VkAccelerationStructureGeometryKHR> &geometries,
+	std::vector<VkAccelerationStructureBuildRangeInfoKHR> &build_range_infos, std::vector<uint32_t> &max_primitive_counts) {
+	// Only geometry without the OPAQUE flag invokes the any-hit shader. The alpha test gives the same
+	// result every time, so duplicate any-hit invocations are allowed.
+	VkGeometryFlagsKHR geometry_flags = blas_geometry.alpha_tested ? 0 : VK_GEOMETRY_OPAQUE_BIT_KHR;
+	for(uint32_t p = 0; p < blas_geometry.primitive_count; ++p) {
+		const Primitive &primitive = mesh.primitives[blas_geometry.first_primitive + p];
+		uint32_t first_vertex = primitive.vertex_offset - static_cast<uint32_t>(mesh_allocation.vertex_offset);
+		uint32_t first_index = primitive.index_offset - static_cast<uint32_t>(mesh_allocation.index_offset);
+		geometries.emplace_back(VkAccelerationStructureGeometryKHR {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+			.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
+			.geometry = VkAccelerationStructureGeometryDataKHR {
+				.triangles = VkAccelerationStructureGeometryTrianglesDataKHR {
+					.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
+					.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
+					.vertexData = vertex_data,
+					.vertexStride = sizeof(Vertex),
+					.maxVertex = first_vertex + primitive.vertex_count - 1,
+					.indexType = static_cast<VkIndexType>(primitive.index_type),
+					.indexData = index_data
+				}
+			},
+			.flags = geometry_flags
+		});
+
+		build_range_infos.emplace_back(VkAccelerationStructureBuildRangeInfoKHR {
+			.primitiveCount = primitive.index_count / 3,
+			.primitiveOffset = first_index * static_cast<uint32_t>(sizeof(uint16_t)),
+			.firstVertex = first_vertex,
+			.transformOffset = 0
+		});
+		max_primitive_counts.emplace_back(primitive.index_count / 3);
+	}
+}
+
+template<typename T>
+void ResourceManager::ExecuteImmediateCommands(T commands) {
+	// Submitting the pending uploads first keeps everything in order on the queue
+	upload_context.Submit();
+	commands(upload_context.GetCommandBuffer());
+	upload_context.WaitIdle();
+}
 
 ResourceManager::ResourceManager(VulkanContext &context) : context(context) {
-	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(MAX_VERTEX_AND_INDEX_BUFSIZE, 
-		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | 
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
-	global_vertex_buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+	upload_context.Init(context.device, context.allocator, context.graphics_queue, context.gpu.graphics_family_idx,
+		STAGING_RING_SIZE);
+	// Without a dedicated transfer family, streaming shares the graphics queue and needs no ownership transfers
+	streaming_ownership_transfer = context.transfer_queue != VK_NULL_HANDLE;
+	if(streaming_ownership_transfer) {
+		streaming_context.Init(context.device, context.allocator, context.transfer_queue, context.gpu.transfer_family_idx,
+			STREAMING_RING_SIZE);
+	}
+	else {
+		streaming_context.Init(context.device, context.allocator, context.graphics_queue, context.gpu.graphics_family_idx,
+			STREAMING_RING_SIZE);
+	}
 
-	buffer_info.usage = VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+	// Transfer source as well, the contents are copied over when a buffer is resized
+	CreateGeometryBuffer(global_vertex_buffer, "Global Vertex Buffer", sizeof(Vertex),
+		VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
+		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | 
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 0);
+	CreateGeometryBuffer(global_index_buffer, "Global Index Buffer", sizeof(uint16_t),
+		VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT |
 		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT;
-	global_index_buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
-
-	buffer_info.usage = VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT;
-	global_obj_data_buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, 1);
+	CreateGeometryBuffer(global_obj_data_buffer, "Global Primitive Buffer", sizeof(Primitive),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 2);
+	CreateGeometryBuffer(global_transform_buffer, "Global Transform Buffer", sizeof(glm::mat4),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 4);
+	CreateGeometryBuffer(global_material_buffer, "Global Material Buffer", sizeof(Material),
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT, 5);
 
 	std::array<VkDescriptorPoolSize, 3> transient_descriptor_pool_sizes {
 		VkDescriptorPoolSize {
@@ -43,6 +224,7 @@ ResourceManager::ResourceManager(VulkanContext &context) : context(context) {
 	};
 	VkDescriptorPoolCreateInfo transient_descriptor_pool_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT,
 		.maxSets = MAX_TRANSIENT_SETS,
 		.poolSizeCount = static_cast<uint32_t>(transient_descriptor_pool_sizes.size()),
 		.pPoolSizes = transient_descriptor_pool_sizes.data()
@@ -50,6 +232,19 @@ ResourceManager::ResourceManager(VulkanContext &context) : context(context) {
 	VK_CHECK(vkCreateDescriptorPool(context.device, &transient_descriptor_pool_info, 
 		nullptr, &transient_descriptor_pool));
 
+	// Pipelines using the bindless arrays may also use transient descriptors of the same type
+	const VkPhysicalDeviceVulkan12Properties &vk12_properties = context.gpu.vk12_properties;
+	uint32_t texture_capacity = std::min({ MAX_BINDLESS_TEXTURES, MAX_BINDLESS_RESOURCES,
+		vk12_properties.maxDescriptorSetUpdateAfterBindSampledImages - MAX_TRANSIENT_DESCRIPTORS_PER_TYPE,
+		vk12_properties.maxPerStageDescriptorUpdateAfterBindSampledImages - MAX_TRANSIENT_DESCRIPTORS_PER_TYPE });
+	uint32_t storage_image_capacity = std::min({ MAX_BINDLESS_STORAGE_IMAGES, MAX_BINDLESS_RESOURCES,
+		vk12_properties.maxDescriptorSetUpdateAfterBindStorageImages - MAX_TRANSIENT_DESCRIPTORS_PER_TYPE,
+		vk12_properties.maxPerStageDescriptorUpdateAfterBindStorageImages - MAX_TRANSIENT_DESCRIPTORS_PER_TYPE });
+	texture_slots = BindlessSlotAllocator(texture_capacity);
+	storage_image_slots = BindlessSlotAllocator(storage_image_capacity);
+	textures.resize(texture_capacity);
+	storage_images.resize(storage_image_capacity);
+
 	CreateGlobalDescriptorSet0();
 	CreateGlobalDescriptorSet1();
 	CreatePerFrameDescriptorSet();
@@ -67,27 +262,42 @@ ResourceManager::ResourceManager(VulkanContext &context) : context(context) {
 		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK
 	};
 	VK_CHECK(vkCreateSampler(context.device, &sampler_info, nullptr, &default_sampler));
+
+	gpu_culling.Init(context, *this);
 }
 
 void ResourceManager::DestroyResources() {
 	VK_CHECK(vkDeviceWaitIdle(context.device));
-
-	VkUtils::DestroyGPUBuffer(context.allocator, global_vertex_buffer);
-	VkUtils::DestroyGPUBuffer(context.allocator, global_index_buffer);
-	VkUtils::DestroyGPUBuffer(context.allocator, global_obj_data_buffer);
-
-	for(uint32_t i = 0; i < MAX_GLOBAL_RESOURCES; ++i) {
-		if(textures[i].handle != VK_NULL_HANDLE) {
-			VkUtils::DestroyImage(context.device, context.allocator, textures[i]);
-			textures[i].handle = VK_NULL_HANDLE;
+	upload_context.Destroy();
+	streaming_context.Destroy();
+	gpu_culling.Destroy();
+
+	VkUtils::DestroyGPUBuffer(context.allocator, global_vertex_buffer.buffer);
+	VkUtils::DestroyGPUBuffer(context.allocator, global_index_buffer.buffer);
+	VkUtils::DestroyGPUBuffer(context.allocator, global_obj_data_buffer.buffer);
+	VkUtils::DestroyGPUBuffer(context.allocator, global_transform_buffer.buffer);
+	VkUtils::DestroyGPUBuffer(context.allocator, global_material_buffer.buffer);
+
+	for(Image &texture : textures) {
+		if(texture.handle != VK_NULL_HANDLE) {
+			VkUtils::DestroyImage(context.device, context.allocator, texture);
+			texture.handle = VK_NULL_HANDLE;
 		}
-		if(storage_images[i].handle != VK_NULL_HANDLE) {
-			VkUtils::DestroyImage(context.device, context.allocator, storage_images[i]);
+	}
+	for(Image &storage_image : storage_images) {
+		if(storage_image.handle != VK_NULL_HANDLE) {
+			VkUtils::DestroyImage(context.device, context.allocator, storage_image);
+			storage_image.handle = VK_NULL_HANDLE;
 		}
 	}
 
-	VkUtils::DestroyAccelerationStructure(context.device, context.allocator, global_BLAS);
+	for(AccelerationStructure &blas : BLASes) {
+		VkUtils::DestroyAccelerationStructure(context.device, context.allocator, blas);
+	}
 	VkUtils::DestroyAccelerationStructure(context.device, context.allocator, global_TLAS);
+	for(MappedBuffer &instance_buffer : tlas_instance_buffers) {
+		VkUtils::DestroyMappedBuffer(context.allocator, instance_buffer);
+	}
 
 	vkDestroyDescriptorPool(context.device, global_descriptor_pool0, nullptr);
 	vkDestroyDescriptorSetLayout(context.device, global_descriptor_set_layout0, nullptr);
@@ -136,14 +346,10 @@ Image ResourceManager::Create2DImage(uint32_t width, uint32_t height, VkFormat f
 		VK_IMAGE_ASPECT_COLOR_BIT;
 
 	if(initial_layout != VK_IMAGE_LAYOUT_UNDEFINED) {
-		VkUtils::ExecuteOneTimeCommands(context.device, context.graphics_queue, context.command_pool,
-			[&](VkCommandBuffer command_buffer) {
-				VkUtils::InsertImageBarrier(command_buffer, image.handle,
-					aspect_flags, VK_IMAGE_LAYOUT_UNDEFINED, initial_layout,
-					VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-					0, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT);
-			}
-		);
+		VkUtils::InsertImageBarrier(upload_context.GetCommandBuffer(), image.handle,
+			aspect_flags, VK_IMAGE_LAYOUT_UNDEFINED, initial_layout,
+			VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, VK_ACCESS_SHADER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT);
 	}
 
 	return image;
@@ -162,30 +368,23 @@ uint32_t ResourceManager::UploadTextureFromData(uint32_t width, uint32_t height,
 		&texture.handle, &texture.allocation, nullptr);
 
 	VkDeviceSize buffer_size = static_cast<VkDeviceSize>(width) * static_cast<VkDeviceSize>(height) * VkUtils::FormatStride(format);
-	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-	MappedBuffer buffer = VkUtils::CreateMappedBuffer(context.allocator, buffer_info);
-	memcpy(buffer.mapped_data, data, buffer_size);
+	StagingAllocation staging = upload_context.Stage(data, buffer_size);
+	VkCommandBuffer command_buffer = upload_context.GetCommandBuffer();
 
-	VkUtils::ExecuteOneTimeCommands(context.device, context.graphics_queue, 
-		context.command_pool, [&](VkCommandBuffer command_buffer) {
-			VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				0, VK_ACCESS_TRANSFER_WRITE_BIT);	
+	VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT);	
 
-			VkBufferImageCopy buffer_image_copy = VkUtils::BufferImageCopy2D(width, height);
-			vkCmdCopyBufferToImage(command_buffer, buffer.handle, texture.handle, 
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_image_copy);
+	VkBufferImageCopy buffer_image_copy = VkUtils::BufferImageCopy2D(width, height);
+	buffer_image_copy.bufferOffset = staging.offset;
+	vkCmdCopyBufferToImage(command_buffer, staging.buffer, texture.handle, 
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &buffer_image_copy);
 
-			VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
-				VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
-				VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);	
-		}
-	);
-
-	VkUtils::DestroyMappedBuffer(context.allocator, buffer);
+	VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, 
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT);	
 
 	VkImageViewCreateInfo image_view_info = VkUtils::ImageViewCreateInfo2D(texture.handle, 
 		format);
@@ -195,6 +394,186 @@ uint32_t ResourceManager::UploadTextureFromData(uint32_t width, uint32_t height,
 	return UploadTexture(texture, texture_sampler);
 }
 
+void ResourceManager::BeginTextureUploads() {
+	assert(!texture_uploader.joinable() && "Texture uploads already in progress");
+
+	texture_upload_count = 0;
+	texture_uploads_finished = false;
+	texture_uploader = std::thread(&ResourceManager::TextureUploaderLoop, this);
+}
+
+void ResourceManager::EnqueueTextureUpload(TextureUploadRequest request) {
+	VkDeviceSize size = VkUtils::ImageDataSize(request.format, request.width, request.height,
+		request.mip_levels);
+
+	// Throttle the decoders if the uploader falls behind, so decoded images don't pile up in memory
+	std::unique_lock<std::mutex> lock(texture_upload_mutex);
+	texture_upload_cv.wait(lock, [&] {
+		return texture_upload_queue.empty() || texture_upload_queued_bytes + size <= MAX_QUEUED_TEXTURE_UPLOAD_BYTES;
+	});
+	texture_upload_queue.push_back(request);
+	texture_upload_queued_bytes += size;
+	lock.unlock();
+	texture_upload_cv.notify_all();
+}
+
+void ResourceManager::EndTextureUploads() {
+	{
+		std::lock_guard<std::mutex> lock(texture_upload_mutex);
+		texture_uploads_finished = true;
+	}
+	texture_upload_cv.notify_all();
+	uint64_t first_submit = upload_context.GetSubmittedValue();
+	texture_uploader.join();
+
+	upload_context.Submit();
+	// Materials sample the textures from the first frame on, whose RecordStreamingAcquires acquires them
+	streaming_context.WaitIdle();
+	if(LOG_STATISTICS) {
+		printf("Uploaded %u textures in %llu submissions\n", texture_upload_count,
+			upload_context.GetSubmittedValue() - first_submit);
+	}
+}
+
+void ResourceManager::TextureUploaderLoop() {
+	while(true) {
+		std::unique_lock<std::mutex> lock(texture_upload_mutex);
+		texture_upload_cv.wait(lock, [&] {
+			return !texture_upload_queue.empty() || texture_uploads_finished;
+		});
+		if(texture_upload_queue.empty()) {
+			break;
+		}
+		TextureUploadRequest request = texture_upload_queue.front();
+		texture_upload_queue.pop_front();
+		texture_upload_queued_bytes -= VkUtils::ImageDataSize(request.format, request.width, request.height,
+			request.mip_levels);
+		lock.unlock();
+		texture_upload_cv.notify_all();
+
+		RecordTextureUpload(request);
+		texture_upload_count++;
+	}
+}
+
+void ResourceManager::RecordTextureUpload(TextureUploadRequest &request) {
+	// Missing mips are generated with a chain of linear blits, which filter SRGB formats in linear space.
+	// Cooked textures already come with their full chain.
+	uint32_t mip_levels = request.mip_levels;
+	if(request.mip_levels == 1 && !VkUtils::IsBlockCompressedFormat(request.format)) {
+		VkFormatProperties format_properties;
+		vkGetPhysicalDeviceFormatProperties(context.gpu.handle, request.format, &format_properties);
+		bool can_blit = (format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT) &&
+			(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_SRC_BIT) &&
+			(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_BLIT_DST_BIT);
+		mip_levels = can_blit ? VkUtils::MipLevelCount(request.width, request.height) : 1;
+	}
+
+	// Textures that need no blits go through the transfer queue,
+	// while the graphics queue generates the mips of the others
+	if(mip_levels == request.mip_levels) {
+		StreamTexture(request);
+		free(request.data);
+		return;
+	}
+
+	VkDeviceSize size = VkUtils::ImageDataSize(request.format, request.width, request.height,
+		request.mip_levels);
+	// Copy offsets have to be a multiple of the texel or block size, 16 covers every format we upload
+	StagingAllocation staging = upload_context.Stage(request.data, size, 16);
+	free(request.data);
+	VkCommandBuffer command_buffer = upload_context.GetCommandBuffer();
+
+	Image texture {
+		.width = request.width,
+		.height = request.height,
+		.format = request.format,
+		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT
+	};
+	VkImageCreateInfo image_info = VkUtils::ImageCreateInfo2D(request.width, request.height,
+		request.format, texture.usage, VK_SAMPLE_COUNT_1_BIT, mip_levels);
+	VmaAllocationCreateInfo image_alloc_info {
+		.usage = VMA_MEMORY_USAGE_GPU_ONLY
+	};
+	vmaCreateImage(context.allocator, &image_info, &image_alloc_info,
+		&texture.handle, &texture.allocation, nullptr);
+
+	VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT, 0, mip_levels);
+
+	std::vector<VkBufferImageCopy> buffer_image_copies(request.mip_levels);
+	VkDeviceSize level_offset = staging.offset;
+	for(uint32_t level = 0; level < request.mip_levels; ++level) {
+		uint32_t level_width = std::max(request.width >> level, 1u);
+		uint32_t level_height = std::max(request.height >> level, 1u);
+		buffer_image_copies[level] = VkUtils::BufferImageCopy2D(level_width, level_height);
+		buffer_image_copies[level].bufferOffset = level_offset;
+		buffer_image_copies[level].imageSubresource.mipLevel = level;
+		level_offset += VkUtils::ImageLevelSize(request.format, level_width, level_height);
+	}
+	vkCmdCopyBufferToImage(command_buffer, staging.buffer, texture.handle,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(buffer_image_copies.size()),
+		buffer_image_copies.data());
+
+	// Each level is blitted from the previous one, which is then done and can be made shader readable
+	uint32_t first_generated_level = request.mip_levels;
+	int32_t mip_width = static_cast<int32_t>(std::max(request.width >> (first_generated_level - 1), 1u));
+	int32_t mip_height = static_cast<int32_t>(std::max(request.height >> (first_generated_level - 1), 1u));
+	for(uint32_t level = first_generated_level; level < mip_levels; ++level) {
+		VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT, level - 1, 1);
+
+		int32_t next_width = std::max(mip_width / 2, 1);
+		int32_t next_height = std::max(mip_height / 2, 1);
+		VkImageBlit image_blit {
+			.srcSubresource = VkImageSubresourceLayers {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = level - 1,
+				.layerCount = 1
+			},
+			.srcOffsets = { VkOffset3D { 0, 0, 0 }, VkOffset3D { mip_width, mip_height, 1 } },
+			.dstSubresource = VkImageSubresourceLayers {
+				.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+				.mipLevel = level,
+				.layerCount = 1
+			},
+			.dstOffsets = { VkOffset3D { 0, 0, 0 }, VkOffset3D { next_width, next_height, 1 } }
+		};
+		vkCmdBlitImage(command_buffer, texture.handle, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			texture.handle, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &image_blit, VK_FILTER_LINEAR);
+
+		VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+			VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT, level - 1, 1);
+
+		mip_width = next_width;
+		mip_height = next_height;
+	}
+
+	// Whatever is still in TRANSFER_DST: the last generated level, or all uploaded levels
+	uint32_t first_remaining_level = mip_levels > first_generated_level ? mip_levels - 1 : 0;
+	VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+		VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		first_remaining_level, mip_levels - first_remaining_level);
+
+	VkImageViewCreateInfo image_view_info = VkUtils::ImageViewCreateInfo2D(texture.handle, request.format, mip_levels);
+	image_view_info.components = request.components;
+	VK_CHECK(vkCreateImageView(context.device, &image_view_info, nullptr, &texture.view));
+
+	VkSampler texture_sampler = request.sampler_info ? GetSampler(&request.sampler_info.value()) : default_sampler;
+	*request.texture_idx = UploadTexture(texture, texture_sampler);
+	if(request.name) {
+		TagImage(*request.texture_idx, request.name);
+	}
+}
+
 uint32_t ResourceManager::UploadEmptyTexture(uint32_t width, uint32_t height, VkFormat format, SamplerInfo *sampler_info) {
 	Image texture;
 
@@ -206,18 +585,11 @@ uint32_t ResourceManager::UploadEmptyTexture(uint32_t width, uint32_t height, Vk
 	vmaCreateImage(context.allocator, &image_info, &image_alloc_info,
 		&texture.handle, &texture.allocation, nullptr);
 
-	VkDeviceSize buffer_size = static_cast<VkDeviceSize>(width) * static_cast<VkDeviceSize>(height) * VkUtils::FormatStride(format);
-	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-	VkUtils::ExecuteOneTimeCommands(context.device, context.graphics_queue,
-		context.command_pool, [&](VkCommandBuffer command_buffer) {
-			VkUtils::InsertImageBarrier(command_buffer, texture.handle, VkUtils::IsDepthFormat(format) ? 
-				VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				0, VK_ACCESS_TRANSFER_WRITE_BIT);
-		}
-	);
+	VkUtils::InsertImageBarrier(upload_context.GetCommandBuffer(), texture.handle, VkUtils::IsDepthFormat(format) ? 
+		VK_IMAGE_ASPECT_DEPTH_BIT : VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT);
 
 	VkImageViewCreateInfo image_view_info = VkUtils::ImageViewCreateInfo2D(texture.handle,
 		format);
@@ -243,17 +615,10 @@ uint32_t ResourceManager::UploadNewStorageImage(uint32_t width, uint32_t height,
 	vmaCreateImage(context.allocator, &image_info, &image_alloc_info,
 		&storage_image.handle, &storage_image.allocation, nullptr);
 
-	VkDeviceSize buffer_size = static_cast<VkDeviceSize>(width) * static_cast<VkDeviceSize>(height) * VkUtils::FormatStride(format);
-	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(buffer_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-
-	VkUtils::ExecuteOneTimeCommands(context.device, context.graphics_queue,
-		context.command_pool, [&](VkCommandBuffer command_buffer) {
-			VkUtils::InsertImageBarrier(command_buffer, storage_image.handle, VK_IMAGE_ASPECT_COLOR_BIT,
-				VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
-				VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
-				0, VK_ACCESS_TRANSFER_WRITE_BIT);
-		}
-	);
+	VkUtils::InsertImageBarrier(upload_context.GetCommandBuffer(), storage_image.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_GENERAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT);
 
 	VkImageViewCreateInfo image_view_info = VkUtils::ImageViewCreateInfo2D(storage_image.handle,
 		format);
@@ -262,10 +627,95 @@ uint32_t ResourceManager::UploadNewStorageImage(uint32_t width, uint32_t height,
 	return UploadStorageImage(storage_image);
 }
 
-void ResourceManager::DestroyStorageImage(uint32_t id) {
-	assert(storage_images[id].handle != VK_NULL_HANDLE);
-	VkUtils::DestroyImage(context.device, context.allocator, storage_images[id]);
-	storage_images[id].handle = VK_NULL_HANDLE;
+void ResourceManager::DestroyTexture(uint32_t handle) {
+	assert(texture_slots.IsValid(handle) && "Stale or invalid texture handle");
+	std::scoped_lock lock(bindless_mutex);
+	destroyed_images[current_resource_idx].emplace_back(handle, false);
+}
+
+void ResourceManager::DestroyStorageImage(uint32_t handle) {
+	assert(storage_image_slots.IsValid(handle) && "Stale or invalid storage image handle");
+	std::scoped_lock lock(bindless_mutex);
+	destroyed_images[current_resource_idx].emplace_back(handle, true);
+}
+
+void ResourceManager::ReleaseDestroyedImages(uint32_t resource_idx) {
+	// Frames are submitted in order, so every frame that could still use the images has finished
+	std::vector<std::pair<uint32_t, bool>> images;
+	{
+		std::scoped_lock lock(bindless_mutex);
+		images.swap(destroyed_images[resource_idx]);
+		current_resource_idx = resource_idx;
+	}
+	for(auto &[handle, storage_image] : images) {
+		if(storage_image) {
+			ReleaseStorageImage(handle);
+		}
+		else {
+			ReleaseTexture(handle);
+		}
+	}
+}
+
+void ResourceManager::ReleaseTexture(uint32_t handle) {
+	Image &texture = GetTexture(handle);
+	VkUtils::DestroyImage(context.device, context.allocator, texture);
+	texture.handle = VK_NULL_HANDLE;
+
+	std::scoped_lock lock(bindless_mutex);
+	// A write still queued for the slot would reference the destroyed view
+	uint32_t slot = GetBindlessIndex(handle);
+	std::erase_if(pending_descriptor_writes, [&](const PendingDescriptorWrite &write) {
+		return write.set == global_descriptor_set0 && write.slot == slot;
+	});
+	texture_slots.Free(handle);
+}
+
+void ResourceManager::ReleaseStorageImage(uint32_t handle) {
+	Image &storage_image = GetStorageImage(handle);
+	VkUtils::DestroyImage(context.device, context.allocator, storage_image);
+	storage_image.handle = VK_NULL_HANDLE;
+
+	std::scoped_lock lock(bindless_mutex);
+	uint32_t slot = GetBindlessIndex(handle);
+	std::erase_if(pending_descriptor_writes, [&](const PendingDescriptorWrite &write) {
+		return write.set == global_descriptor_set1 && write.slot == slot;
+	});
+	storage_image_slots.Free(handle);
+}
+
+Image &ResourceManager::GetTexture(uint32_t handle) {
+	assert(texture_slots.IsValid(handle) && "Stale or invalid texture handle");
+	return textures[GetBindlessIndex(handle)];
+}
+
+Image &ResourceManager::GetStorageImage(uint32_t handle) {
+	assert(storage_image_slots.IsValid(handle) && "Stale or invalid storage image handle");
+	return storage_images[GetBindlessIndex(handle)];
+}
+
+void ResourceManager::FlushDescriptorWrites() {
+	std::scoped_lock lock(bindless_mutex);
+	if(pending_descriptor_writes.empty()) {
+		return;
+	}
+
+	std::vector<VkWriteDescriptorSet> write_descriptor_sets;
+	write_descriptor_sets.reserve(pending_descriptor_writes.size());
+	for(PendingDescriptorWrite &write : pending_descriptor_writes) {
+		write_descriptor_sets.push_back(VkWriteDescriptorSet {
+			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
+			.dstSet = write.set,
+			.dstBinding = write.binding,
+			.dstArrayElement = write.slot,
+			.descriptorCount = 1,
+			.descriptorType = write.type,
+			.pImageInfo = &write.image_info
+		});
+	}
+	vkUpdateDescriptorSets(context.device, static_cast<uint32_t>(write_descriptor_sets.size()),
+		write_descriptor_sets.data(), 0, nullptr);
+	pending_descriptor_writes.clear();
 }
 
 void ResourceManager::TagImage(Image &image, const char *name) {
@@ -282,78 +732,406 @@ void ResourceManager::TagImage(uint32_t image_idx, const char *name) {
 	VkDebugUtilsObjectNameInfoEXT debug_utils_object_name_info {
 		.sType = VK_STRUCTURE_TYPE_DEBUG_UTILS_OBJECT_NAME_INFO_EXT,
 		.objectType = VK_OBJECT_TYPE_IMAGE,
-		.objectHandle = reinterpret_cast<uint64_t>(textures[image_idx].handle),
+		.objectHandle = reinterpret_cast<uint64_t>(GetTexture(image_idx).handle),
 		.pObjectName = name
 	};
 	vkSetDebugUtilsObjectNameEXT(context.device, &debug_utils_object_name_info);
 }
 
-void ResourceManager::UpdateGeometry(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, Scene &scene) {
-	UploadDataToGPUBuffer(global_vertex_buffer, vertices.data(), vertices.size() * sizeof(Vertex));
-	UploadDataToGPUBuffer(global_index_buffer, indices.data(), indices.size() * sizeof(uint32_t));
-
-	// Gather all primitives from all meshes in a flat array 
-	std::vector<Primitive> primitives;
+void ResourceManager::UpdateGeometry(std::vector<Vertex> &vertices, std::vector<uint16_t> &indices, Scene &scene) {
+	// Alpha tested primitives go last, so the opaque and alpha tested BLAS of a mesh each cover a contiguous range
 	for(Mesh &mesh : scene.meshes) {
-		primitives.insert(primitives.end(), mesh.primitives.begin(), mesh.primitives.end());
+		std::stable_partition(mesh.primitives.begin(), mesh.primitives.end(), [&scene](const Primitive &primitive) {
+			return scene.materials[primitive.material].alpha_mask != 1;
+		});
 	}
 
-	UploadDataToGPUBuffer(global_obj_data_buffer, primitives.data(), primitives.size() * sizeof(Primitive));
-	UpdateBLAS(static_cast<uint32_t>(vertices.size()), primitives);
-	UpdateTLAS(primitives);
-
-	VkDescriptorBufferInfo vertex_buffer_info {
-		.buffer = global_vertex_buffer.handle,
-		.range = VK_WHOLE_SIZE
+	// The vertices and indices of a mesh are contiguous in the loaded arrays
+	struct MeshGeometryRange {
+		uint32_t first_vertex = UINT32_MAX;
+		uint32_t vertex_end = 0;
+		uint32_t first_index = UINT32_MAX;
+		uint32_t index_end = 0;
+		uint32_t primitive_count = 0;
 	};
-	VkDescriptorBufferInfo index_buffer_info {
-		.buffer = global_index_buffer.handle,
-		.range = VK_WHOLE_SIZE
-	};
-	VkDescriptorBufferInfo obj_data_buffer_info {
-		.buffer = global_obj_data_buffer.handle,
-		.range = VK_WHOLE_SIZE
+	uint32_t mesh_count = static_cast<uint32_t>(scene.meshes.size());
+	std::vector<MeshGeometryRange> ranges(mesh_count);
+	uint64_t vertex_count = 0;
+	uint64_t index_count = 0;
+	uint64_t primitive_count = 0;
+	uint64_t transform_count = 0;
+	for(uint32_t m = 0; m < mesh_count; ++m) {
+		Mesh &mesh = scene.meshes[m];
+		MeshGeometryRange &range = ranges[m];
+		for(Primitive &primitive : mesh.primitives) {
+			uint32_t index_units = primitive.index_type == INDEX_TYPE_UINT16 ? 1 : 2;
+			range.first_vertex = std::min(range.first_vertex, primitive.vertex_offset);
+			range.vertex_end = std::max(range.vertex_end, primitive.vertex_offset + primitive.vertex_count);
+			range.first_index = std::min(range.first_index, primitive.index_offset);
+			range.index_end = std::max(range.index_end, primitive.index_offset + primitive.index_count * index_units);
+		}
+		if(mesh.primitives.empty()) {
+			continue;
+		}
+		// 32-bit indices are 4-byte aligned, so the index range starts and ends on an even 16-bit unit
+		range.first_index &= ~1u;
+		range.index_end = VkUtils::AlignUp(range.index_end, 2u);
+		range.primitive_count = static_cast<uint32_t>(mesh.primitives.size() * mesh.instance_transforms.size());
+		vertex_count += range.vertex_end - range.first_vertex;
+		index_count += range.index_end - range.first_index;
+		primitive_count += range.primitive_count;
+		transform_count += mesh.instance_transforms.size();
+	}
+
+	// Grow once up front instead of once per mesh that doesn't fit
+	auto reserve = [this](GeometryBuffer &geometry_buffer, uint64_t count) {
+		OffsetAllocator &allocator = geometry_buffer.allocator;
+		if(allocator.GetCapacity() - allocator.GetUsedEnd() < count) {
+			ResizeGeometryBuffer(geometry_buffer, allocator.GetUsedEnd() + count, { OffsetAllocator::Relocation {
+				.src_offset = 0,
+				.dst_offset = 0,
+				.size = allocator.GetUsedEnd()
+			}});
+		}
 	};
-	VkWriteDescriptorSetAccelerationStructureKHR write_descriptor_set_acceleration_structure {
-		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
-		.accelerationStructureCount = 1,
-		.pAccelerationStructures = &global_TLAS.handle
+	reserve(global_vertex_buffer, vertex_count);
+	reserve(global_index_buffer, index_count);
+	reserve(global_obj_data_buffer, primitive_count);
+	reserve(global_transform_buffer, transform_count);
+
+	mesh_allocations.resize(mesh_count);
+	std::vector<MeshGeometryData> mesh_data(mesh_count);
+	std::vector<VkBufferCopy> vertex_copies;
+	std::vector<VkBufferCopy> index_copies;
+	for(uint32_t m = 0; m < mesh_count; ++m) {
+		Mesh &mesh = scene.meshes[m];
+		MeshGeometryRange &range = ranges[m];
+		if(mesh.primitives.empty()) {
+			continue;
+		}
+
+		MeshAllocation &allocation = mesh_allocations[m];
+		allocation.vertex_offset = AllocateGeometry(global_vertex_buffer, range.vertex_end - range.first_vertex);
+		allocation.index_offset = AllocateGeometry(global_index_buffer, range.index_end - range.first_index, 2);
+		if(range.primitive_count > 0) {
+			allocation.primitive_offset = AllocateGeometry(global_obj_data_buffer, range.primitive_count);
+			mesh.first_primitive = static_cast<uint32_t>(allocation.primitive_offset);
+			allocation.transform_offset = AllocateGeometry(global_transform_buffer, mesh.instance_transforms.size());
+			mesh.first_transform = static_cast<uint32_t>(allocation.transform_offset);
+		}
+
+		vertex_copies.emplace_back(VkBufferCopy {
+			.srcOffset = range.first_vertex * sizeof(Vertex),
+			.dstOffset = allocation.vertex_offset * sizeof(Vertex),
+			.size = (range.vertex_end - range.first_vertex) * sizeof(Vertex)
+		});
+		// The padding to the even end may lie past the loaded indices
+		index_copies.emplace_back(VkBufferCopy {
+			.srcOffset = range.first_index * sizeof(uint16_t),
+			.dstOffset = allocation.index_offset * sizeof(uint16_t),
+			.size = (std::min(range.index_end, static_cast<uint32_t>(indices.size())) - range.first_index) * sizeof(uint16_t)
+		});
+		mesh_data[m] = MeshGeometryData {
+			.vertices = vertices.data() + range.first_vertex,
+			.indices = indices.data() + range.first_index
+		};
+
+		for(Primitive &primitive : mesh.primitives) {
+			// Center and half diagonal of the bounding box, for culling
+			glm::vec3 min_pos(FLT_MAX);
+			glm::vec3 max_pos(-FLT_MAX);
+			for(uint32_t v = primitive.vertex_offset; v < primitive.vertex_offset + primitive.vertex_count; ++v) {
+				min_pos = glm::min(min_pos, vertices[v].pos);
+				max_pos = glm::max(max_pos, vertices[v].pos);
+			}
+			primitive.bounding_sphere = glm::vec4((min_pos + max_pos) * 0.5f, glm::length(max_pos - min_pos) * 0.5f);
+
+			primitive.vertex_offset = static_cast<uint32_t>(allocation.vertex_offset) + primitive.vertex_offset - range.first_vertex;
+			primitive.index_offset = static_cast<uint32_t>(allocation.index_offset) + primitive.index_offset - range.first_index;
+		}
+	}
+
+	UploadDataToGPUBuffer(global_vertex_buffer.buffer, vertices.data(), vertices.size() * sizeof(Vertex), vertex_copies);
+	UploadDataToGPUBuffer(global_index_buffer.buffer, indices.data(), indices.size() * sizeof(uint16_t), index_copies);
+	UploadMaterials(scene);
+	UploadPrimitiveRecords(scene);
+	UpdateBLAS(scene, mesh_data);
+	UpdateTLAS(scene);
+	WriteGeometryDescriptors();
+	PrintGeometryStatistics();
+}
+
+void ResourceManager::FreeMeshGeometry(uint32_t mesh_idx) {
+	// Frames in flight may still read the geometry and the BLASes
+	VK_CHECK(vkDeviceWaitIdle(context.device));
+
+	MeshAllocation &allocation = mesh_allocations[mesh_idx];
+	if(allocation.vertex_offset != OffsetAllocator::INVALID_OFFSET) {
+		global_vertex_buffer.allocator.Free(allocation.vertex_offset);
+		global_index_buffer.allocator.Free(allocation.index_offset);
+	}
+	if(allocation.primitive_offset != OffsetAllocator::INVALID_OFFSET) {
+		global_obj_data_buffer.allocator.Free(allocation.primitive_offset);
+		global_transform_buffer.allocator.Free(allocation.transform_offset);
+	}
+	allocation = MeshAllocation {};
+
+	for(uint32_t b = static_cast<uint32_t>(blas_geometries.size()); b-- > 0;) {
+		if(blas_geometries[b].mesh_idx == mesh_idx) {
+			VkUtils::DestroyAccelerationStructure(context.device, context.allocator, BLASes[b]);
+			BLASes.erase(BLASes.begin() + b);
+			blas_geometries.erase(blas_geometries.begin() + b);
+		}
+	}
+
+	// The mesh keeps its index, so the indices of the other meshes stay valid
+	Mesh &mesh = scene.meshes[mesh_idx];
+	mesh.primitives.clear();
+	mesh.instance_transforms.clear();
+	std::erase_if(moved_mesh_instances, [mesh_idx](const glm::uvec2 &mesh_instance) {
+		return mesh_instance.x == mesh_idx;
+	});
+	UpdateTLAS(scene);
+	gpu_culling.SetDrawList(scene);
+	frustum_culler.SetPrimitives(scene);
+
+	bool fragmented = false;
+	// Materials are never freed
+	for(GeometryBuffer *geometry_buffer : { &global_vertex_buffer, &global_index_buffer, &global_obj_data_buffer,
+		&global_transform_buffer }) {
+		fragmented |= geometry_buffer->allocator.GetStatistics().fragmentation > GEOMETRY_DEFRAGMENTATION_THRESHOLD;
+	}
+	if(fragmented) {
+		DefragmentGeometry();
+	}
+	else {
+		WriteGeometryDescriptors();
+	}
+}
+
+void ResourceManager::DefragmentGeometry() {
+	VK_CHECK(vkDeviceWaitIdle(context.device));
+
+	// Packs a buffer into a new one sized to its contents, and returns where every allocation went
+	auto compact = [this](GeometryBuffer &geometry_buffer) {
+		std::vector<OffsetAllocator::Relocation> relocations = geometry_buffer.allocator.Compact();
+		uint64_t initial_capacity = GEOMETRY_BUFFER_INITIAL_SIZE / geometry_buffer.element_size;
+		ResizeGeometryBuffer(geometry_buffer, std::max(geometry_buffer.allocator.GetUsedEnd(), initial_capacity), relocations);
+
+		std::unordered_map<uint64_t, uint64_t> new_offsets;
+		for(OffsetAllocator::Relocation &relocation : relocations) {
+			new_offsets[relocation.src_offset] = relocation.dst_offset;
+		}
+		return new_offsets;
 	};
+	std::unordered_map<uint64_t, uint64_t> new_vertex_offsets = compact(global_vertex_buffer);
+	std::unordered_map<uint64_t, uint64_t> new_index_offsets = compact(global_index_buffer);
+	std::unordered_map<uint64_t, uint64_t> new_primitive_offsets = compact(global_obj_data_buffer);
+	std::unordered_map<uint64_t, uint64_t> new_transform_offsets = compact(global_transform_buffer);
+
+	for(uint32_t m = 0; m < mesh_allocations.size(); ++m) {
+		MeshAllocation &allocation = mesh_allocations[m];
+		if(allocation.vertex_offset == OffsetAllocator::INVALID_OFFSET) {
+			continue;
+		}
+		uint64_t vertex_offset = new_vertex_offsets[allocation.vertex_offset];
+		uint64_t index_offset = new_index_offsets[allocation.index_offset];
+		for(Primitive &primitive : scene.meshes[m].primitives) {
+			primitive.vertex_offset = static_cast<uint32_t>(vertex_offset + primitive.vertex_offset - allocation.vertex_offset);
+			primitive.index_offset = static_cast<uint32_t>(index_offset + primitive.index_offset - allocation.index_offset);
+		}
+		allocation.vertex_offset = vertex_offset;
+		allocation.index_offset = index_offset;
+		if(allocation.primitive_offset != OffsetAllocator::INVALID_OFFSET) {
+			allocation.primitive_offset = new_primitive_offsets[allocation.primitive_offset];
+			scene.meshes[m].first_primitive = static_cast<uint32_t>(allocation.primitive_offset);
+			allocation.transform_offset = new_transform_offsets[allocation.transform_offset];
+			scene.meshes[m].first_transform = static_cast<uint32_t>(allocation.transform_offset);
+		}
+	}
 
-	std::vector<VkWriteDescriptorSet> write_descriptor_sets {
-		VkWriteDescriptorSet {
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = global_descriptor_set0,
-			.dstBinding = 0,
-			.descriptorCount = 1,
-			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.pBufferInfo = &vertex_buffer_info
-		},
-		VkWriteDescriptorSet {
-			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-			.dstSet = global_descriptor_set0,
-			.dstBinding = 1,
-			.descriptorCount = 1,
-			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.pBufferInfo = &index_buffer_info
-		},
-		VkWriteDescriptorSet {
+	// The records hold the geometry offsets and transform indices, and the TLAS instances the record indices
+	UploadPrimitiveRecords(scene);
+	UpdateTLAS(scene);
+	WriteGeometryDescriptors();
+	PrintGeometryStatistics();
+}
+
+void ResourceManager::PrintGeometryStatistics() {
+	if(!LOG_STATISTICS) {
+		return;
+	}
+	for(GeometryBuffer *geometry_buffer : { &global_vertex_buffer, &global_index_buffer, &global_obj_data_buffer,
+		&global_transform_buffer, &global_material_buffer }) {
+		OffsetAllocator::Statistics statistics = geometry_buffer->allocator.GetStatistics();
+		VkDeviceSize element_size = geometry_buffer->element_size;
+		printf("%s: %.2f of %.2f MB used (%.1f%%), %u allocations, %u free ranges, largest %.2f MB, %.1f%% fragmented\n",
+			geometry_buffer->name, statistics.used * element_size / (1024.0 * 1024.0),
+			statistics.capacity * element_size / (1024.0 * 1024.0),
+			statistics.capacity ? 100.0 * statistics.used / statistics.capacity : 0.0,
+			statistics.allocation_count, statistics.free_range_count,
+			statistics.largest_free_range * element_size / (1024.0 * 1024.0), 100.0f * statistics.fragmentation);
+	}
+}
+
+void ResourceManager::CreateGeometryBuffer(GeometryBuffer &geometry_buffer, const char *name, VkDeviceSize element_size,
+	VkBufferUsageFlags usage, uint32_t binding) {
+	geometry_buffer.name = name;
+	geometry_buffer.element_size = element_size;
+	geometry_buffer.usage = usage;
+	geometry_buffer.binding = binding;
+	ResizeGeometryBuffer(geometry_buffer, GEOMETRY_BUFFER_INITIAL_SIZE / element_size, {});
+}
+
+void ResourceManager::ResizeGeometryBuffer(GeometryBuffer &geometry_buffer, uint64_t capacity,
+	const std::vector<OffsetAllocator::Relocation> &relocations) {
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(capacity * geometry_buffer.element_size, geometry_buffer.usage);
+	GPUBuffer buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+
+	if(geometry_buffer.buffer.handle != VK_NULL_HANDLE) {
+		// Frames in flight may still read the old buffer
+		VK_CHECK(vkDeviceWaitIdle(context.device));
+
+		std::vector<VkBufferCopy> regions;
+		for(const OffsetAllocator::Relocation &relocation : relocations) {
+			if(relocation.size > 0) {
+				regions.emplace_back(VkBufferCopy {
+					.srcOffset = relocation.src_offset * geometry_buffer.element_size,
+					.dstOffset = relocation.dst_offset * geometry_buffer.element_size,
+					.size = relocation.size * geometry_buffer.element_size
+				});
+			}
+		}
+		if(!regions.empty()) {
+			// Uploads to the old buffer may still be pending in the same batch
+			VkCommandBuffer command_buffer = upload_context.GetCommandBuffer();
+			VkMemoryBarrier memory_barrier {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+				.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT
+			};
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+			vkCmdCopyBuffer(command_buffer, geometry_buffer.buffer.handle, buffer.handle,
+				static_cast<uint32_t>(regions.size()), regions.data());
+		}
+		upload_context.DestroyAfterUpload(geometry_buffer.buffer);
+	}
+
+	geometry_buffer.buffer = buffer;
+	geometry_buffer.allocator.Resize(capacity);
+}
+
+uint64_t ResourceManager::AllocateGeometry(GeometryBuffer &geometry_buffer, uint64_t count, uint64_t alignment) {
+	OffsetAllocator &allocator = geometry_buffer.allocator;
+	uint64_t offset = allocator.Allocate(count, alignment);
+	if(offset == OffsetAllocator::INVALID_OFFSET) {
+		// Grow geometrically, so adding meshes one by one doesn't copy the buffer every time
+		uint64_t capacity = std::max(allocator.GetCapacity() * 2, allocator.GetCapacity() + count + alignment);
+		ResizeGeometryBuffer(geometry_buffer, capacity, { OffsetAllocator::Relocation {
+			.src_offset = 0,
+			.dst_offset = 0,
+			.size = allocator.GetUsedEnd()
+		}});
+		offset = allocator.Allocate(count, alignment);
+	}
+	assert(offset != OffsetAllocator::INVALID_OFFSET);
+	return offset;
+}
+
+void ResourceManager::UploadPrimitiveRecords(Scene &scene) {
+	// Records of all mesh instances, ordered by instance, then primitive within every mesh.
+	// The instanced draws and the TLAS instance custom indices rely on this order.
+	std::vector<Primitive> primitives;
+	std::vector<VkBufferCopy> copies;
+	std::vector<glm::mat4> transforms;
+	std::vector<VkBufferCopy> transform_copies;
+	for(Mesh &mesh : scene.meshes) {
+		if(mesh.primitives.empty() || mesh.instance_transforms.empty()) {
+			continue;
+		}
+		copies.emplace_back(VkBufferCopy {
+			.srcOffset = primitives.size() * sizeof(Primitive),
+			.dstOffset = mesh.first_primitive * sizeof(Primitive),
+			.size = mesh.primitives.size() * mesh.instance_transforms.size() * sizeof(Primitive)
+		});
+		transform_copies.emplace_back(VkBufferCopy {
+			.srcOffset = transforms.size() * sizeof(glm::mat4),
+			.dstOffset = mesh.first_transform * sizeof(glm::mat4),
+			.size = mesh.instance_transforms.size() * sizeof(glm::mat4)
+		});
+		for(uint32_t i = 0; i < mesh.instance_transforms.size(); ++i) {
+			for(Primitive &primitive : mesh.primitives) {
+				primitives.push_back(primitive);
+				primitives.back().transform = mesh.first_transform + i;
+			}
+		}
+		transforms.insert(transforms.end(), mesh.instance_transforms.begin(), mesh.instance_transforms.end());
+	}
+	if(!primitives.empty()) {
+		UploadDataToGPUBuffer(global_obj_data_buffer.buffer, primitives.data(), primitives.size() * sizeof(Primitive), copies);
+		UploadDataToGPUBuffer(global_transform_buffer.buffer, transforms.data(), transforms.size() * sizeof(glm::mat4),
+			transform_copies);
+	}
+	gpu_culling.SetDrawList(scene);
+	frustum_culler.SetPrimitives(scene);
+}
+
+void ResourceManager::UploadMaterials(Scene &scene) {
+	if(material_offset != OffsetAllocator::INVALID_OFFSET) {
+		global_material_buffer.allocator.Free(material_offset);
+		material_offset = OffsetAllocator::INVALID_OFFSET;
+	}
+	if(scene.materials.empty()) {
+		return;
+	}
+
+	// With nothing else in the buffer the allocation starts at 0, so material indices need no rebasing
+	material_offset = AllocateGeometry(global_material_buffer, scene.materials.size());
+	assert(material_offset == 0);
+	UploadDataToGPUBuffer(global_material_buffer.buffer, scene.materials.data(), scene.materials.size() * sizeof(Material),
+		{ VkBufferCopy {
+			.srcOffset = 0,
+			.dstOffset = 0,
+			.size = scene.materials.size() * sizeof(Material)
+		}});
+}
+
+void ResourceManager::WriteGeometryDescriptors() {
+	std::vector<VkDescriptorBufferInfo> buffer_infos;
+	std::vector<VkWriteDescriptorSet> write_descriptor_sets;
+	buffer_infos.reserve(5);
+	for(GeometryBuffer *geometry_buffer : { &global_vertex_buffer, &global_index_buffer, &global_obj_data_buffer,
+		&global_transform_buffer, &global_material_buffer }) {
+		buffer_infos.emplace_back(VkDescriptorBufferInfo {
+			.buffer = geometry_buffer->buffer.handle,
+			.range = VK_WHOLE_SIZE
+		});
+		write_descriptor_sets.emplace_back(VkWriteDescriptorSet {
 			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 			.dstSet = global_descriptor_set0,
-			.dstBinding = 2,
+			.dstBinding = geometry_buffer->binding,
 			.descriptorCount = 1,
 			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.pBufferInfo = &obj_data_buffer_info
-		},
-		VkWriteDescriptorSet {
+			.pBufferInfo = &buffer_infos.back()
+		});
+	}
+
+	VkWriteDescriptorSetAccelerationStructureKHR write_descriptor_set_acceleration_structure {
+		.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET_ACCELERATION_STRUCTURE_KHR,
+		.accelerationStructureCount = 1,
+		.pAccelerationStructures = &global_TLAS.handle
+	};
+	if(global_TLAS.handle != VK_NULL_HANDLE) {
+		write_descriptor_sets.emplace_back(VkWriteDescriptorSet {
 			.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
 			.pNext = &write_descriptor_set_acceleration_structure,
 			.dstSet = global_descriptor_set0,
 			.dstBinding = 3,
 			.descriptorCount = 1,
 			.descriptorType = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR
-		}
-	};
+		});
+	}
 
 	vkUpdateDescriptorSets(context.device, static_cast<uint32_t>(write_descriptor_sets.size()),
 		write_descriptor_sets.data(), 0, nullptr);
@@ -367,7 +1145,7 @@ void ResourceManager::CreateGlobalDescriptorSet0() {
 	std::array<VkDescriptorPoolSize, 3> descriptor_pool_sizes {
 		VkDescriptorPoolSize {
 			.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
-			.descriptorCount = 3
+			.descriptorCount = 5
 		},
 		VkDescriptorPoolSize {
 			.type = VK_DESCRIPTOR_TYPE_ACCELERATION_STRUCTURE_KHR,
@@ -375,11 +1153,12 @@ void ResourceManager::CreateGlobalDescriptorSet0() {
 		},
 		VkDescriptorPoolSize {
 			.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			.descriptorCount = MAX_GLOBAL_RESOURCES
+			.descriptorCount = texture_slots.GetCapacity()
 		}
 	};
 	VkDescriptorPoolCreateInfo descriptor_pool_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
 		.maxSets = 1,
 		.poolSizeCount = static_cast<uint32_t>(descriptor_pool_sizes.size()),
 		.pPoolSizes = descriptor_pool_sizes.data()
@@ -387,25 +1166,28 @@ void ResourceManager::CreateGlobalDescriptorSet0() {
 	VK_CHECK(vkCreateDescriptorPool(context.device, &descriptor_pool_info, nullptr, 
 		&global_descriptor_pool0));
 
-	std::array<VkDescriptorSetLayoutBinding, 5> descriptor_set_layout_bindings {
+	std::array<VkDescriptorSetLayoutBinding, 7> descriptor_set_layout_bindings {
 		VkDescriptorSetLayoutBinding {
 			.binding = 0,
 			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 			.descriptorCount = 1,
-			.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR
+			.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | 
+				VK_SHADER_STAGE_FRAGMENT_BIT
 		},
 		VkDescriptorSetLayoutBinding {
 			.binding = 1,
 			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 			.descriptorCount = 1,
-			.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR
+			.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR | 
+				VK_SHADER_STAGE_FRAGMENT_BIT
 		},
 		VkDescriptorSetLayoutBinding {
 			.binding = 2,
 			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
 			.descriptorCount = 1,
 			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT | 
-						  VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR
+						  VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR |
+						  VK_SHADER_STAGE_COMPUTE_BIT
 		},
 		VkDescriptorSetLayoutBinding {
 			.binding = 3,
@@ -416,19 +1198,37 @@ void ResourceManager::CreateGlobalDescriptorSet0() {
 		},
 		VkDescriptorSetLayoutBinding {
 			.binding = 4,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_VERTEX_BIT | VK_SHADER_STAGE_COMPUTE_BIT
+		},
+		VkDescriptorSetLayoutBinding {
+			.binding = 5,
+			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER,
+			.descriptorCount = 1,
+			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR |
+						  VK_SHADER_STAGE_COMPUTE_BIT
+		},
+		VkDescriptorSetLayoutBinding {
+			.binding = GLOBAL_TEXTURES_BINDING,
 			.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-			.descriptorCount = MAX_GLOBAL_RESOURCES,
+			.descriptorCount = texture_slots.GetCapacity(),
 			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT | 
 						  VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR |
 						  VK_SHADER_STAGE_RAYGEN_BIT_KHR
 		}
 	};
-	std::array<VkDescriptorBindingFlags, 5> descriptor_binding_flags {
+	std::array<VkDescriptorBindingFlags, 7> descriptor_binding_flags {
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
 		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
 		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
 		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
 		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+		// Textures are written while the set is bound by frames in flight, but never the slots they use
 		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT |
 		VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
 	};
 	VkDescriptorSetLayoutBindingFlagsCreateInfo descriptor_set_layout_binding_flags_info {
@@ -439,13 +1239,14 @@ void ResourceManager::CreateGlobalDescriptorSet0() {
 	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 		.pNext = &descriptor_set_layout_binding_flags_info,
+		.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
 		.bindingCount = static_cast<uint32_t>(descriptor_set_layout_bindings.size()),
 		.pBindings = descriptor_set_layout_bindings.data()
 	};
 	VK_CHECK(vkCreateDescriptorSetLayout(context.device, &descriptor_set_layout_info, 
 		nullptr, &global_descriptor_set_layout0));
 
-	uint32_t alloc_count = MAX_GLOBAL_RESOURCES;
+	uint32_t alloc_count = texture_slots.GetCapacity();
 	VkDescriptorSetVariableDescriptorCountAllocateInfo descriptor_set_variable_alloc_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT,
 		.descriptorSetCount = 1,
@@ -466,11 +1267,12 @@ void ResourceManager::CreateGlobalDescriptorSet1() {
 	std::array<VkDescriptorPoolSize, 1> descriptor_pool_sizes {
 	VkDescriptorPoolSize {
 		.type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-		.descriptorCount = MAX_GLOBAL_RESOURCES
+		.descriptorCount = storage_image_slots.GetCapacity()
 	}
 	};
 	VkDescriptorPoolCreateInfo descriptor_pool_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO,
+		.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT,
 		.maxSets = 1,
 		.poolSizeCount = static_cast<uint32_t>(descriptor_pool_sizes.size()),
 		.pPoolSizes = descriptor_pool_sizes.data()
@@ -482,14 +1284,15 @@ void ResourceManager::CreateGlobalDescriptorSet1() {
 		VkDescriptorSetLayoutBinding {
 			.binding = 0,
 			.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-			.descriptorCount = MAX_GLOBAL_RESOURCES,
+			.descriptorCount = storage_image_slots.GetCapacity(),
 			.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT | VK_SHADER_STAGE_VERTEX_BIT |
 						  VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR | VK_SHADER_STAGE_ANY_HIT_BIT_KHR |
 						  VK_SHADER_STAGE_COMPUTE_BIT | VK_SHADER_STAGE_RAYGEN_BIT_KHR
 		}
 	};
 	std::array<VkDescriptorBindingFlags, 1> descriptor_binding_flags {
-		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
+		VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT | VK_DESCRIPTOR_BINDING_VARIABLE_DESCRIPTOR_COUNT_BIT
 	};
 	VkDescriptorSetLayoutBindingFlagsCreateInfo descriptor_set_layout_binding_flags_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
@@ -499,13 +1302,14 @@ void ResourceManager::CreateGlobalDescriptorSet1() {
 	VkDescriptorSetLayoutCreateInfo descriptor_set_layout_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO,
 		.pNext = &descriptor_set_layout_binding_flags_info,
+		.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT,
 		.bindingCount = static_cast<uint32_t>(descriptor_set_layout_bindings.size()),
 		.pBindings = descriptor_set_layout_bindings.data()
 	};
 	VK_CHECK(vkCreateDescriptorSetLayout(context.device, &descriptor_set_layout_info,
 		nullptr, &global_descriptor_set_layout1));
 
-	uint32_t alloc_count = MAX_GLOBAL_RESOURCES;
+	uint32_t alloc_count = storage_image_slots.GetCapacity();
 	VkDescriptorSetVariableDescriptorCountAllocateInfo descriptor_set_variable_alloc_info {
 		.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_VARIABLE_DESCRIPTOR_COUNT_ALLOCATE_INFO_EXT,
 		.descriptorSetCount = 1,
@@ -590,139 +1394,643 @@ void ResourceManager::CreatePerFrameUBOs() {
 	}
 }
 
-void ResourceManager::UpdateBLAS(uint32_t vertex_count, std::vector<Primitive> &primitives) {
-	std::vector<VkAccelerationStructureGeometryKHR> acceleration_structure_geometries;
-	std::vector<VkAccelerationStructureBuildRangeInfoKHR> acceleration_structure_build_range_infos;
-	std::vector<VkAccelerationStructureBuildRangeInfoKHR *> acceleration_structure_build_range_pinfos;
-	std::vector<VkTransformMatrixKHR> transform_data;
-	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(
-		sizeof(VkTransformMatrixKHR) * primitives.size(),
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-	GPUBuffer transform_data_buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
-	std::vector<uint32_t> max_primitive_counts;
-
-	acceleration_structure_build_range_infos.reserve(primitives.size());
-	uint32_t transform_offset = 0;
-	for(Primitive &primitive : primitives) {
-		glm::vec4 row1 = glm::row(primitive.transform, 0);
-		glm::vec4 row2 = glm::row(primitive.transform, 1);
-		glm::vec4 row3 = glm::row(primitive.transform, 2);
-		transform_data.emplace_back(VkTransformMatrixKHR {
-			.matrix = { 
-				row1[0], row1[1], row1[2], row1[3],
-				row2[0], row2[1], row2[2], row2[3],
-				row3[0], row3[1], row3[2], row3[3] 
+void ResourceManager::UpdateBLAS(Scene &scene, const std::vector<MeshGeometryData> &mesh_data) {
+	// Split every mesh into its opaque and alpha tested primitives, the primitives are already sorted that way
+	blas_geometries.clear();
+	for(uint32_t m = 0; m < scene.meshes.size(); ++m) {
+		Mesh &mesh = scene.meshes[m];
+		uint32_t primitive_count = static_cast<uint32_t>(mesh.primitives.size());
+		uint32_t opaque_count = static_cast<uint32_t>(std::count_if(mesh.primitives.begin(), mesh.primitives.end(),
+			[&scene](const Primitive &primitive) { return scene.materials[primitive.material].alpha_mask != 1; }));
+		if(opaque_count > 0) {
+			blas_geometries.emplace_back(BLASGeometry {
+				.mesh_idx = m,
+				.first_primitive = 0,
+				.primitive_count = opaque_count,
+				.alpha_tested = false
+			});
+		}
+		if(opaque_count < primitive_count) {
+			blas_geometries.emplace_back(BLASGeometry {
+				.mesh_idx = m,
+				.first_primitive = opaque_count,
+				.primitive_count = primitive_count - opaque_count,
+				.alpha_tested = true
+			});
+		}
+	}
+
+	uint32_t blas_count = static_cast<uint32_t>(blas_geometries.size());
+	BLASes.resize(blas_count);
+	if(LOG_STATISTICS && BENCHMARK_BLAS_BUILDS) {
+		BenchmarkBLASBuilds(scene, mesh_data);
+	}
+
+	std::vector<std::string> cache_paths(blas_count);
+	std::vector<uint32_t> BLASes_to_build;
+	if(CACHE_BLASES) {
+		#pragma omp parallel for
+		for(int b = 0; b < static_cast<int>(blas_count); ++b) {
+			uint32_t m = blas_geometries[b].mesh_idx;
+			cache_paths[b] = GetBLASCachePath(scene.meshes[m], mesh_allocations[m], blas_geometries[b], mesh_data[m],
+				context.gpu.properties.properties);
+		}
+		BLASes_to_build = LoadCachedBLASes(cache_paths);
+	}
+	else {
+		BLASes_to_build.resize(blas_count);
+		std::iota(BLASes_to_build.begin(), BLASes_to_build.end(), 0);
+	}
+
+	if(HOST_BUILD_BLASES && context.gpu.supports_host_acceleration_structure_commands) {
+		// The host and device implementations may use different formats, those BLASes are built on the device
+		std::vector<std::vector<uint8_t>> serialized_BLASes = HostBuildBLASes(scene, mesh_data, BLASes_to_build);
+		std::vector<uint32_t> host_built_BLASes;
+		std::vector<uint32_t> device_built_BLASes;
+		for(uint32_t b : BLASes_to_build) {
+			if(IsSerializedBLASCompatible(context.device, serialized_BLASes[b])) {
+				host_built_BLASes.push_back(b);
+			}
+			else {
+				serialized_BLASes[b].clear();
+				device_built_BLASes.push_back(b);
+			}
+		}
+
+		if(!host_built_BLASes.empty()) {
+			DeserializeBLASes(serialized_BLASes);
+		}
+		BuildBLASes(scene, device_built_BLASes);
+		if(CACHE_BLASES && !host_built_BLASes.empty()) {
+			std::filesystem::create_directories(BLAS_CACHE_DIRECTORY);
+			for(uint32_t b : host_built_BLASes) {
+				WriteSerializedBLAS(cache_paths[b].c_str(), serialized_BLASes[b].data(), serialized_BLASes[b].size());
+			}
+		}
+		if(CACHE_BLASES && !device_built_BLASes.empty()) {
+			SaveBLASCache(device_built_BLASes, cache_paths);
+		}
+	}
+	else {
+		BuildBLASes(scene, BLASes_to_build);
+		if(CACHE_BLASES && !BLASes_to_build.empty()) {
+			SaveBLASCache(BLASes_to_build, cache_paths);
+		}
+	}
+}
+
+void ResourceManager::BuildBLASes(Scene &scene, const std::vector<uint32_t> &blas_indices) {
+	uint32_t build_count = static_cast<uint32_t>(blas_indices.size());
+	if(build_count == 0) {
+		return;
+	}
+	std::vector<std::vector<VkAccelerationStructureGeometryKHR>> acceleration_structure_geometries(build_count);
+	std::vector<std::vector<VkAccelerationStructureBuildRangeInfoKHR>> acceleration_structure_build_range_infos(build_count);
+	std::vector<VkAccelerationStructureBuildRangeInfoKHR *> acceleration_structure_build_range_pinfos(build_count);
+	std::vector<VkAccelerationStructureBuildGeometryInfoKHR> acceleration_structure_build_geometry_infos(build_count);
+	std::vector<VkDeviceSize> scratch_sizes(build_count);
+
+	VkDeviceSize scratch_alignment = context.gpu.acceleration_structure_properties.minAccelerationStructureScratchOffsetAlignment;
+	VkDeviceSize max_scratch_size = 0;
+	VkDeviceAddress vertex_buffer_address = VkUtils::GetDeviceAddress(context.device, global_vertex_buffer.buffer.handle).deviceAddress;
+	VkDeviceAddress index_buffer_address = VkUtils::GetDeviceAddress(context.device, global_index_buffer.buffer.handle).deviceAddress;
+	for(uint32_t b = 0; b < build_count; ++b) {
+		std::vector<uint32_t> max_primitive_counts;
+		BLASGeometry &blas_geometry = blas_geometries[blas_indices[b]];
+		MeshAllocation &mesh_allocation = mesh_allocations[blas_geometry.mesh_idx];
+		GetBLASGeometries(scene.meshes[blas_geometry.mesh_idx], mesh_allocation, blas_geometry,
+			VkDeviceOrHostAddressConstKHR { .deviceAddress = vertex_buffer_address + mesh_allocation.vertex_offset * sizeof(Vertex) },
+			VkDeviceOrHostAddressConstKHR { .deviceAddress = index_buffer_address + mesh_allocation.index_offset * sizeof(uint16_t) },
+			acceleration_structure_geometries[b], acceleration_structure_build_range_infos[b], max_primitive_counts);
+		acceleration_structure_build_range_pinfos[b] = acceleration_structure_build_range_infos[b].data();
+
+		VkAccelerationStructureBuildGeometryInfoKHR &acceleration_structure_build_geometry_info =
+			acceleration_structure_build_geometry_infos[b];
+		acceleration_structure_build_geometry_info = VkAccelerationStructureBuildGeometryInfoKHR {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+				(COMPACT_BLASES ? VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR : 0u),
+			.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+			.geometryCount = static_cast<uint32_t>(acceleration_structure_geometries[b].size()),
+			.pGeometries = acceleration_structure_geometries[b].data()
+		};
+
+		VkAccelerationStructureBuildSizesInfoKHR acceleration_structure_build_sizes_info {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+		};
+		vkGetAccelerationStructureBuildSizesKHR(context.device,
+			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
+			&acceleration_structure_build_geometry_info,
+			max_primitive_counts.data(),
+			&acceleration_structure_build_sizes_info
+		);
+
+		AccelerationStructure &blas = BLASes[blas_indices[b]];
+		VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(
+			acceleration_structure_build_sizes_info.accelerationStructureSize,
+			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR
+		);
+		blas.buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+
+		VkAccelerationStructureCreateInfoKHR acceleration_structure_info {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.buffer = blas.buffer.handle,
+			.size = acceleration_structure_build_sizes_info.accelerationStructureSize,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR
+		};
+		VK_CHECK(vkCreateAccelerationStructureKHR(context.device, &acceleration_structure_info, nullptr,
+			&blas.handle));
+		blas.address = VkUtils::GetAccelerationStructureAddress(context.device, blas.handle).deviceAddress;
+		blas.size = acceleration_structure_build_sizes_info.accelerationStructureSize;
+
+		acceleration_structure_build_geometry_info.dstAccelerationStructure = blas.handle;
+		scratch_sizes[b] = VkUtils::AlignUp(acceleration_structure_build_sizes_info.buildScratchSize, scratch_alignment);
+		max_scratch_size = std::max(max_scratch_size, scratch_sizes[b]);
+	}
+
+	// All BLASes share one scratch pool. As many builds as fit are batched into one call,
+	// the pool is reused by the next batch once the previous one has finished writing to it.
+	VkDeviceSize scratch_pool_size = std::max(BLAS_SCRATCH_POOL_SIZE, max_scratch_size);
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(scratch_pool_size + scratch_alignment,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+	GPUBuffer scratch_pool = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+	VkDeviceAddress scratch_pool_address = VkUtils::AlignUp(
+		VkUtils::GetDeviceAddress(context.device, scratch_pool.handle).deviceAddress, scratch_alignment);
+
+	VkQueryPool compacted_size_query_pool = VK_NULL_HANDLE;
+	std::vector<VkAccelerationStructureKHR> blas_handles;
+	if(COMPACT_BLASES) {
+		VkQueryPoolCreateInfo query_pool_info {
+			.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+			.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR,
+			.queryCount = build_count
+		};
+		VK_CHECK(vkCreateQueryPool(context.device, &query_pool_info, nullptr, &compacted_size_query_pool));
+		for(uint32_t b : blas_indices) {
+			blas_handles.push_back(BLASes[b].handle);
+		}
+	}
+
+	ExecuteImmediateCommands([&](VkCommandBuffer command_buffer) {
+		auto build_batch = [&](uint32_t first, uint32_t last) {
+			if(first == last) {
+				return;
 			}
+			vkCmdBuildAccelerationStructuresKHR(command_buffer,
+				last - first,
+				&acceleration_structure_build_geometry_infos[first],
+				&acceleration_structure_build_range_pinfos[first]
+			);
+
+			VkMemoryBarrier memory_barrier {
+				.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+				.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+				.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | 
+					VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR
+			};
+			vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+				VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+		};
+
+		uint32_t batch_start = 0;
+		VkDeviceSize scratch_offset = 0;
+		for(uint32_t b = 0; b < build_count; ++b) {
+			if(scratch_offset + scratch_sizes[b] > scratch_pool_size) {
+				build_batch(batch_start, b);
+				batch_start = b;
+				scratch_offset = 0;
+			}
+			acceleration_structure_build_geometry_infos[b].scratchData.deviceAddress = scratch_pool_address + scratch_offset;
+			scratch_offset += scratch_sizes[b];
+		}
+		build_batch(batch_start, build_count);
+
+		// The last batch ends with a barrier, so all builds are complete before the sizes are read
+		if(compacted_size_query_pool != VK_NULL_HANDLE) {
+			vkCmdResetQueryPool(command_buffer, compacted_size_query_pool, 0, build_count);
+			vkCmdWriteAccelerationStructuresPropertiesKHR(command_buffer, build_count, blas_handles.data(),
+				VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, compacted_size_query_pool, 0);
+		}
+	});
+
+	VkUtils::DestroyGPUBuffer(context.allocator, scratch_pool);
+
+	if(compacted_size_query_pool != VK_NULL_HANDLE) {
+		CompactBLASes(compacted_size_query_pool, blas_indices);
+		vkDestroyQueryPool(context.device, compacted_size_query_pool, nullptr);
+	}
+}
+
+void ResourceManager::CompactBLASes(VkQueryPool compacted_size_query_pool, const std::vector<uint32_t> &blas_indices) {
+	uint32_t blas_count = static_cast<uint32_t>(blas_indices.size());
+	std::vector<VkDeviceSize> compacted_sizes(blas_count);
+	VK_CHECK(vkGetQueryPoolResults(context.device, compacted_size_query_pool, 0, blas_count,
+		compacted_sizes.size() * sizeof(VkDeviceSize), compacted_sizes.data(), sizeof(VkDeviceSize),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+
+	std::vector<AccelerationStructure> compacted_BLASes(blas_count);
+	VkDeviceSize size_before = 0;
+	VkDeviceSize size_after = 0;
+	for(uint32_t i = 0; i < blas_count; ++i) {
+		AccelerationStructure &compacted_blas = compacted_BLASes[i];
+		VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(compacted_sizes[i],
+			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
+		compacted_blas.buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+
+		VkAccelerationStructureCreateInfoKHR acceleration_structure_info {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.buffer = compacted_blas.buffer.handle,
+			.size = compacted_sizes[i],
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR
+		};
+		VK_CHECK(vkCreateAccelerationStructureKHR(context.device, &acceleration_structure_info, nullptr,
+			&compacted_blas.handle));
+		compacted_blas.address = VkUtils::GetAccelerationStructureAddress(context.device, 
+			compacted_blas.handle).deviceAddress;
+		compacted_blas.size = compacted_sizes[i];
+
+		size_before += BLASes[blas_indices[i]].size;
+		size_after += compacted_sizes[i];
+	}
+
+	ExecuteImmediateCommands([&](VkCommandBuffer command_buffer) {
+		for(uint32_t i = 0; i < blas_count; ++i) {
+			VkCopyAccelerationStructureInfoKHR copy_info {
+				.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+				.src = BLASes[blas_indices[i]].handle,
+				.dst = compacted_BLASes[i].handle,
+				.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR
+			};
+			vkCmdCopyAccelerationStructureKHR(command_buffer, &copy_info);
+		}
+	});
+
+	for(uint32_t i = 0; i < blas_count; ++i) {
+		VkUtils::DestroyAccelerationStructure(context.device, context.allocator, BLASes[blas_indices[i]]);
+		BLASes[blas_indices[i]] = compacted_BLASes[i];
+	}
+
+	if(LOG_STATISTICS) {
+		printf("BLAS memory: %.2f MB -> %.2f MB after compaction (%.1f%% saved, %u BLASes)\n",
+			size_before / (1024.0 * 1024.0), size_after / (1024.0 * 1024.0),
+			size_before ? 100.0 * (size_before - size_after) / size_before : 0.0, blas_count);
+	}
+}
+
+std::vector<uint32_t> ResourceManager::LoadCachedBLASes(const std::vector<std::string> &cache_paths) {
+	uint32_t blas_count = static_cast<uint32_t>(cache_paths.size());
+	std::vector<std::vector<uint8_t>> serialized_BLASes(blas_count);
+	std::vector<uint32_t> BLASes_to_build;
+	for(uint32_t b = 0; b < blas_count; ++b) {
+		std::vector<uint8_t> &serialized_blas = serialized_BLASes[b];
+		if(!ReadSerializedBLAS(cache_paths[b].c_str(), serialized_blas)) {
+			BLASes_to_build.push_back(b);
+			continue;
+		}
+
+		// Entries written by another driver or GPU are rebuilt and overwritten
+		if(!IsSerializedBLASCompatible(context.device, serialized_blas)) {
+			serialized_blas.clear();
+			BLASes_to_build.push_back(b);
+		}
+	}
+
+	uint32_t cached_count = blas_count - static_cast<uint32_t>(BLASes_to_build.size());
+	if(LOG_STATISTICS) {
+		printf("BLAS cache: %u of %u BLASes loaded from disk\n", cached_count, blas_count);
+	}
+	if(cached_count > 0) {
+		DeserializeBLASes(serialized_BLASes);
+	}
+	return BLASes_to_build;
+}
+
+void ResourceManager::DeserializeBLASes(std::vector<std::vector<uint8_t>> &serialized_BLASes) {
+	uint32_t blas_count = static_cast<uint32_t>(serialized_BLASes.size());
+	VkDeviceSize staging_size = 0;
+	for(std::vector<uint8_t> &serialized_blas : serialized_BLASes) {
+		staging_size += VkUtils::AlignUp(static_cast<VkDeviceSize>(serialized_blas.size()), SERIALIZED_AS_ALIGNMENT);
+	}
+
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(staging_size + SERIALIZED_AS_ALIGNMENT,
+		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR | 
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+	MappedBuffer staging_buffer = VkUtils::CreateMappedBuffer(context.allocator, buffer_info);
+	VkDeviceAddress staging_address = VkUtils::GetDeviceAddress(context.device, staging_buffer.handle).deviceAddress;
+	VkDeviceSize staging_offset = VkUtils::AlignUp(staging_address, SERIALIZED_AS_ALIGNMENT) - staging_address;
+
+	std::vector<VkCopyMemoryToAccelerationStructureInfoKHR> copy_infos;
+	for(uint32_t b = 0; b < blas_count; ++b) {
+		std::vector<uint8_t> &serialized_blas = serialized_BLASes[b];
+		if(serialized_blas.empty()) {
+			continue;
+		}
+
+		// The serialized header holds the two version UUIDs, the serialized size and then the deserialized size
+		VkDeviceSize size;
+		memcpy(&size, serialized_blas.data() + 2 * VK_UUID_SIZE + sizeof(uint64_t), sizeof(size));
+
+		AccelerationStructure &blas = BLASes[b];
+		buffer_info = VkUtils::BufferCreateInfo(size, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
+		blas.buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+
+		VkAccelerationStructureCreateInfoKHR acceleration_structure_info {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.buffer = blas.buffer.handle,
+			.size = size,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR
+		};
+		VK_CHECK(vkCreateAccelerationStructureKHR(context.device, &acceleration_structure_info, nullptr,
+			&blas.handle));
+		blas.address = VkUtils::GetAccelerationStructureAddress(context.device, blas.handle).deviceAddress;
+		blas.size = size;
+
+		memcpy(static_cast<uint8_t *>(staging_buffer.mapped_data) + staging_offset, serialized_blas.data(),
+			serialized_blas.size());
+		copy_infos.emplace_back(VkCopyMemoryToAccelerationStructureInfoKHR {
+			.sType = VK_STRUCTURE_TYPE_COPY_MEMORY_TO_ACCELERATION_STRUCTURE_INFO_KHR,
+			.src = VkDeviceOrHostAddressConstKHR {
+				.deviceAddress = staging_address + staging_offset
+			},
+			.dst = blas.handle,
+			.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_DESERIALIZE_KHR
 		});
-		acceleration_structure_geometries.emplace_back(VkAccelerationStructureGeometryKHR {
-			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
-			.geometryType = VK_GEOMETRY_TYPE_TRIANGLES_KHR,
-			.geometry = VkAccelerationStructureGeometryDataKHR {
-				.triangles = VkAccelerationStructureGeometryTrianglesDataKHR {
-					.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_TRIANGLES_DATA_KHR,
-					.vertexFormat = VK_FORMAT_R32G32B32_SFLOAT,
-					.vertexData = VkUtils::GetDeviceAddressConst(context.device, global_vertex_buffer.handle),
-					.vertexStride = sizeof(Vertex),
-					.maxVertex = primitive.vertex_offset + primitive.index_count / 3,
-					.indexType = VK_INDEX_TYPE_UINT32,
-					.indexData = VkUtils::GetDeviceAddressConst(context.device, global_index_buffer.handle),
-					.transformData = VkUtils::GetDeviceAddressConst(context.device, transform_data_buffer.handle)
+		staging_offset += VkUtils::AlignUp(static_cast<VkDeviceSize>(serialized_blas.size()), SERIALIZED_AS_ALIGNMENT);
+	}
+
+	ExecuteImmediateCommands([&](VkCommandBuffer command_buffer) {
+		for(VkCopyMemoryToAccelerationStructureInfoKHR &copy_info : copy_infos) {
+			vkCmdCopyMemoryToAccelerationStructureKHR(command_buffer, &copy_info);
+		}
+	});
+
+	VkUtils::DestroyMappedBuffer(context.allocator, staging_buffer);
+}
+
+std::vector<std::vector<uint8_t>> ResourceManager::HostBuildBLASes(Scene &scene, const std::vector<MeshGeometryData> &mesh_data,
+	const std::vector<uint32_t> &blas_indices) {
+	std::vector<std::vector<uint8_t>> serialized_BLASes(blas_geometries.size());
+	std::vector<uint8_t> scratch;
+	int max_threads = omp_get_max_threads();
+
+	// BLASes are built one after another, every build is spread over the worker threads
+	for(uint32_t b : blas_indices) {
+		std::vector<VkAccelerationStructureGeometryKHR> acceleration_structure_geometries;
+		std::vector<VkAccelerationStructureBuildRangeInfoKHR> acceleration_structure_build_range_infos;
+		std::vector<uint32_t> max_primitive_counts;
+		BLASGeometry &blas_geometry = blas_geometries[b];
+		GetBLASGeometries(scene.meshes[blas_geometry.mesh_idx], mesh_allocations[blas_geometry.mesh_idx], blas_geometry,
+			VkDeviceOrHostAddressConstKHR { .hostAddress = mesh_data[blas_geometry.mesh_idx].vertices },
+			VkDeviceOrHostAddressConstKHR { .hostAddress = mesh_data[blas_geometry.mesh_idx].indices },
+			acceleration_structure_geometries, acceleration_structure_build_range_infos, max_primitive_counts);
+
+		VkAccelerationStructureBuildGeometryInfoKHR acceleration_structure_build_geometry_info {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
+			.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR |
+				(COMPACT_BLASES ? VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR : 0u),
+			.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+			.geometryCount = static_cast<uint32_t>(acceleration_structure_geometries.size()),
+			.pGeometries = acceleration_structure_geometries.data()
+		};
+
+		VkAccelerationStructureBuildSizesInfoKHR acceleration_structure_build_sizes_info {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+		};
+		vkGetAccelerationStructureBuildSizesKHR(context.device,
+			VK_ACCELERATION_STRUCTURE_BUILD_TYPE_HOST_KHR,
+			&acceleration_structure_build_geometry_info,
+			max_primitive_counts.data(),
+			&acceleration_structure_build_sizes_info
+		);
+
+		// Host built acceleration structures have to live in host visible memory
+		VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(
+			acceleration_structure_build_sizes_info.accelerationStructureSize,
+			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR
+		);
+		MappedBuffer host_buffer = VkUtils::CreateMappedBuffer(context.allocator, buffer_info, VMA_MEMORY_USAGE_CPU_ONLY);
+
+		VkAccelerationStructureCreateInfoKHR acceleration_structure_info {
+			.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
+			.buffer = host_buffer.handle,
+			.size = acceleration_structure_build_sizes_info.accelerationStructureSize,
+			.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR
+		};
+		VkAccelerationStructureKHR host_blas;
+		VK_CHECK(vkCreateAccelerationStructureKHR(context.device, &acceleration_structure_info, nullptr, &host_blas));
+
+		scratch.resize(std::max(scratch.size(), static_cast<size_t>(acceleration_structure_build_sizes_info.buildScratchSize)));
+		acceleration_structure_build_geometry_info.dstAccelerationStructure = host_blas;
+		acceleration_structure_build_geometry_info.scratchData.hostAddress = scratch.data();
+
+		VkDeferredOperationKHR deferred_operation;
+		VK_CHECK(vkCreateDeferredOperationKHR(context.device, nullptr, &deferred_operation));
+		const VkAccelerationStructureBuildRangeInfoKHR *acceleration_structure_build_range_pinfo =
+			acceleration_structure_build_range_infos.data();
+		VkResult result = vkBuildAccelerationStructuresKHR(context.device, deferred_operation, 1,
+			&acceleration_structure_build_geometry_info, &acceleration_structure_build_range_pinfo);
+
+		if(result == VK_OPERATION_DEFERRED_KHR) {
+			int thread_count = static_cast<int>(std::min(
+				vkGetDeferredOperationMaxConcurrencyKHR(context.device, deferred_operation),
+				static_cast<uint32_t>(max_threads)));
+			#pragma omp parallel num_threads(std::max(thread_count, 1))
+			{
+				// VK_THREAD_IDLE_KHR means there is no work right now, but the operation isn't complete yet
+				while(vkDeferredOperationJoinKHR(context.device, deferred_operation) == VK_THREAD_IDLE_KHR) {
+					std::this_thread::yield();
 				}
+			}
+			result = vkGetDeferredOperationResultKHR(context.device, deferred_operation);
+		}
+		else if(result == VK_OPERATION_NOT_DEFERRED_KHR) {
+			result = VK_SUCCESS;
+		}
+		VK_CHECK(result);
+		vkDestroyDeferredOperationKHR(context.device, deferred_operation, nullptr);
+
+		// Deserialized BLASes keep the size they were serialized with, so they are compacted on the host first
+		if(COMPACT_BLASES) {
+			size_t compacted_size;
+			VK_CHECK(vkWriteAccelerationStructuresPropertiesKHR(context.device, 1, &host_blas,
+				VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, sizeof(compacted_size),
+				&compacted_size, sizeof(compacted_size)));
+
+			buffer_info = VkUtils::BufferCreateInfo(compacted_size, VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR);
+			MappedBuffer compacted_buffer = VkUtils::CreateMappedBuffer(context.allocator, buffer_info, VMA_MEMORY_USAGE_CPU_ONLY);
+			acceleration_structure_info.buffer = compacted_buffer.handle;
+			acceleration_structure_info.size = compacted_size;
+			VkAccelerationStructureKHR compacted_blas;
+			VK_CHECK(vkCreateAccelerationStructureKHR(context.device, &acceleration_structure_info, nullptr, &compacted_blas));
+
+			VkCopyAccelerationStructureInfoKHR compact_info {
+				.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR,
+				.src = host_blas,
+				.dst = compacted_blas,
+				.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR
+			};
+			VK_CHECK(vkCopyAccelerationStructureKHR(context.device, VK_NULL_HANDLE, &compact_info));
+
+			vkDestroyAccelerationStructureKHR(context.device, host_blas, nullptr);
+			VkUtils::DestroyMappedBuffer(context.allocator, host_buffer);
+			host_blas = compacted_blas;
+			host_buffer = compacted_buffer;
+		}
+
+		// Tracing from host memory would be slow, the BLAS is moved to the GPU in serialized form
+		size_t serialized_size;
+		VK_CHECK(vkWriteAccelerationStructuresPropertiesKHR(context.device, 1, &host_blas,
+			VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, sizeof(serialized_size),
+			&serialized_size, sizeof(serialized_size)));
+		serialized_BLASes[b].resize(serialized_size);
+
+		VkCopyAccelerationStructureToMemoryInfoKHR copy_info {
+			.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR,
+			.src = host_blas,
+			.dst = VkDeviceOrHostAddressKHR {
+				.hostAddress = serialized_BLASes[b].data()
 			},
-			.flags = VK_GEOMETRY_OPAQUE_BIT_KHR
-		});
+			.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR
+		};
+		VK_CHECK(vkCopyAccelerationStructureToMemoryKHR(context.device, VK_NULL_HANDLE, &copy_info));
 
-		acceleration_structure_build_range_infos.emplace_back(VkAccelerationStructureBuildRangeInfoKHR {
-			.primitiveCount = primitive.index_count / 3,
-			.primitiveOffset = primitive.index_offset * sizeof(uint32_t),
-			.firstVertex = primitive.vertex_offset,
-			.transformOffset = sizeof(VkTransformMatrixKHR) * transform_offset++
-		});
-		acceleration_structure_build_range_pinfos.emplace_back(&acceleration_structure_build_range_infos.back());
-		max_primitive_counts.emplace_back(primitive.index_count / 3);
+		vkDestroyAccelerationStructureKHR(context.device, host_blas, nullptr);
+		VkUtils::DestroyMappedBuffer(context.allocator, host_buffer);
 	}
-	UploadDataToGPUBuffer(transform_data_buffer, transform_data.data(), transform_data.size() * sizeof(VkTransformMatrixKHR));
-		
-	VkAccelerationStructureBuildGeometryInfoKHR acceleration_structure_build_geometry_info {
-		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
-		.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR,
-		.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
-		.geometryCount = static_cast<uint32_t>(acceleration_structure_geometries.size()),
-		.pGeometries = acceleration_structure_geometries.data()
-	};
+	return serialized_BLASes;
+}
 
-	VkAccelerationStructureBuildSizesInfoKHR acceleration_structure_build_sizes_info {
-		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
+void ResourceManager::BenchmarkBLASBuilds(Scene &scene, const std::vector<MeshGeometryData> &mesh_data) {
+	std::vector<uint32_t> blas_indices(blas_geometries.size());
+	std::iota(blas_indices.begin(), blas_indices.end(), 0);
+	auto destroy_BLASes = [this]() {
+		for(AccelerationStructure &blas : BLASes) {
+			VkUtils::DestroyAccelerationStructure(context.device, context.allocator, blas);
+			blas = AccelerationStructure {};
+		}
 	};
-	vkGetAccelerationStructureBuildSizesKHR(context.device,
-		VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR,
-		&acceleration_structure_build_geometry_info,
-		max_primitive_counts.data(),
-		&acceleration_structure_build_sizes_info
-	);
 
-	buffer_info = VkUtils::BufferCreateInfo(
-		acceleration_structure_build_sizes_info.accelerationStructureSize,
-		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR
-	);
-	global_BLAS.buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
-	buffer_info = VkUtils::BufferCreateInfo(
-		acceleration_structure_build_sizes_info.buildScratchSize,
-		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
-	);
-	global_BLAS.scratch = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
-	
-	VkAccelerationStructureCreateInfoKHR acceleration_structure_info {
-		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR,
-		.buffer = global_BLAS.buffer.handle,
-		.size = acceleration_structure_build_sizes_info.accelerationStructureSize,
-		.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR
+	auto start = std::chrono::high_resolution_clock::now();
+	BuildBLASes(scene, blas_indices);
+	double device_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	destroy_BLASes();
+
+	if(!context.gpu.supports_host_acceleration_structure_commands) {
+		printf("BLAS builds (%zu BLASes): device %.2f ms, host builds are not supported\n", blas_indices.size(), device_ms);
+		return;
+	}
+
+	start = std::chrono::high_resolution_clock::now();
+	std::vector<std::vector<uint8_t>> serialized_BLASes = HostBuildBLASes(scene, mesh_data, blas_indices);
+	double host_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	start = std::chrono::high_resolution_clock::now();
+	DeserializeBLASes(serialized_BLASes);
+	double upload_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	destroy_BLASes();
+
+	printf("BLAS builds (%zu BLASes): device %.2f ms, host %.2f ms on %d threads + %.2f ms upload\n",
+		blas_indices.size(), device_ms, host_ms, omp_get_max_threads(), upload_ms);
+}
+
+void ResourceManager::SaveBLASCache(const std::vector<uint32_t> &blas_indices, const std::vector<std::string> &cache_paths) {
+	uint32_t blas_count = static_cast<uint32_t>(blas_indices.size());
+	std::vector<VkAccelerationStructureKHR> blas_handles;
+	for(uint32_t b : blas_indices) {
+		blas_handles.push_back(BLASes[b].handle);
+	}
+
+	VkQueryPoolCreateInfo query_pool_info {
+		.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO,
+		.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR,
+		.queryCount = blas_count
 	};
-	VK_CHECK(vkCreateAccelerationStructureKHR(context.device, &acceleration_structure_info, nullptr,
-		&global_BLAS.handle));
+	VkQueryPool serialization_size_query_pool;
+	VK_CHECK(vkCreateQueryPool(context.device, &query_pool_info, nullptr, &serialization_size_query_pool));
+	ExecuteImmediateCommands([&](VkCommandBuffer command_buffer) {
+		vkCmdResetQueryPool(command_buffer, serialization_size_query_pool, 0, blas_count);
+		vkCmdWriteAccelerationStructuresPropertiesKHR(command_buffer, blas_count, blas_handles.data(),
+			VK_QUERY_TYPE_ACCELERATION_STRUCTURE_SERIALIZATION_SIZE_KHR, serialization_size_query_pool, 0);
+	});
 
-	acceleration_structure_build_geometry_info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-	acceleration_structure_build_geometry_info.dstAccelerationStructure = global_BLAS.handle;
-	acceleration_structure_build_geometry_info.scratchData = VkUtils::GetDeviceAddress(context.device, 
-		global_BLAS.scratch.handle);
+	std::vector<VkDeviceSize> serialized_sizes(blas_count);
+	VK_CHECK(vkGetQueryPoolResults(context.device, serialization_size_query_pool, 0, blas_count,
+		serialized_sizes.size() * sizeof(VkDeviceSize), serialized_sizes.data(), sizeof(VkDeviceSize),
+		VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+	vkDestroyQueryPool(context.device, serialization_size_query_pool, nullptr);
+
+	std::vector<VkDeviceSize> readback_offsets(blas_count);
+	VkDeviceSize readback_size = 0;
+	for(uint32_t i = 0; i < blas_count; ++i) {
+		readback_offsets[i] = readback_size;
+		readback_size += VkUtils::AlignUp(serialized_sizes[i], SERIALIZED_AS_ALIGNMENT);
+	}
 
-	VkUtils::ExecuteOneTimeCommands(context.device, context.graphics_queue, context.command_pool,
-		[&](VkCommandBuffer command_buffer) {
-			vkCmdBuildAccelerationStructuresKHR(command_buffer,
-				1,
-				&acceleration_structure_build_geometry_info,
-				acceleration_structure_build_range_pinfos.data()
-			);
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(readback_size + SERIALIZED_AS_ALIGNMENT,
+		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+	MappedBuffer readback_buffer = VkUtils::CreateMappedBuffer(context.allocator, buffer_info, 
+		VMA_MEMORY_USAGE_GPU_TO_CPU);
+	VkDeviceAddress readback_address = VkUtils::GetDeviceAddress(context.device, readback_buffer.handle).deviceAddress;
+	VkDeviceSize readback_base = VkUtils::AlignUp(readback_address, SERIALIZED_AS_ALIGNMENT) - readback_address;
+
+	ExecuteImmediateCommands([&](VkCommandBuffer command_buffer) {
+		for(uint32_t i = 0; i < blas_count; ++i) {
+			VkCopyAccelerationStructureToMemoryInfoKHR copy_info {
+				.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_TO_MEMORY_INFO_KHR,
+				.src = blas_handles[i],
+				.dst = VkDeviceOrHostAddressKHR {
+					.deviceAddress = readback_address + readback_base + readback_offsets[i]
+				},
+				.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_SERIALIZE_KHR
+			};
+			vkCmdCopyAccelerationStructureToMemoryKHR(command_buffer, &copy_info);
 		}
-	);
 
-	VkUtils::DestroyGPUBuffer(context.allocator, transform_data_buffer);
+		// Serialization writes count as transfer writes of the build stage, make them visible to the host
+		VkMemoryBarrier memory_barrier {
+			.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+			.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+			.dstAccessMask = VK_ACCESS_HOST_READ_BIT
+		};
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR |
+			VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+	});
+	vmaInvalidateAllocation(context.allocator, readback_buffer.allocation, 0, VK_WHOLE_SIZE);
+
+	std::filesystem::create_directories(BLAS_CACHE_DIRECTORY);
+	for(uint32_t i = 0; i < blas_count; ++i) {
+		WriteSerializedBLAS(cache_paths[blas_indices[i]].c_str(), 
+			static_cast<uint8_t *>(readback_buffer.mapped_data) + readback_base + readback_offsets[i], serialized_sizes[i]);
+	}
+
+	VkUtils::DestroyMappedBuffer(context.allocator, readback_buffer);
 }
 
-void ResourceManager::UpdateTLAS(std::vector<Primitive> &primitives) {
-	VkAccelerationStructureInstanceKHR acceleration_structure_instance {
-		.transform = VkTransformMatrixKHR {
-			.matrix = {
-				1.0f, 0.0f, 0.0f, 0.0f,
-				0.0f, 1.0f, 0.0f, 0.0f,
-				0.0f, 0.0f, 1.0f, 0.0f
-			}
-		},
-		.instanceCustomIndex = 0,
-		.mask = 0xFF,
-		.instanceShaderBindingTableRecordOffset = 0,
-		.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
-		.accelerationStructureReference = VkUtils::GetAccelerationStructureAddress(
-			context.device, global_BLAS.handle).deviceAddress
-	};
+void ResourceManager::UpdateTLAS(Scene &scene) {
+	// Rebuilt from scratch when meshes are freed or their primitive records move
+	if(global_TLAS.handle != VK_NULL_HANDLE) {
+		VkUtils::DestroyAccelerationStructure(context.device, context.allocator, global_TLAS);
+		global_TLAS = AccelerationStructure {};
+		for(MappedBuffer &instance_buffer : tlas_instance_buffers) {
+			VkUtils::DestroyMappedBuffer(context.allocator, instance_buffer);
+		}
+		tlas_refits_since_build = 0;
+	}
 
-	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(sizeof(VkAccelerationStructureInstanceKHR),
+	tlas_instance_count = 0;
+	for(BLASGeometry &blas_geometry : blas_geometries) {
+		tlas_instance_count += static_cast<uint32_t>(scene.meshes[blas_geometry.mesh_idx].instance_transforms.size());
+	}
+
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(
+		sizeof(VkAccelerationStructureInstanceKHR) * std::max(tlas_instance_count, 1u),
 		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
-		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
-	GPUBuffer instances_buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
-	UploadDataToGPUBuffer(instances_buffer, &acceleration_structure_instance,
-		sizeof(VkAccelerationStructureInstanceKHR));
+		VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT);
+	for(MappedBuffer &instance_buffer : tlas_instance_buffers) {
+		instance_buffer = VkUtils::CreateMappedBuffer(context.allocator, buffer_info);
+		WriteTLASInstances(scene, static_cast<VkAccelerationStructureInstanceKHR *>(instance_buffer.mapped_data));
+	}
 
 	VkAccelerationStructureGeometryKHR acceleration_structure_geometry {
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
@@ -730,8 +2038,7 @@ void ResourceManager::UpdateTLAS(std::vector<Primitive> &primitives) {
 		.geometry = VkAccelerationStructureGeometryDataKHR {
 			.instances = VkAccelerationStructureGeometryInstancesDataKHR {
 				.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
-				.arrayOfPointers = VK_FALSE,
-				.data = VkUtils::GetDeviceAddressConst(context.device, instances_buffer.handle)
+				.arrayOfPointers = VK_FALSE
 			}
 		},
 		.flags = VK_GEOMETRY_OPAQUE_BIT_KHR
@@ -740,26 +2047,28 @@ void ResourceManager::UpdateTLAS(std::vector<Primitive> &primitives) {
 	VkAccelerationStructureBuildGeometryInfoKHR acceleration_structure_build_geometry_info {
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
 		.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
-		.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR,
+		.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | 
+			VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
 		.geometryCount = 1,
 		.pGeometries = &acceleration_structure_geometry
 	};
 
-	uint32_t max_primitive_counts = static_cast<uint32_t>(primitives.size());
 	VkAccelerationStructureBuildSizesInfoKHR acceleration_structure_build_sizes_info {
 		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_SIZES_INFO_KHR,
 	};
 	vkGetAccelerationStructureBuildSizesKHR(context.device,
 		VK_ACCELERATION_STRUCTURE_BUILD_TYPE_DEVICE_KHR, &acceleration_structure_build_geometry_info,
-		&max_primitive_counts, &acceleration_structure_build_sizes_info);
+		&tlas_instance_count, &acceleration_structure_build_sizes_info);
 
 	buffer_info = VkUtils::BufferCreateInfo(
 		acceleration_structure_build_sizes_info.accelerationStructureSize,
 		VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR
 	);
 	global_TLAS.buffer = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
+	// The scratch buffer is kept around for refits and periodic rebuilds
 	buffer_info = VkUtils::BufferCreateInfo(
-		acceleration_structure_build_sizes_info.buildScratchSize,
+		std::max(acceleration_structure_build_sizes_info.buildScratchSize, 
+			acceleration_structure_build_sizes_info.updateScratchSize),
 		VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT
 	);
 	global_TLAS.scratch = VkUtils::CreateGPUBuffer(context.allocator, buffer_info);
@@ -772,14 +2081,73 @@ void ResourceManager::UpdateTLAS(std::vector<Primitive> &primitives) {
 	};
 	VK_CHECK(vkCreateAccelerationStructureKHR(context.device, &acceleration_structure_info, nullptr,
 		&global_TLAS.handle));
+	global_TLAS.address = VkUtils::GetAccelerationStructureAddress(context.device, global_TLAS.handle).deviceAddress;
+	global_TLAS.size = acceleration_structure_build_sizes_info.accelerationStructureSize;
+	if(LOG_STATISTICS) {
+		printf("TLAS memory: %.2f MB, %.2f MB scratch kept for refits (%u instances)\n",
+			global_TLAS.size / (1024.0 * 1024.0), buffer_info.size / (1024.0 * 1024.0), tlas_instance_count);
+	}
+
+	ExecuteImmediateCommands([&](VkCommandBuffer command_buffer) {
+		RecordTLASBuild(command_buffer, 0, false);
+	});
+}
+
+void ResourceManager::WriteTLASInstances(Scene &scene, VkAccelerationStructureInstanceKHR *instances) {
+	uint32_t instance_idx = 0;
+	for(uint32_t b = 0; b < blas_geometries.size(); ++b) {
+		BLASGeometry &blas_geometry = blas_geometries[b];
+		Mesh &mesh = scene.meshes[blas_geometry.mesh_idx];
+		uint32_t primitive_idx = mesh.first_primitive + blas_geometry.first_primitive;
+		for(glm::mat4 &transform : mesh.instance_transforms) {
+			// The hit shaders find the primitive record at instanceCustomIndex + geometry index
+			assert(primitive_idx < (1u << 24) && "Primitive index doesn't fit in instanceCustomIndex");
+			glm::mat4 rows = glm::transpose(transform);
+			VkAccelerationStructureInstanceKHR &instance = instances[instance_idx++];
+			// Alpha tested instances use the hit groups with the any-hit shader, and can be skipped
+			// through the cull mask by rays that don't need alpha testing
+			instance = VkAccelerationStructureInstanceKHR {
+				.instanceCustomIndex = primitive_idx,
+				.mask = blas_geometry.alpha_tested ? INSTANCE_MASK_ALPHA_TESTED : INSTANCE_MASK_OPAQUE,
+				.instanceShaderBindingTableRecordOffset = blas_geometry.alpha_tested ? HIT_GROUP_ALPHA_TESTED : HIT_GROUP_OPAQUE,
+				.flags = VK_GEOMETRY_INSTANCE_TRIANGLE_FACING_CULL_DISABLE_BIT_KHR,
+				.accelerationStructureReference = BLASes[b].address
+			};
+			memcpy(&instance.transform, glm::value_ptr(rows), sizeof(VkTransformMatrixKHR));
+			primitive_idx += static_cast<uint32_t>(mesh.primitives.size());
+		}
+	}
+}
+
+void ResourceManager::RecordTLASBuild(VkCommandBuffer command_buffer, uint32_t resource_idx, bool update) {
+	VkAccelerationStructureGeometryKHR acceleration_structure_geometry {
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_KHR,
+		.geometryType = VK_GEOMETRY_TYPE_INSTANCES_KHR,
+		.geometry = VkAccelerationStructureGeometryDataKHR {
+			.instances = VkAccelerationStructureGeometryInstancesDataKHR {
+				.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_GEOMETRY_INSTANCES_DATA_KHR,
+				.arrayOfPointers = VK_FALSE,
+				.data = VkUtils::GetDeviceAddressConst(context.device, tlas_instance_buffers[resource_idx].handle)
+			}
+		},
+		.flags = VK_GEOMETRY_OPAQUE_BIT_KHR
+	};
 
-	acceleration_structure_build_geometry_info.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-	acceleration_structure_build_geometry_info.dstAccelerationStructure = global_TLAS.handle;
-	acceleration_structure_build_geometry_info.scratchData = VkUtils::GetDeviceAddress(context.device,
-		global_TLAS.scratch.handle);
+	VkAccelerationStructureBuildGeometryInfoKHR acceleration_structure_build_geometry_info {
+		.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR,
+		.type = VK_ACCELERATION_STRUCTURE_TYPE_TOP_LEVEL_KHR,
+		.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR | 
+			VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_UPDATE_BIT_KHR,
+		.mode = update ? VK_BUILD_ACCELERATION_STRUCTURE_MODE_UPDATE_KHR : VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR,
+		.srcAccelerationStructure = update ? global_TLAS.handle : VK_NULL_HANDLE,
+		.dstAccelerationStructure = global_TLAS.handle,
+		.geometryCount = 1,
+		.pGeometries = &acceleration_structure_geometry,
+		.scratchData = VkUtils::GetDeviceAddress(context.device, global_TLAS.scratch.handle)
+	};
 
 	VkAccelerationStructureBuildRangeInfoKHR acceleration_structure_build_range_info {
-		.primitiveCount = 1,
+		.primitiveCount = tlas_instance_count,
 		.primitiveOffset = 0,
 		.firstVertex = 0,
 		.transformOffset = 0
@@ -787,94 +2155,234 @@ void ResourceManager::UpdateTLAS(std::vector<Primitive> &primitives) {
 
 	VkAccelerationStructureBuildRangeInfoKHR *acceleration_structure_build_range_pinfo =
 		&acceleration_structure_build_range_info;
-	VkUtils::ExecuteOneTimeCommands(context.device, context.graphics_queue, context.command_pool,
-		[&](VkCommandBuffer command_buffer) {
-			vkCmdBuildAccelerationStructuresKHR(command_buffer,
-				1,
-				&acceleration_structure_build_geometry_info,
-				&acceleration_structure_build_range_pinfo
-			);
-		}
+	vkCmdBuildAccelerationStructuresKHR(command_buffer,
+		1,
+		&acceleration_structure_build_geometry_info,
+		&acceleration_structure_build_range_pinfo
 	);
+	tlas_refits_since_build = update ? tlas_refits_since_build + 1 : 0;
+}
 
-	VkUtils::DestroyGPUBuffer(context.allocator, instances_buffer);
+void ResourceManager::SetMeshInstanceTransform(uint32_t mesh_idx, uint32_t instance_idx, const glm::mat4 &transform) {
+	scene.meshes[mesh_idx].instance_transforms[instance_idx] = transform;
+	moved_mesh_instances.emplace_back(mesh_idx, instance_idx);
+	frustum_culler.UpdateInstance(scene, mesh_idx, instance_idx);
 }
 
-void ResourceManager::UploadDataToGPUBuffer(GPUBuffer buffer, void *data, VkDeviceSize size) {
-	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(size, 
-		VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
-	MappedBuffer staging_buffer = VkUtils::CreateMappedBuffer(context.allocator, buffer_info);
-	memcpy(staging_buffer.mapped_data, data, size);
+void ResourceManager::UpdateSceneTransforms(VkCommandBuffer command_buffer, uint32_t resource_idx) {
+	if(moved_mesh_instances.empty()) {
+		return;
+	}
 
-	VkUtils::ExecuteOneTimeCommands(context.device, context.graphics_queue, context.command_pool,
-		[=](VkCommandBuffer command_buffer) {
-			VkBufferCopy buffer_copy {
-				.size = size
-			};
-			vkCmdCopyBuffer(command_buffer, staging_buffer.handle, buffer.handle, 1, &buffer_copy);
-		}
-	);
+	// Previous frames may still be reading the transforms and the TLAS
+	VkMemoryBarrier memory_barrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR
+	};
+	VkPipelineStageFlags shader_stages = VK_PIPELINE_STAGE_VERTEX_SHADER_BIT | VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT |
+		VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR;
+	VkPipelineStageFlags update_stages = VK_PIPELINE_STAGE_TRANSFER_BIT | 
+		VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR;
+	vkCmdPipelineBarrier(command_buffer, shader_stages, update_stages, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+
+	// All primitive records of an instance share its transform
+	for(glm::uvec2 &mesh_instance : moved_mesh_instances) {
+		Mesh &mesh = scene.meshes[mesh_instance.x];
+		vkCmdUpdateBuffer(command_buffer, global_transform_buffer.buffer.handle,
+			(mesh.first_transform + mesh_instance.y) * sizeof(glm::mat4), sizeof(glm::mat4),
+			&mesh.instance_transforms[mesh_instance.y]);
+	}
+	moved_mesh_instances.clear();
 
-	VkUtils::DestroyMappedBuffer(context.allocator, staging_buffer);
+	// Refitting keeps the topology of the TLAS, rebuild it every now and then to restore trace performance
+	WriteTLASInstances(scene, static_cast<VkAccelerationStructureInstanceKHR *>(tlas_instance_buffers[resource_idx].mapped_data));
+	RecordTLASBuild(command_buffer, resource_idx, tlas_refits_since_build < MAX_TLAS_REFITS_BEFORE_REBUILD);
+
+	memory_barrier = VkMemoryBarrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR,
+		.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR
+	};
+	vkCmdPipelineBarrier(command_buffer, update_stages, shader_stages, 0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
 }
 
-uint32_t ResourceManager::UploadTexture(Image texture, VkSampler sampler) {
-	for(uint32_t i = 0; i < MAX_GLOBAL_RESOURCES; ++i) {
-		if(textures[i].handle == VK_NULL_HANDLE) {
-			textures[i] = texture;
-
-			VkDescriptorImageInfo descriptor {
-				.sampler = sampler,
-				.imageView = texture.view,
-				.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
-			};
+void ResourceManager::UploadDataToGPUBuffer(GPUBuffer buffer, const void *data, VkDeviceSize size,
+	const std::vector<VkBufferCopy> &regions) {
+	if(regions.empty()) {
+		return;
+	}
+	StagingAllocation staging = upload_context.Stage(data, size);
 
-			VkWriteDescriptorSet write_descriptor_set {
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.dstSet = global_descriptor_set0,
-				.dstBinding = 4,
-				.dstArrayElement = i,
-				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
-				.pImageInfo = &descriptor
-			};
+	std::vector<VkBufferCopy> staged_regions(regions);
+	for(VkBufferCopy &region : staged_regions) {
+		region.srcOffset += staging.offset;
+	}
+	vkCmdCopyBuffer(upload_context.GetCommandBuffer(), staging.buffer, buffer.handle, 
+		static_cast<uint32_t>(staged_regions.size()), staged_regions.data());
+}
+
+void ResourceManager::FlushUploads() {
+	upload_context.Submit();
+}
+
+void ResourceManager::StreamTexture(TextureUploadRequest &request) {
+	VkFormatProperties format_properties;
+	vkGetPhysicalDeviceFormatProperties(context.gpu.handle, request.format, &format_properties);
+	if(!(format_properties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT) || request.mip_levels == 0 ||
+		request.mip_levels > VkUtils::MipLevelCount(request.width, request.height)) {
+		assert(false && "Streamed texture can't be sampled or has too many mip levels");
+		*request.texture_idx = INVALID_BINDLESS_HANDLE;
+		return;
+	}
 
-			vkUpdateDescriptorSets(context.device, 1, &write_descriptor_set, 0, nullptr);
-			return i;
+	Image texture {
+		.width = request.width,
+		.height = request.height,
+		.format = request.format,
+		.usage = VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT
+	};
+	VkImageCreateInfo image_info = VkUtils::ImageCreateInfo2D(request.width, request.height, request.format,
+		texture.usage, VK_SAMPLE_COUNT_1_BIT, request.mip_levels);
+	VmaAllocationCreateInfo image_alloc_info {
+		.usage = VMA_MEMORY_USAGE_GPU_ONLY
+	};
+	vmaCreateImage(context.allocator, &image_info, &image_alloc_info,
+		&texture.handle, &texture.allocation, nullptr);
+
+	// Copy offsets have to be a multiple of the texel or block size, 16 covers every format we upload
+	VkDeviceSize size = VkUtils::ImageDataSize(request.format, request.width, request.height, request.mip_levels);
+	StagingAllocation staging = streaming_context.Stage(request.data, size, 16);
+	VkCommandBuffer command_buffer = streaming_context.GetCommandBuffer();
+
+	VkUtils::InsertImageBarrier(command_buffer, texture.handle, VK_IMAGE_ASPECT_COLOR_BIT,
+		VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		0, VK_ACCESS_TRANSFER_WRITE_BIT, 0, request.mip_levels);
+	std::vector<VkBufferImageCopy> buffer_image_copies(request.mip_levels);
+	VkDeviceSize level_offset = staging.offset;
+	for(uint32_t level = 0; level < request.mip_levels; ++level) {
+		uint32_t level_width = std::max(request.width >> level, 1u);
+		uint32_t level_height = std::max(request.height >> level, 1u);
+		buffer_image_copies[level] = VkUtils::BufferImageCopy2D(level_width, level_height);
+		buffer_image_copies[level].bufferOffset = level_offset;
+		buffer_image_copies[level].imageSubresource.mipLevel = level;
+		level_offset += VkUtils::ImageLevelSize(request.format, level_width, level_height);
+	}
+	vkCmdCopyBufferToImage(command_buffer, staging.buffer, texture.handle,
+		VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, static_cast<uint32_t>(buffer_image_copies.size()),
+		buffer_image_copies.data());
+
+	// The release half of the ownership transfer also performs the layout transition,
+	// the graphics queue repeats both in the acquire
+	VkImageMemoryBarrier image_barrier {
+		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = 0,
+		.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		.srcQueueFamilyIndex = streaming_ownership_transfer ? context.gpu.transfer_family_idx : VK_QUEUE_FAMILY_IGNORED,
+		.dstQueueFamilyIndex = streaming_ownership_transfer ? context.gpu.graphics_family_idx : VK_QUEUE_FAMILY_IGNORED,
+		.image = texture.handle,
+		.subresourceRange = VkImageSubresourceRange {
+			.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT,
+			.levelCount = request.mip_levels,
+			.layerCount = 1
 		}
+	};
+	if(!streaming_ownership_transfer) {
+		image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	}
+	vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+		streaming_ownership_transfer ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0, 0, nullptr, 0, nullptr, 1, &image_barrier);
+	if(streaming_ownership_transfer) {
+		image_barrier.srcAccessMask = 0;
+		image_barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		pending_streaming_acquires.emplace_back(PendingStreamingAcquire {
+			.timeline_value = streaming_context.GetRecordingValue(),
+			.barrier = image_barrier
+		});
 	}
 
-	assert(false && "No free texture slots left!");
-	return static_cast<uint32_t>(-1);
-}
+	VkImageViewCreateInfo image_view_info = VkUtils::ImageViewCreateInfo2D(texture.handle, request.format,
+		request.mip_levels);
+	image_view_info.components = request.components;
+	VK_CHECK(vkCreateImageView(context.device, &image_view_info, nullptr, &texture.view));
 
-uint32_t ResourceManager::UploadStorageImage(Image image) {
-	for(uint32_t i = 0; i < MAX_GLOBAL_RESOURCES; ++i) {
-		if(storage_images[i].handle == VK_NULL_HANDLE) {
-			storage_images[i] = image;
+	VkSampler texture_sampler = request.sampler_info ? GetSampler(&request.sampler_info.value()) : default_sampler;
+	*request.texture_idx = UploadTexture(texture, texture_sampler);
+	if(request.name) {
+		TagImage(*request.texture_idx, request.name);
+	}
+}
 
-			VkDescriptorImageInfo descriptor {
-				.imageView = image.view,
-				.imageLayout = VK_IMAGE_LAYOUT_GENERAL
-			};
+void ResourceManager::RecordStreamingAcquires(VkCommandBuffer command_buffer) {
+	streaming_context.Submit();
 
-			VkWriteDescriptorSet write_descriptor_set {
-				.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET,
-				.dstSet = global_descriptor_set1,
-				.dstBinding = 0,
-				.dstArrayElement = i,
-				.descriptorCount = 1,
-				.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
-				.pImageInfo = &descriptor
-			};
+	// Only finished uploads are acquired, so waiting for them never holds back the frame
+	uint64_t completed_value = streaming_context.GetCompletedValue();
+	std::vector<VkImageMemoryBarrier> image_barriers;
+	while(!pending_streaming_acquires.empty() &&
+		pending_streaming_acquires.front().timeline_value <= completed_value) {
+		image_barriers.push_back(pending_streaming_acquires.front().barrier);
+		pending_streaming_acquires.pop_front();
+	}
+	if(!image_barriers.empty()) {
+		vkCmdPipelineBarrier(command_buffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 0, nullptr, 0, nullptr, static_cast<uint32_t>(image_barriers.size()), image_barriers.data());
+	}
+	streaming_acquired_value = completed_value;
+}
 
-			vkUpdateDescriptorSets(context.device, 1, &write_descriptor_set, 0, nullptr);
-			return i;
+uint32_t ResourceManager::UploadTexture(Image texture, VkSampler sampler) {
+	std::scoped_lock lock(bindless_mutex);
+	uint32_t handle = texture_slots.Allocate();
+	if(handle == INVALID_BINDLESS_HANDLE) {
+		assert(false && "No free texture slots left!");
+		return INVALID_BINDLESS_HANDLE;
+	}
+	uint32_t slot = GetBindlessIndex(handle);
+	textures[slot] = texture;
+
+	QueueDescriptorWrite(global_descriptor_set0, GLOBAL_TEXTURES_BINDING, slot, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+		VkDescriptorImageInfo {
+			.sampler = sampler,
+			.imageView = texture.view,
+			.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
 		}
+	);
+	return handle;
+}
+
+uint32_t ResourceManager::UploadStorageImage(Image image) {
+	std::scoped_lock lock(bindless_mutex);
+	uint32_t handle = storage_image_slots.Allocate();
+	if(handle == INVALID_BINDLESS_HANDLE) {
+		assert(false && "No free storage image slots left!");
+		return INVALID_BINDLESS_HANDLE;
 	}
+	uint32_t slot = GetBindlessIndex(handle);
+	storage_images[slot] = image;
+
+	QueueDescriptorWrite(global_descriptor_set1, 0, slot, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE,
+		VkDescriptorImageInfo {
+			.imageView = image.view,
+			.imageLayout = VK_IMAGE_LAYOUT_GENERAL
+		}
+	);
+	return handle;
+}
 
-	assert(false && "No free storage image slots left!");
-	return static_cast<uint32_t>(-1);
+void ResourceManager::QueueDescriptorWrite(VkDescriptorSet set, uint32_t binding, uint32_t slot, VkDescriptorType type,
+	VkDescriptorImageInfo image_info) {
+	pending_descriptor_writes.push_back(PendingDescriptorWrite {
+		.set = set,
+		.binding = binding,
+		.slot = slot,
+		.type = type,
+		.image_info = image_info
+	});
 }
 
 VkSampler ResourceManager::GetSampler(SamplerInfo *sampler_info) {
@@ -883,7 +2391,8 @@ VkSampler ResourceManager::GetSampler(SamplerInfo *sampler_info) {
 		if(sampler.info.mag_filter == sampler_info->mag_filter &&
 			sampler.info.min_filter == sampler_info->min_filter &&
 			sampler.info.address_mode_u == sampler_info->address_mode_u &&
-			sampler.info.address_mode_v == sampler_info->address_mode_v) {
+			sampler.info.address_mode_v == sampler_info->address_mode_v &&
+			sampler.info.mipmap_mode == sampler_info->mipmap_mode) {
 			return sampler.handle;
 		}
 	}
@@ -894,11 +2403,13 @@ VkSampler ResourceManager::GetSampler(SamplerInfo *sampler_info) {
 		.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO,
 		.magFilter = sampler_info->mag_filter,
 		.minFilter = sampler_info->min_filter,
+		.mipmapMode = sampler_info->mipmap_mode,
 		.addressModeU = sampler_info->address_mode_u,
 		.addressModeV = sampler_info->address_mode_v,
 		.addressModeW = sampler_info->address_mode_v,
 		.anisotropyEnable = VK_TRUE,
 		.maxAnisotropy = context.gpu.properties.properties.limits.maxSamplerAnisotropy,
+		.maxLod = VK_LOD_CLAMP_NONE,
 		.borderColor = VK_BORDER_COLOR_INT_OPAQUE_BLACK
 	};
 	vkCreateSampler(context.device, &vk_sampler_info, nullptr, &sampler);
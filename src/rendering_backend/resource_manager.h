@@ -1,16 +1,81 @@
 #pragma once
+#include "rendering_backend/bindless_slot_allocator.h"
+#include "rendering_backend/frustum_culler.h"
+#include "rendering_backend/gpu_culling.h"
+#include "rendering_backend/offset_allocator.h"
+#include "rendering_backend/upload_context.h"
 
 // The global descriptor set (set = 0) is laid out as follows
 // Layout(set = 0, binding = 0) global_vertex_buffer
 // Layout(set = 0, binding = 1) global_index_buffer
 // Layout(set = 0, binding = 2) global_obj_data_buffer
 // Layout(set = 0, binding = 3) global_tlas
-// Layout(set = 0, binding = 4) textures
+// Layout(set = 0, binding = 4) global_transform_buffer
+// Layout(set = 0, binding = 5) global_material_buffer
+// Layout(set = 0, binding = 6) textures
 
 // The second global descriptor set (set = 1) is laid out as follows
 // Layout(set = 1, binding = 0) storage_images
 
-inline constexpr uint32_t MAX_GLOBAL_RESOURCES = 2048;
+// Textures and storage images are referred to by bindless handles, see bindless_slot_allocator.h.
+// Shaders only ever see the slot index of a handle, GetBindlessIndex.
+
+// A decoded texture handed to the texture uploader. The uploader takes ownership of data
+// (allocated with malloc) and writes the bindless handle of the texture to texture_idx.
+// data holds mip_levels tightly packed levels, if that is a single uncompressed level
+// the rest of the mip chain is generated on the GPU.
+struct TextureUploadRequest {
+	uint32_t width;
+	uint32_t height;
+	uint8_t *data;
+	VkFormat format;
+	std::optional<SamplerInfo> sampler_info;
+	const char *name;
+	uint32_t *texture_idx;
+	uint32_t mip_levels = 1;
+	VkComponentMapping components {};
+};
+
+// A device buffer suballocated per mesh, in elements of element_size. It grows with a GPU copy
+// when an allocation doesn't fit, and shrinks to its contents when it is defragmented.
+struct GeometryBuffer {
+	GPUBuffer buffer {};
+	OffsetAllocator allocator;
+	VkDeviceSize element_size;
+	VkBufferUsageFlags usage;
+	// Binding in the global descriptor set
+	uint32_t binding;
+	const char *name;
+};
+
+// Where the vertices, indices, primitive records and instance transforms of a mesh live in the geometry buffers, in elements
+struct MeshAllocation {
+	uint64_t vertex_offset = OffsetAllocator::INVALID_OFFSET;
+	uint64_t index_offset = OffsetAllocator::INVALID_OFFSET;
+	uint64_t primitive_offset = OffsetAllocator::INVALID_OFFSET;
+	uint64_t transform_offset = OffsetAllocator::INVALID_OFFSET;
+};
+
+// The CPU copy of the geometry of a mesh while it is loaded, laid out like its allocations
+struct MeshGeometryData {
+	const Vertex *vertices;
+	const uint16_t *indices;
+};
+
+// An upload finished on the transfer queue, waiting for the graphics queue to take ownership
+struct PendingStreamingAcquire {
+	uint64_t timeline_value;
+	VkImageMemoryBarrier barrier;
+};
+
+// A BLAS holds either the opaque or the alpha tested primitives of a mesh. The primitives of
+// every mesh are sorted opaque first, so both groups are contiguous.
+struct BLASGeometry {
+	uint32_t mesh_idx;
+	uint32_t first_primitive;
+	uint32_t primitive_count;
+	bool alpha_tested;
+};
 
 class VulkanContext;
 class ResourceManager {
@@ -24,29 +89,79 @@ public:
 		VkImageLayout initial_layout, VkSampleCountFlagBits sample_count = VK_SAMPLE_COUNT_1_BIT);
 
 	uint32_t UploadTextureFromData(uint32_t width, uint32_t height, uint8_t *data, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, SamplerInfo *sampler_info = nullptr);
+	// Between Begin and End, textures can be enqueued from any thread. A single uploader thread
+	// stages and records them into the upload context, which the calling thread must not use meanwhile.
+	void BeginTextureUploads();
+	void EnqueueTextureUpload(TextureUploadRequest request);
+	void EndTextureUploads();
+
 	uint32_t UploadEmptyTexture(uint32_t width, uint32_t height, VkFormat format = VK_FORMAT_R8G8B8A8_UNORM, SamplerInfo *sampler_info = nullptr);
 	uint32_t UploadNewStorageImage(uint32_t width, uint32_t height, VkFormat format);
-	void DestroyStorageImage(uint32_t id);
+	// The image and its slot are released once the frames in flight are done with them
+	void DestroyTexture(uint32_t handle);
+	void DestroyStorageImage(uint32_t handle);
+	// Releases the images destroyed while this frame resource was last recorded, its fence must have signaled
+	void ReleaseDestroyedImages(uint32_t resource_idx);
+	// Assert that the handle hasn't been destroyed
+	Image &GetTexture(uint32_t handle);
+	Image &GetStorageImage(uint32_t handle);
+
+	// The bindless descriptors written since the last call are batched into a single update. They are
+	// update after bind, so this only has to happen before submitting the frame that uses them.
+	void FlushDescriptorWrites();
+
+	// Uploads and image initializations are batched and only submitted when a batch fills up,
+	// this has to be called before submitting anything that uses them
+	void FlushUploads();
+
+	// Submits the streaming uploads recorded since the last frame and records the queue ownership
+	// acquires of those that finished. The frame has to wait for GetStreamingWaitValue.
+	void RecordStreamingAcquires(VkCommandBuffer command_buffer);
+	VkSemaphore GetStreamingSemaphore() const { return streaming_context.GetTimelineSemaphore(); }
+	uint64_t GetStreamingWaitValue() const { return streaming_acquired_value; }
 
 	void TagImage(Image &image, const char *name);
 	void TagImage(uint32_t image_idx, const char *name);
 
-	void UpdateGeometry(std::vector<Vertex> &vertices, std::vector<uint32_t> &indices, Scene &scene);
+	// indices holds the 16 and 32-bit index ranges of all primitives, addressed in 16-bit units.
+	// Every mesh gets its own allocations, the primitives are rebased onto them.
+	void UpdateGeometry(std::vector<Vertex> &vertices, std::vector<uint16_t> &indices, Scene &scene);
+	// Releases the geometry, primitive records and BLASes of a mesh, which stays in the scene without primitives
+	void FreeMeshGeometry(uint32_t mesh_idx);
+	// Packs the geometry buffers with GPU copies and shrinks them to their contents
+	void DefragmentGeometry();
+	void PrintGeometryStatistics();
+	// Moves a mesh instance. The TLAS and the primitive transforms follow with the next UpdateSceneTransforms.
+	void SetMeshInstanceTransform(uint32_t mesh_idx, uint32_t instance_idx, const glm::mat4 &transform);
+	// Records the TLAS refit for moved instances, must precede every pass of the frame
+	void UpdateSceneTransforms(VkCommandBuffer command_buffer, uint32_t resource_idx);
 	void UpdatePerFrameUBO(uint32_t resource_idx, PerFrameData &per_frame_data);
 
-	GPUBuffer global_vertex_buffer;
-	GPUBuffer global_index_buffer;
-	GPUBuffer global_obj_data_buffer;
+	GeometryBuffer global_vertex_buffer;
+	GeometryBuffer global_index_buffer;
+	GeometryBuffer global_obj_data_buffer;
+	GeometryBuffer global_transform_buffer;
+	// Holds scene.materials in a single allocation, they are indexed from the primitive records as is
+	GeometryBuffer global_material_buffer;
+	std::vector<MeshAllocation> mesh_allocations;
+	// Culls the primitive records for the rasterized passes, see RecordCulling
+	GPUCulling gpu_culling;
+	// Culls the primitive records on the CPU, for the draw loops recorded per primitive
+	FrustumCuller frustum_culler;
 
-	AccelerationStructure global_BLAS;
+	// Up to two BLASes per unique mesh, opaque and alpha tested. The TLAS holds an instance
+	// of both for every node referencing the mesh.
+	std::vector<AccelerationStructure> BLASes;
+	std::vector<BLASGeometry> blas_geometries;
 	AccelerationStructure global_TLAS;
 
-	std::array<Image, MAX_GLOBAL_RESOURCES> textures;
+	// Indexed by slot, sized to the capacity of the descriptor array
+	std::vector<Image> textures;
 	VkDescriptorPool global_descriptor_pool0 = VK_NULL_HANDLE;
 	VkDescriptorSetLayout global_descriptor_set_layout0 = VK_NULL_HANDLE;
 	VkDescriptorSet global_descriptor_set0 = VK_NULL_HANDLE;
 
-	std::array<Image, MAX_GLOBAL_RESOURCES> storage_images;
+	std::vector<Image> storage_images;
 	VkDescriptorPool global_descriptor_pool1 = VK_NULL_HANDLE;
 	VkDescriptorSetLayout global_descriptor_set_layout1 = VK_NULL_HANDLE;
 	VkDescriptorSet global_descriptor_set1 = VK_NULL_HANDLE;
@@ -67,13 +182,90 @@ private:
 	void CreateGlobalDescriptorSet1();
 	void CreatePerFrameDescriptorSet();
 	void CreatePerFrameUBOs();
-	void UpdateBLAS(uint32_t vertex_count, std::vector<Primitive> &primitives);
-	void UpdateTLAS(std::vector<Primitive> &primitives);
-	void UploadDataToGPUBuffer(GPUBuffer buffer, void *data, VkDeviceSize size);
+	void UpdateBLAS(Scene &scene, const std::vector<MeshGeometryData> &mesh_data);
+	void BuildBLASes(Scene &scene, const std::vector<uint32_t> &blas_indices);
+	void CompactBLASes(VkQueryPool compacted_size_query_pool, const std::vector<uint32_t> &blas_indices);
+	// Deserializes every compatible cache entry and returns the BLASes that still have to be built
+	std::vector<uint32_t> LoadCachedBLASes(const std::vector<std::string> &cache_paths);
+	// serialized_BLASes is indexed by BLAS, BLASes without data are skipped
+	void DeserializeBLASes(std::vector<std::vector<uint8_t>> &serialized_BLASes);
+	void SaveBLASCache(const std::vector<uint32_t> &blas_indices, const std::vector<std::string> &cache_paths);
+	// Returns the serialized BLASes indexed by BLAS
+	std::vector<std::vector<uint8_t>> HostBuildBLASes(Scene &scene, const std::vector<MeshGeometryData> &mesh_data,
+		const std::vector<uint32_t> &blas_indices);
+	void BenchmarkBLASBuilds(Scene &scene, const std::vector<MeshGeometryData> &mesh_data);
+	void UpdateTLAS(Scene &scene);
+	void WriteTLASInstances(Scene &scene, VkAccelerationStructureInstanceKHR *instances);
+	void RecordTLASBuild(VkCommandBuffer command_buffer, uint32_t resource_idx, bool update);
+	// Runs the commands after all pending uploads and waits for them
+	template<typename T>
+	void ExecuteImmediateCommands(T commands);
+	// Stages size bytes of data and records copies of the regions, their source offsets are relative to data
+	void UploadDataToGPUBuffer(GPUBuffer buffer, const void *data, VkDeviceSize size, const std::vector<VkBufferCopy> &regions);
+	void CreateGeometryBuffer(GeometryBuffer &geometry_buffer, const char *name, VkDeviceSize element_size,
+		VkBufferUsageFlags usage, uint32_t binding);
+	// Moves the contents to a new buffer of capacity elements, relocations say what goes where
+	void ResizeGeometryBuffer(GeometryBuffer &geometry_buffer, uint64_t capacity,
+		const std::vector<OffsetAllocator::Relocation> &relocations);
+	uint64_t AllocateGeometry(GeometryBuffer &geometry_buffer, uint64_t count, uint64_t alignment = 1);
+	// Writes the primitive records and transforms of every mesh instance to the allocations of the meshes
+	void UploadPrimitiveRecords(Scene &scene);
+	void UploadMaterials(Scene &scene);
+	void WriteGeometryDescriptors();
 	uint32_t UploadTexture(Image texture, VkSampler sampler);
 	uint32_t UploadStorageImage(Image image);
+	void ReleaseTexture(uint32_t handle);
+	void ReleaseStorageImage(uint32_t handle);
+	// The caller holds bindless_mutex
+	void QueueDescriptorWrite(VkDescriptorSet set, uint32_t binding, uint32_t slot, VkDescriptorType type,
+		VkDescriptorImageInfo image_info);
 	VkSampler GetSampler(SamplerInfo *sampler_info);
 
+	void TextureUploaderLoop();
+	void RecordTextureUpload(TextureUploadRequest &request);
+	// Uploads a texture that brings all its mip levels along on the dedicated transfer queue if there is one.
+	// The transfer queue can't blit, textures that need generated mips stay on the graphics queue.
+	void StreamTexture(TextureUploadRequest &request);
+
+	std::thread texture_uploader;
+	std::mutex texture_upload_mutex;
+	std::condition_variable texture_upload_cv;
+	std::deque<TextureUploadRequest> texture_upload_queue;
+	VkDeviceSize texture_upload_queued_bytes = 0;
+	bool texture_uploads_finished = false;
+	uint32_t texture_upload_count = 0;
+
+	// Textures are uploaded from the texture uploader thread too
+	std::mutex bindless_mutex;
+	BindlessSlotAllocator texture_slots;
+	BindlessSlotAllocator storage_image_slots;
+	struct PendingDescriptorWrite {
+		VkDescriptorSet set;
+		uint32_t binding;
+		uint32_t slot;
+		VkDescriptorType type;
+		VkDescriptorImageInfo image_info;
+	};
+	std::vector<PendingDescriptorWrite> pending_descriptor_writes;
+	// Handles of destroyed images per frame resource, and whether they are storage images
+	std::array<std::vector<std::pair<uint32_t, bool>>, MAX_FRAMES_IN_FLIGHT> destroyed_images;
+	uint32_t current_resource_idx = 0;
+
+	UploadContext upload_context;
+	// On the transfer queue if the device has a dedicated one, on the graphics queue otherwise
+	UploadContext streaming_context;
+	bool streaming_ownership_transfer = false;
+	std::deque<PendingStreamingAcquire> pending_streaming_acquires;
+	uint64_t streaming_acquired_value = 0;
+
+	// Instances are rewritten whenever a transform changes, so every frame in flight has its own copy
+	std::array<MappedBuffer, MAX_FRAMES_IN_FLIGHT> tlas_instance_buffers;
+	uint32_t tlas_instance_count = 0;
+	uint32_t tlas_refits_since_build = 0;
+	std::vector<glm::uvec2> moved_mesh_instances;
+
+	uint64_t material_offset = OffsetAllocator::INVALID_OFFSET;
+
 	VulkanContext &context;
 };
 
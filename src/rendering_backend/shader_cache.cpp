@@ -0,0 +1,242 @@
+#include "pch.h"
+#include "shader_cache.h"
+
+inline constexpr const char *SHADER_DIRECTORY = "data/shaders_compiled/";
+inline constexpr const char *SHADER_ARCHIVE_PATH = "data/shaders_compiled.pak";
+inline constexpr uint32_t SHADER_ARCHIVE_MAGIC = 0x4B505348; // "HSPK"
+// Bump whenever the archive layout changes
+inline constexpr uint32_t SHADER_ARCHIVE_VERSION = 2;
+
+// The archive is the header, entry_count entries, the paths and the SPIR-V of every entry, 4-byte aligned
+struct ShaderArchiveHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t entry_count;
+	uint32_t padding;
+};
+
+struct ShaderArchiveEntry {
+	uint64_t content_hash;
+	uint64_t offset;
+	uint64_t size;
+	uint32_t path_offset;
+	uint32_t path_size;
+	int64_t write_time;
+};
+
+static uint64_t HashSPIRV(const void *data, size_t size) {
+	uint64_t hash = 0xcbf29ce484222325;
+	const uint8_t *bytes = static_cast<const uint8_t *>(data);
+	for(size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+// gbuf.vert.spv is looked up as gbuf.vert
+static std::string GetShaderPath(const std::filesystem::path &file_path) {
+	std::filesystem::path relative_path = file_path.lexically_relative(SHADER_DIRECTORY);
+	relative_path.replace_extension();
+	return relative_path.generic_string();
+}
+
+void ShaderCache::Init(VkDevice device) {
+	this->device = device;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	bool archive_mapped = MapArchive();
+	if(!archive_mapped) {
+		LoadLooseFiles();
+		WriteArchive();
+	}
+	double load_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	if(LOG_STATISTICS) {
+		printf("Shader cache: %zu shaders loaded from %s in %.2f ms\n", blobs.size(),
+			archive_mapped ? "the archive" : "loose files", load_ms);
+	}
+}
+
+void ShaderCache::Destroy() {
+	for(auto &[_, module] : modules) {
+		vkDestroyShaderModule(device, module, nullptr);
+	}
+	modules.clear();
+	blobs.clear();
+	loose_files.clear();
+	UnmapArchive();
+}
+
+VkShaderModule ShaderCache::GetModule(const char *path) {
+	auto blob = blobs.find(path);
+	if(blob == blobs.end()) {
+		assert(false && "Shader not found!");
+		return VK_NULL_HANDLE;
+	}
+
+	std::scoped_lock lock(modules_mutex);
+	VkShaderModule &module = modules[blob->second.hash];
+	if(module == VK_NULL_HANDLE) {
+		VkShaderModuleCreateInfo shader_module_info {
+			.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
+			.codeSize = blob->second.size,
+			.pCode = blob->second.code
+		};
+		VK_CHECK(vkCreateShaderModule(device, &shader_module_info, nullptr, &module));
+	}
+	return module;
+}
+
+bool ShaderCache::MapArchive() {
+	std::error_code error;
+	if(!std::filesystem::exists(SHADER_ARCHIVE_PATH, error)) {
+		return false;
+	}
+
+	archive_file = CreateFileA(SHADER_ARCHIVE_PATH, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL, NULL);
+	if(archive_file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER archive_size;
+	GetFileSizeEx(archive_file, &archive_size);
+	archive_mapping = CreateFileMappingA(archive_file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if(archive_mapping == NULL) {
+		UnmapArchive();
+		return false;
+	}
+	archive_data = static_cast<const uint8_t *>(MapViewOfFile(archive_mapping, FILE_MAP_READ, 0, 0, 0));
+	if(!archive_data) {
+		UnmapArchive();
+		return false;
+	}
+
+	uint64_t size = static_cast<uint64_t>(archive_size.QuadPart);
+	const ShaderArchiveHeader *header = reinterpret_cast<const ShaderArchiveHeader *>(archive_data);
+	if(size < sizeof(ShaderArchiveHeader) || header->magic != SHADER_ARCHIVE_MAGIC ||
+		header->version != SHADER_ARCHIVE_VERSION ||
+		size < sizeof(ShaderArchiveHeader) + header->entry_count * sizeof(ShaderArchiveEntry)) {
+		UnmapArchive();
+		return false;
+	}
+
+	const ShaderArchiveEntry *entries = reinterpret_cast<const ShaderArchiveEntry *>(header + 1);
+	for(uint32_t i = 0; i < header->entry_count; ++i) {
+		const ShaderArchiveEntry &entry = entries[i];
+		if(entry.offset + entry.size > size || entry.offset % sizeof(uint32_t) != 0 ||
+			static_cast<uint64_t>(entry.path_offset) + entry.path_size > size) {
+			blobs.clear();
+			UnmapArchive();
+			return false;
+		}
+		std::string path(reinterpret_cast<const char *>(archive_data + entry.path_offset), entry.path_size);
+		blobs[path] = ShaderBlob {
+			.code = reinterpret_cast<const uint32_t *>(archive_data + entry.offset),
+			.size = entry.size,
+			.hash = entry.content_hash,
+			.write_time = entry.write_time
+		};
+	}
+
+	// Without loose files there is nothing to compare against, e.g. in a packaged build. Otherwise every
+	// compiled shader needs an entry of the same size and write time, and there must be no others.
+	// Comparing write times for equality also catches files replaced by older versions.
+	if(std::filesystem::exists(SHADER_DIRECTORY, error)) {
+		size_t loose_file_count = 0;
+		bool stale = false;
+		for(const auto &file : std::filesystem::recursive_directory_iterator(SHADER_DIRECTORY, error)) {
+			if(file.path().extension() != ".spv") {
+				continue;
+			}
+			++loose_file_count;
+			auto blob = blobs.find(GetShaderPath(file.path()));
+			if(blob == blobs.end() || blob->second.size != file.file_size(error) ||
+				blob->second.write_time != file.last_write_time(error).time_since_epoch().count()) {
+				stale = true;
+				break;
+			}
+		}
+		if(stale || loose_file_count != blobs.size()) {
+			blobs.clear();
+			UnmapArchive();
+			return false;
+		}
+	}
+	return true;
+}
+
+void ShaderCache::LoadLooseFiles() {
+	std::error_code error;
+	for(const auto &file : std::filesystem::recursive_directory_iterator(SHADER_DIRECTORY, error)) {
+		if(file.path().extension() != ".spv") {
+			continue;
+		}
+		std::ifstream stream(file.path(), std::ios::binary | std::ios::ate);
+		size_t size = static_cast<size_t>(stream.tellg());
+		stream.seekg(0);
+		std::vector<uint32_t> &code = loose_files.emplace_back(size / sizeof(uint32_t));
+		stream.read(reinterpret_cast<char *>(code.data()), size);
+
+		blobs[GetShaderPath(file.path())] = ShaderBlob {
+			.code = code.data(),
+			.size = code.size() * sizeof(uint32_t),
+			.hash = HashSPIRV(code.data(), code.size() * sizeof(uint32_t)),
+			.write_time = file.last_write_time(error).time_since_epoch().count()
+		};
+	}
+}
+
+void ShaderCache::WriteArchive() {
+	std::vector<ShaderArchiveEntry> entries;
+	std::string paths;
+	uint64_t paths_offset = sizeof(ShaderArchiveHeader) + blobs.size() * sizeof(ShaderArchiveEntry);
+	for(auto &[path, blob] : blobs) {
+		entries.push_back(ShaderArchiveEntry {
+			.content_hash = blob.hash,
+			.size = blob.size,
+			.path_offset = static_cast<uint32_t>(paths_offset + paths.size()),
+			.path_size = static_cast<uint32_t>(path.size()),
+			.write_time = blob.write_time
+		});
+		paths += path;
+	}
+	uint64_t offset = paths_offset + paths.size();
+	for(ShaderArchiveEntry &entry : entries) {
+		offset = (offset + sizeof(uint32_t) - 1) & ~static_cast<uint64_t>(sizeof(uint32_t) - 1);
+		entry.offset = offset;
+		offset += entry.size;
+	}
+
+	ShaderArchiveHeader header {
+		.magic = SHADER_ARCHIVE_MAGIC,
+		.version = SHADER_ARCHIVE_VERSION,
+		.entry_count = static_cast<uint32_t>(entries.size())
+	};
+	std::ofstream file(SHADER_ARCHIVE_PATH, std::ios::binary);
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(ShaderArchiveEntry));
+	file.write(paths.data(), paths.size());
+	uint32_t i = 0;
+	for(auto &[_, blob] : blobs) {
+		// Padding up to the aligned offset
+		std::array<char, sizeof(uint32_t)> zeros {};
+		file.write(zeros.data(), entries[i].offset - static_cast<uint64_t>(file.tellp()));
+		file.write(reinterpret_cast<const char *>(blob.code), blob.size);
+		++i;
+	}
+}
+
+void ShaderCache::UnmapArchive() {
+	if(archive_data) {
+		UnmapViewOfFile(archive_data);
+		archive_data = nullptr;
+	}
+	if(archive_mapping != NULL) {
+		CloseHandle(archive_mapping);
+		archive_mapping = NULL;
+	}
+	if(archive_file != INVALID_HANDLE_VALUE) {
+		CloseHandle(archive_file);
+		archive_file = INVALID_HANDLE_VALUE;
+	}
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+// Hands out shader modules for the SPIR-V compiled to data/shaders_compiled/, addressed by the path
+// of the shader relative to data/shaders/. All SPIR-V is read in Init, from a memory mapped archive,
+// or from the loose files when there is no archive or its entries don't match their size and write
+// time. In that case the archive is rewritten for the next run. Modules are created on first use and
+// live until Destroy, shaders with the same contents share one.
+class ShaderCache {
+public:
+	void Init(VkDevice device);
+	void Destroy();
+
+	// Thread safe, pipelines are built in parallel
+	VkShaderModule GetModule(const char *path);
+
+private:
+	struct ShaderBlob {
+		const uint32_t *code;
+		size_t size;
+		uint64_t hash;
+		// Of the compiled file the blob was read from
+		int64_t write_time;
+	};
+
+	// Returns false if the archive is missing, stale or malformed
+	bool MapArchive();
+	void LoadLooseFiles();
+	void WriteArchive();
+	void UnmapArchive();
+
+	VkDevice device = VK_NULL_HANDLE;
+	HANDLE archive_file = INVALID_HANDLE_VALUE;
+	HANDLE archive_mapping = NULL;
+	const uint8_t *archive_data = nullptr;
+	// Backs the blobs when they come from the loose files
+	std::vector<std::vector<uint32_t>> loose_files;
+	std::unordered_map<std::string, ShaderBlob> blobs;
+
+	std::mutex modules_mutex;
+	// Keyed by the content hash of the SPIR-V
+	std::unordered_map<uint64_t, VkShaderModule> modules;
+};
@@ -0,0 +1,214 @@
+#include "pch.h"
+#include "upload_context.h"
+
+#include "rendering_backend/vulkan_utils.h"
+
+void UploadContext::Init(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queue_family_idx,
+	VkDeviceSize ring_size) {
+	this->device = device;
+	this->allocator = allocator;
+	this->queue = queue;
+	this->queue_family_idx = queue_family_idx;
+	this->ring_size = ring_size;
+
+	// A pool of its own, so the context can be recorded from a thread other than the renderer's
+	VkCommandPoolCreateInfo command_pool_info {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
+		.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT |
+				 VK_COMMAND_POOL_CREATE_TRANSIENT_BIT,
+		.queueFamilyIndex = queue_family_idx
+	};
+	VK_CHECK(vkCreateCommandPool(device, &command_pool_info, nullptr, &command_pool));
+
+	std::array<VkCommandBuffer, UPLOAD_BATCH_COUNT> command_buffers;
+	VkCommandBufferAllocateInfo cmdbuf_alloc_info {
+		.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO,
+		.commandPool = command_pool,
+		.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY,
+		.commandBufferCount = UPLOAD_BATCH_COUNT
+	};
+	VK_CHECK(vkAllocateCommandBuffers(device, &cmdbuf_alloc_info, command_buffers.data()));
+
+	for(uint32_t i = 0; i < UPLOAD_BATCH_COUNT; ++i) {
+		batches[i].command_buffer = command_buffers[i];
+	}
+
+	VkSemaphoreTypeCreateInfo semaphore_type_info {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO,
+		.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE,
+		.initialValue = 0
+	};
+	VkSemaphoreCreateInfo semaphore_info {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO,
+		.pNext = &semaphore_type_info
+	};
+	VK_CHECK(vkCreateSemaphore(device, &semaphore_info, nullptr, &timeline_semaphore));
+	submitted_value = 0;
+
+	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(ring_size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+	ring = VkUtils::CreateMappedBuffer(allocator, buffer_info);
+}
+
+void UploadContext::Destroy() {
+	WaitIdle();
+	for(Batch &batch : batches) {
+		batch = Batch {};
+	}
+	vkDestroyCommandPool(device, command_pool, nullptr);
+	vkDestroySemaphore(device, timeline_semaphore, nullptr);
+	VkUtils::DestroyMappedBuffer(allocator, ring);
+}
+
+StagingAllocation UploadContext::Stage(const void *data, VkDeviceSize size, VkDeviceSize alignment) {
+	if(size > ring_size / 2) {
+		VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(size, VK_BUFFER_USAGE_TRANSFER_SRC_BIT);
+		MappedBuffer staging_buffer = VkUtils::CreateMappedBuffer(allocator, buffer_info);
+		memcpy(staging_buffer.mapped_data, data, size);
+		GetCommandBuffer();
+		batches[current_batch].dedicated_staging_buffers.push_back(staging_buffer);
+		return StagingAllocation {
+			.buffer = staging_buffer.handle,
+			.offset = 0,
+			.mapped_data = staging_buffer.mapped_data
+		};
+	}
+
+	while(true) {
+		// Beginning a batch may retire the one that used its slot before, so do it before looking for space
+		GetCommandBuffer();
+		if(ring_used == 0) {
+			ring_head = 0;
+		}
+
+		// Allocations don't wrap around, the bytes skipped at the end count as used by this batch
+		VkDeviceSize offset = VkUtils::AlignUp(ring_head, alignment);
+		if(offset + size > ring_size) {
+			offset = 0;
+		}
+		VkDeviceSize end = offset + size;
+		VkDeviceSize consumed = offset >= ring_head ? end - ring_head : ring_size - ring_head + end;
+		if(ring_used + consumed <= ring_size) {
+			ring_head = end == ring_size ? 0 : end;
+			ring_used += consumed;
+			batches[current_batch].ring_bytes += consumed;
+
+			void *mapped_data = static_cast<uint8_t *>(ring.mapped_data) + offset;
+			memcpy(mapped_data, data, size);
+			return StagingAllocation {
+				.buffer = ring.handle,
+				.offset = offset,
+				.mapped_data = mapped_data
+			};
+		}
+
+		// Only the batch being recorded holds the space, it has to go out before it can be reclaimed
+		if(!RetireOldestBatch()) {
+			Submit();
+		}
+	}
+}
+
+VkCommandBuffer UploadContext::GetCommandBuffer() {
+	Batch &batch = batches[current_batch];
+	if(!recording) {
+		// Only stall if the GPU hasn't consumed the batch submitted UPLOAD_BATCH_COUNT batches ago
+		if(batch.in_flight) {
+			Retire(batch);
+		}
+		VkCommandBufferBeginInfo cmdbuf_begin_info {
+			.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO,
+			.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT,
+		};
+		VK_CHECK(vkBeginCommandBuffer(batch.command_buffer, &cmdbuf_begin_info));
+		recording = true;
+	}
+	return batch.command_buffer;
+}
+
+void UploadContext::DestroyAfterUpload(GPUBuffer buffer) {
+	GetCommandBuffer();
+	batches[current_batch].released_buffers.push_back(buffer);
+}
+
+uint64_t UploadContext::Submit() {
+	if(!recording) {
+		return submitted_value;
+	}
+	Batch &batch = batches[current_batch];
+
+	// Makes the copies visible to everything submitted after the batch
+	VkMemoryBarrier memory_barrier {
+		.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER,
+		.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT,
+		.dstAccessMask = VK_ACCESS_MEMORY_READ_BIT | VK_ACCESS_MEMORY_WRITE_BIT
+	};
+	vkCmdPipelineBarrier(batch.command_buffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+		0, 1, &memory_barrier, 0, nullptr, 0, nullptr);
+	VK_CHECK(vkEndCommandBuffer(batch.command_buffer));
+
+	batch.timeline_value = submitted_value + 1;
+	VkTimelineSemaphoreSubmitInfo timeline_submit_info {
+		.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO,
+		.signalSemaphoreValueCount = 1,
+		.pSignalSemaphoreValues = &batch.timeline_value
+	};
+	VkSubmitInfo submit_info {
+		.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO,
+		.pNext = &timeline_submit_info,
+		.commandBufferCount = 1,
+		.pCommandBuffers = &batch.command_buffer,
+		.signalSemaphoreCount = 1,
+		.pSignalSemaphores = &timeline_semaphore
+	};
+	VK_CHECK(vkQueueSubmit(queue, 1, &submit_info, VK_NULL_HANDLE));
+	batch.in_flight = true;
+	recording = false;
+	submitted_value = batch.timeline_value;
+
+	current_batch = (current_batch + 1) % UPLOAD_BATCH_COUNT;
+	return submitted_value;
+}
+
+void UploadContext::WaitIdle() {
+	Submit();
+	while(RetireOldestBatch());
+}
+
+uint64_t UploadContext::GetCompletedValue() const {
+	uint64_t value;
+	VK_CHECK(vkGetSemaphoreCounterValue(device, timeline_semaphore, &value));
+	return value;
+}
+
+void UploadContext::Retire(Batch &batch) {
+	VkSemaphoreWaitInfo wait_info {
+		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO,
+		.semaphoreCount = 1,
+		.pSemaphores = &timeline_semaphore,
+		.pValues = &batch.timeline_value
+	};
+	VK_CHECK(vkWaitSemaphores(device, &wait_info, UINT64_MAX));
+	ring_used -= batch.ring_bytes;
+	batch.ring_bytes = 0;
+	for(MappedBuffer &staging_buffer : batch.dedicated_staging_buffers) {
+		VkUtils::DestroyMappedBuffer(allocator, staging_buffer);
+	}
+	batch.dedicated_staging_buffers.clear();
+	for(GPUBuffer &buffer : batch.released_buffers) {
+		VkUtils::DestroyGPUBuffer(allocator, buffer);
+	}
+	batch.released_buffers.clear();
+	batch.in_flight = false;
+}
+
+bool UploadContext::RetireOldestBatch() {
+	// Batches are submitted in slot order, the oldest one follows the slot being recorded
+	for(uint32_t i = 1; i <= UPLOAD_BATCH_COUNT; ++i) {
+		Batch &batch = batches[(current_batch + i) % UPLOAD_BATCH_COUNT];
+		if(batch.in_flight) {
+			Retire(batch);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+inline constexpr uint32_t UPLOAD_BATCH_COUNT = 4;
+
+struct StagingAllocation {
+	VkBuffer buffer;
+	VkDeviceSize offset;
+	void *mapped_data;
+};
+
+// Records uploads into batched command buffers, staged in a persistently mapped ring buffer.
+// Every submission signals the next value of a timeline semaphore. Ring space used by a batch
+// is reclaimed once its value is reached, payloads larger than half the ring get a dedicated
+// staging buffer that is released the same way. Only one thread may record uploads at a time.
+class UploadContext {
+public:
+	void Init(VkDevice device, VmaAllocator allocator, VkQueue queue, uint32_t queue_family_idx,
+		VkDeviceSize ring_size);
+	void Destroy();
+
+	// Copies data to staging memory. Running out of space submits the batch being recorded,
+	// so stage before getting the command buffer the copies are recorded into.
+	StagingAllocation Stage(const void *data, VkDeviceSize size, VkDeviceSize alignment = 16);
+	VkCommandBuffer GetCommandBuffer();
+	// Destroys the buffer once the commands recorded so far have executed
+	void DestroyAfterUpload(GPUBuffer buffer);
+	// Submits the batch being recorded without waiting, later submissions to the queue see its writes.
+	// Returns the timeline value signaled once everything recorded so far has executed.
+	uint64_t Submit();
+	// Submits and waits for every batch
+	void WaitIdle();
+
+	VkSemaphore GetTimelineSemaphore() const { return timeline_semaphore; }
+	// Value the batch being recorded will signal
+	uint64_t GetRecordingValue() const { return submitted_value + 1; }
+	uint64_t GetSubmittedValue() const { return submitted_value; }
+	uint64_t GetCompletedValue() const;
+	uint32_t GetQueueFamily() const { return queue_family_idx; }
+
+private:
+	struct Batch {
+		VkCommandBuffer command_buffer = VK_NULL_HANDLE;
+		uint64_t timeline_value = 0;
+		VkDeviceSize ring_bytes = 0;
+		std::vector<MappedBuffer> dedicated_staging_buffers;
+		std::vector<GPUBuffer> released_buffers;
+		bool in_flight = false;
+	};
+
+	void Retire(Batch &batch);
+	// Retires the oldest batch in flight, returns false if there is none
+	bool RetireOldestBatch();
+
+	VkDevice device = VK_NULL_HANDLE;
+	VmaAllocator allocator = VK_NULL_HANDLE;
+	VkQueue queue = VK_NULL_HANDLE;
+	uint32_t queue_family_idx = UINT32_MAX;
+	VkCommandPool command_pool = VK_NULL_HANDLE;
+	VkSemaphore timeline_semaphore = VK_NULL_HANDLE;
+
+	std::array<Batch, UPLOAD_BATCH_COUNT> batches;
+	uint32_t current_batch = 0;
+	bool recording = false;
+	uint64_t submitted_value = 0;
+
+	MappedBuffer ring {};
+	VkDeviceSize ring_size = 0;
+	// Next free byte, the used bytes end there and start ring_used bytes earlier
+	VkDeviceSize ring_head = 0;
+	VkDeviceSize ring_used = 0;
+};
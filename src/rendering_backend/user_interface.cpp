@@ -31,7 +31,7 @@ UserInterface::UserInterface(VulkanContext &context, ResourceManager &resource_m
 	int width, height;
 	io.Fonts->GetTexDataAsRGBA32(&font_data, &width, &height);
 	font_texture = resource_manager.UploadTextureFromData(width, height, font_data);
-	io.Fonts->TexID = reinterpret_cast<ImTextureID>(static_cast<uint64_t>(font_texture));
+	io.Fonts->TexID = reinterpret_cast<ImTextureID>(static_cast<uint64_t>(GetBindlessIndex(font_texture)));
 	free(font_data);
 
 	debug_textures[VK_FORMAT_B8G8R8A8_UNORM] = resource_manager.UploadEmptyTexture(4096, 4096, VK_FORMAT_B8G8R8A8_UNORM);
@@ -41,6 +41,7 @@ UserInterface::UserInterface(VulkanContext &context, ResourceManager &resource_m
 	debug_textures[VK_FORMAT_R32G32B32A32_SFLOAT] = resource_manager.UploadEmptyTexture(4096, 4096, VK_FORMAT_R32G32B32A32_SFLOAT);
 	debug_textures[VK_FORMAT_R16_SFLOAT] = resource_manager.UploadEmptyTexture(4096, 4096, VK_FORMAT_R16_SFLOAT);
 	debug_textures[VK_FORMAT_R16G16_SFLOAT] = resource_manager.UploadEmptyTexture(4096, 4096, VK_FORMAT_R16G16_SFLOAT);
+	debug_textures[VK_FORMAT_R32_SFLOAT] = resource_manager.UploadEmptyTexture(4096, 4096, VK_FORMAT_R32_SFLOAT);
 	active_debug_texture = debug_textures[VK_FORMAT_B8G8R8A8_UNORM];
 
 	VkBufferCreateInfo buffer_info = VkUtils::BufferCreateInfo(IMGUI_MAX_VERTEX_AND_INDEX_BUFSIZE, 
@@ -126,6 +127,20 @@ UserInterfaceState UserInterface::Update(RenderGraph &render_graph,
 	active_render_path.ImGuiDrawSettings();
 	ImGui::End();
 
+	// Moves an instance every frame, which exercises the TLAS refits
+	static bool animate_mesh_instance = false;
+	// Freeing meshes one by one exercises the geometry allocators and their defragmentation
+	static int selected_mesh_idx = 0;
+	int32_t free_mesh_idx = -1;
+	ImGui::Begin("Scene");
+	ImGui::Checkbox("Animate First Mesh Instance", &animate_mesh_instance);
+	ImGui::InputInt("Mesh", &selected_mesh_idx);
+	selected_mesh_idx = std::max(selected_mesh_idx, 0);
+	if(ImGui::Button("Free Mesh Geometry")) {
+		free_mesh_idx = selected_mesh_idx;
+	}
+	ImGui::End();
+
 	ImGui::SetNextWindowBgAlpha(1.0f);
 	ImGui::Begin("Debug Texture");
 	if(ImGui::BeginCombo("##texture_combo", current_texture.c_str()))
@@ -141,7 +156,7 @@ UserInterfaceState UserInterface::Update(RenderGraph &render_graph,
 
 	if(!current_texture.empty()) {
 		ImGui::Image(
-			reinterpret_cast<ImTextureID>(static_cast<uint64_t>(active_debug_texture)),
+			reinterpret_cast<ImTextureID>(static_cast<uint64_t>(GetBindlessIndex(active_debug_texture))),
 			ImGui::GetContentRegionAvail(),
 			ImVec2(0, io.DisplaySize.y / 4096),
 			ImVec2(io.DisplaySize.x / 4096, 0) 
@@ -154,7 +169,9 @@ UserInterfaceState UserInterface::Update(RenderGraph &render_graph,
 
 	return UserInterfaceState {
 		.render_path_state = render_path_state,
-		.debug_texture = current_texture
+		.debug_texture = current_texture,
+		.animate_mesh_instance = animate_mesh_instance,
+		.free_mesh_idx = free_mesh_idx
 	};
 }
 
@@ -224,7 +241,7 @@ void UserInterface::Draw(ResourceManager &resource_manager, VkCommandBuffer comm
 			2.0f / draw_data->DisplaySize.y
 		},
 		.translate = glm::vec2 { -1.0f, -1.0f },
-		.texture = font_texture
+		.texture = GetBindlessIndex(font_texture)
 	};
 
 	VkViewport viewport {
@@ -346,9 +363,9 @@ void UserInterface::CreateImGuiRenderPass() {
 
 void UserInterface::CreateImGuiPipeline(ResourceManager &resource_manager) {
 	std::array<VkPipelineShaderStageCreateInfo, 2> shader_stage_infos {
-		VkUtils::PipelineShaderStageCreateInfo(context.device, "imgui/imgui.vert",
+		VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule("imgui/imgui.vert"),
 			VK_SHADER_STAGE_VERTEX_BIT),
-		VkUtils::PipelineShaderStageCreateInfo(context.device, "imgui/imgui.frag",
+		VkUtils::PipelineShaderStageCreateInfo(context.shader_cache.GetModule("imgui/imgui.frag"),
 			VK_SHADER_STAGE_FRAGMENT_BIT)
 	};
 
@@ -420,11 +437,10 @@ void UserInterface::CreateImGuiPipeline(ResourceManager &resource_manager) {
 		.subpass = 0
 	};
 
-	VK_CHECK(vkCreateGraphicsPipelines(context.device, VK_NULL_HANDLE, 1, &pipeline_info,
+	VkUtils::PipelineCreationFeedback creation_feedback(pipeline_info.stageCount);
+	pipeline_info.pNext = &creation_feedback.create_info;
+	VK_CHECK(vkCreateGraphicsPipelines(context.device, context.pipeline_cache, 1, &pipeline_info,
 		nullptr, &pipeline));
-
-	for(VkPipelineShaderStageCreateInfo& pipeline_shader_stage_info : shader_stage_infos) {
-		vkDestroyShaderModule(context.device, pipeline_shader_stage_info.module, nullptr);
-	}
+	VkUtils::RecordPipelineCreationFeedback(context, creation_feedback);
 }
 
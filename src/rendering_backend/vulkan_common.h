@@ -6,6 +6,10 @@
 	printf("Vulkan error: %s:%i", __FILE__, __LINE__); 	\
 }
 
+// Load times, cache hit rates and memory statistics are printed to stdout when enabled, otherwise
+// only errors are
+inline constexpr bool LOG_STATISTICS = false;
+
 inline constexpr uint32_t MAX_FRAMES_IN_FLIGHT = 3;
 
 struct Image {
@@ -23,6 +27,7 @@ struct SamplerInfo {
 	VkFilter min_filter;
 	VkSamplerAddressMode address_mode_u;
 	VkSamplerAddressMode address_mode_v;
+	VkSamplerMipmapMode mipmap_mode;
 };
 
 struct Sampler {
@@ -55,8 +60,16 @@ struct Camera {
 //	uint32_t index_count;
 //};
 
+// A glTF mesh, decoded once and drawn instanced for every node referencing it.
+// The transform indices of mesh.primitives are unused, each instance has its own.
 struct Mesh {
 	std::vector<Primitive> primitives;
+	std::vector<glm::mat4> instance_transforms;
+	// Index of the first primitive record in the global primitive buffer, records are ordered
+	// by instance, then primitive. Assigned by the ResourceManager.
+	uint32_t first_primitive = 0;
+	// Index of the transform of the first instance in the global transform buffer, one per instance
+	uint32_t first_transform = 0;
 };
 
 //struct DirectionalLight {
@@ -70,6 +83,8 @@ struct Scene {
 	Camera camera;
 	DirectionalLight directional_light;
 	std::vector<Mesh> meshes;
+	// Deduplicated, Primitive::material indexes into them
+	std::vector<Material> materials;
 };
 
 //struct PerFrameData {
@@ -106,7 +121,9 @@ constexpr VkVertexInputBindingDescription DEFAULT_VERTEX_BINDING_DESCRIPTION {
 	.stride = sizeof(Vertex),
 	.inputRate = VK_VERTEX_INPUT_RATE_VERTEX
 };
-constexpr std::array<VkVertexInputAttributeDescription, 5> DEFAULT_VERTEX_ATTRIBUTE_DESCRIPTIONS {
+// Packed attributes are fetched as raw uints and decoded in the shaders, with the same
+// functions the ray tracing shaders use on the vertices[] buffer.
+constexpr std::array<VkVertexInputAttributeDescription, 4> DEFAULT_VERTEX_ATTRIBUTE_DESCRIPTIONS {
 	VkVertexInputAttributeDescription {
 		.location = 0,
 		.binding = 0,
@@ -116,26 +133,20 @@ constexpr std::array<VkVertexInputAttributeDescription, 5> DEFAULT_VERTEX_ATTRIB
 	VkVertexInputAttributeDescription {
 		.location = 1,
 		.binding = 0,
-		.format = VK_FORMAT_R32G32B32_SFLOAT,
+		.format = VK_FORMAT_R32_UINT,
 		.offset = offsetof(Vertex, normal)
 	},
 	VkVertexInputAttributeDescription {
 		.location = 2,
 		.binding = 0,
-		.format = VK_FORMAT_R32G32B32A32_SFLOAT,
+		.format = VK_FORMAT_R32_UINT,
 		.offset = offsetof(Vertex, tangent)
 	},
 	VkVertexInputAttributeDescription {
 		.location = 3,
 		.binding = 0,
-		.format = VK_FORMAT_R32G32_SFLOAT,
+		.format = VK_FORMAT_R32_UINT,
 		.offset = offsetof(Vertex, uv0)
-	},
-	VkVertexInputAttributeDescription {
-		.location = 4,
-		.binding = 0,
-		.format = VK_FORMAT_R32G32_SFLOAT,
-		.offset = offsetof(Vertex, uv1)
 	}
 };
 
@@ -184,11 +195,15 @@ struct GPUBuffer {
 struct AccelerationStructure {
 	VkAccelerationStructureKHR handle;
 	GPUBuffer buffer;
+	// Null for BLASes, they are built from a shared scratch pool
 	GPUBuffer scratch;
+	VkDeviceAddress address;
+	VkDeviceSize size;
 };
 
 enum class VertexInputState {
 	Default,
+	PositionOnly,
 	Empty,
 	ImGui
 };
@@ -203,7 +218,8 @@ enum class MultisampleState {
 };
 enum class DepthStencilState {
 	Off,
-	On
+	On,
+	Equal
 };
 enum class ColorBlendState {
 	Off,
@@ -403,4 +419,7 @@ enum class RenderPathState {
 struct UserInterfaceState {
 	RenderPathState render_path_state;
 	std::string debug_texture;
+	bool animate_mesh_instance;
+	// -1 unless the geometry of a mesh should be freed this frame
+	int32_t free_mesh_idx;
 };
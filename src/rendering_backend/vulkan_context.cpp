@@ -22,10 +22,11 @@ inline constexpr std::array<const char*, 3> INSTANCE_EXTENSIONS {
 	VK_EXT_DEBUG_UTILS_EXTENSION_NAME
 };
 #endif
-inline constexpr std::array<const char*, 9> DEVICE_EXTENSIONS {
+inline constexpr std::array<const char*, 10> DEVICE_EXTENSIONS {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME,
 	VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME,
 	VK_KHR_SPIRV_1_4_EXTENSION_NAME,
+	VK_EXT_PIPELINE_CREATION_FEEDBACK_EXTENSION_NAME,
 	
 	VK_KHR_BUFFER_DEVICE_ADDRESS_EXTENSION_NAME,
 	VK_KHR_DEFERRED_HOST_OPERATIONS_EXTENSION_NAME,
@@ -41,6 +42,19 @@ inline constexpr std::array<const char*, 9> DEVICE_EXTENSIONS {
 	printf("Vulkan error: %s:%i", __FILE__, __LINE__); 	\
 }
 
+inline constexpr const char *PIPELINE_CACHE_PATH = "data/pipeline_cache.bin";
+inline constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43505648; // "HVPC"
+
+// Cache data is only used on the GPU and driver it was written by
+struct PipelineCacheFileHeader {
+	uint32_t magic;
+	uint32_t vendor_id;
+	uint32_t device_id;
+	uint32_t driver_version;
+	uint8_t pipeline_cache_uuid[VK_UUID_SIZE];
+	uint64_t size;
+};
+
 VulkanContext::VulkanContext(HINSTANCE hinstance, HWND hwnd) : hwnd(hwnd) {
 	VK_CHECK(volkInitialize());
 
@@ -75,6 +89,8 @@ VulkanContext::VulkanContext(HINSTANCE hinstance, HWND hwnd) : hwnd(hwnd) {
 	volkLoadDevice(device);
 
 	InitAllocator();
+	InitPipelineCache();
+	shader_cache.Init(device);
 
 	VkCommandPoolCreateInfo command_pool_info {
 		.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO,
@@ -106,6 +122,10 @@ void VulkanContext::DestroyResources() {
 	vkDestroyCommandPool(device, command_pool, nullptr);
 	vmaDestroyAllocator(allocator);
 
+	SavePipelineCache();
+	vkDestroyPipelineCache(device, pipeline_cache, nullptr);
+	shader_cache.Destroy();
+
 	vkDestroyDevice(device, nullptr);
 
 #ifndef NDEBUG
@@ -163,14 +183,32 @@ void VulkanContext::InitPhysicalDevice() {
 		gpu.handle = dev;
 	}
 
+	gpu.vk12_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES
+	};
+	gpu.acceleration_structure_properties = {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR,
+		.pNext = &gpu.vk12_properties
+	};
 	gpu.raytracing_properties = {
-		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR,
+		.pNext = &gpu.acceleration_structure_properties
 	};
 	gpu.properties = {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2,
 		.pNext = &gpu.raytracing_properties
 	};
 	vkGetPhysicalDeviceProperties2(gpu.handle, &gpu.properties);
+
+	VkPhysicalDeviceAccelerationStructureFeaturesKHR as_features {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR
+	};
+	VkPhysicalDeviceFeatures2 features {
+		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
+		.pNext = &as_features
+	};
+	vkGetPhysicalDeviceFeatures2(gpu.handle, &features);
+	gpu.supports_host_acceleration_structure_commands = as_features.accelerationStructureHostCommands;
 	vkGetPhysicalDeviceSurfaceCapabilitiesKHR(gpu.handle, surface, 
 		&gpu.surface_capabilities);
 
@@ -193,6 +231,11 @@ void VulkanContext::InitPhysicalDevice() {
 		if(queue_families[i].queueFlags & VK_QUEUE_COMPUTE_BIT) {
 			gpu.compute_family_idx = i;
 		}
+		// Dedicated transfer families map to the copy engines, which run alongside rendering
+		if((queue_families[i].queueFlags & VK_QUEUE_TRANSFER_BIT) &&
+			!(queue_families[i].queueFlags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+			gpu.transfer_family_idx = i;
+		}
 	}
 
 	VkBool32 supports_present = VK_FALSE;
@@ -203,20 +246,23 @@ void VulkanContext::InitPhysicalDevice() {
 
 void VulkanContext::InitLogicalDevice() {
 	float priority = 1.0f;
-	std::array<VkDeviceQueueCreateInfo, 2> device_queue_infos {
-		VkDeviceQueueCreateInfo {
-			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-			.queueFamilyIndex = gpu.graphics_family_idx,
-			.queueCount = 1,
-			.pQueuePriorities = &priority
-		},
-		VkDeviceQueueCreateInfo {
-			.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
-			.queueFamilyIndex = gpu.compute_family_idx,
-			.queueCount = 1,
-			.pQueuePriorities = &priority
+	// Every family may only be requested once
+	std::vector<VkDeviceQueueCreateInfo> device_queue_infos;
+	for(uint32_t family_idx : { gpu.graphics_family_idx, gpu.compute_family_idx, gpu.transfer_family_idx }) {
+		bool requested = std::any_of(device_queue_infos.begin(), device_queue_infos.end(),
+			[family_idx](const VkDeviceQueueCreateInfo &queue_info) {
+				return queue_info.queueFamilyIndex == family_idx;
+			}
+		);
+		if(family_idx != UINT32_MAX && !requested) {
+			device_queue_infos.emplace_back(VkDeviceQueueCreateInfo {
+				.sType = VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO,
+				.queueFamilyIndex = family_idx,
+				.queueCount = 1,
+				.pQueuePriorities = &priority
+			});
 		}
-	};
+	}
 
 	VkPhysicalDeviceRayQueryFeaturesKHR device_ray_query_features {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_QUERY_FEATURES_KHR,
@@ -225,7 +271,8 @@ void VulkanContext::InitLogicalDevice() {
 	VkPhysicalDeviceAccelerationStructureFeaturesKHR device_as_features {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_FEATURES_KHR,
 		.pNext = &device_ray_query_features,
-		.accelerationStructure = VK_TRUE
+		.accelerationStructure = VK_TRUE,
+		.accelerationStructureHostCommands = gpu.supports_host_acceleration_structure_commands
 	};
 	VkPhysicalDeviceRayTracingPipelineFeaturesKHR device_rt_pipeline_features {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_FEATURES_KHR,
@@ -235,19 +282,30 @@ void VulkanContext::InitLogicalDevice() {
 	VkPhysicalDeviceVulkan12Features device_vk12_features {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES,
 		.pNext = &device_rt_pipeline_features,
+		.drawIndirectCount = VK_TRUE,
 		.descriptorIndexing = VK_TRUE,
 		.shaderSampledImageArrayNonUniformIndexing = VK_TRUE,
+		.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE,
+		.descriptorBindingStorageImageUpdateAfterBind = VK_TRUE,
+		.descriptorBindingUpdateUnusedWhilePending = VK_TRUE,
 		.descriptorBindingPartiallyBound = VK_TRUE,
 		.descriptorBindingVariableDescriptorCount = VK_TRUE,
 		.runtimeDescriptorArray = VK_TRUE,
 		.scalarBlockLayout = VK_TRUE,
+		.timelineSemaphore = VK_TRUE,
 		.bufferDeviceAddress = VK_TRUE
 	};
 	VkPhysicalDeviceFeatures2 device_features {
 		.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2,
 		.pNext = &device_vk12_features,
 		.features = VkPhysicalDeviceFeatures {
+			// The culled draws carry the primitive record index in firstInstance
+			.multiDrawIndirect = VK_TRUE,
+			.drawIndirectFirstInstance = VK_TRUE,
 			.samplerAnisotropy = VK_TRUE,
+			.textureCompressionBC = VK_TRUE,
+			// The render graph counts the fragments each graphics pass shades
+			.pipelineStatisticsQuery = VK_TRUE,
 			.shaderStorageImageReadWithoutFormat = VK_TRUE,
 			.shaderStorageImageWriteWithoutFormat = VK_TRUE
 		}
@@ -268,6 +326,9 @@ void VulkanContext::InitLogicalDevice() {
 	VK_CHECK(vkCreateDevice(gpu.handle, &device_info, nullptr, &device));
 	vkGetDeviceQueue(device, gpu.graphics_family_idx, 0, &graphics_queue);
 	vkGetDeviceQueue(device, gpu.compute_family_idx, 0, &compute_queue);
+	if(gpu.transfer_family_idx != UINT32_MAX) {
+		vkGetDeviceQueue(device, gpu.transfer_family_idx, 0, &transfer_queue);
+	}
 }
 
 void VulkanContext::InitAllocator() {
@@ -283,6 +344,71 @@ void VulkanContext::InitAllocator() {
 	vmaCreateAllocator(&allocator_info, &allocator);
 }
 
+void VulkanContext::InitPipelineCache() {
+	// The driver validates the data as well, but silently starts out empty if it doesn't match
+	std::vector<uint8_t> cache_data;
+	std::ifstream file(PIPELINE_CACHE_PATH, std::ios::binary);
+	PipelineCacheFileHeader header;
+	if(file && file.read(reinterpret_cast<char *>(&header), sizeof(header))) {
+		// A truncated or corrupted file could claim any size, it has to hold the data it announces
+		std::error_code error;
+		uint64_t file_size = std::filesystem::file_size(PIPELINE_CACHE_PATH, error);
+		const VkPhysicalDeviceProperties &properties = gpu.properties.properties;
+		bool compatible = header.magic == PIPELINE_CACHE_MAGIC && header.vendor_id == properties.vendorID &&
+			header.device_id == properties.deviceID && header.driver_version == properties.driverVersion &&
+			!memcmp(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE) &&
+			!error && header.size <= file_size - sizeof(header);
+		if(compatible) {
+			cache_data.resize(header.size);
+			if(!file.read(reinterpret_cast<char *>(cache_data.data()), header.size)) {
+				cache_data.clear();
+			}
+		}
+	}
+	pipeline_cache_loaded = !cache_data.empty();
+
+	VkPipelineCacheCreateInfo pipeline_cache_info {
+		.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO,
+		.initialDataSize = cache_data.size(),
+		.pInitialData = cache_data.empty() ? nullptr : cache_data.data()
+	};
+	VK_CHECK(vkCreatePipelineCache(device, &pipeline_cache_info, nullptr, &pipeline_cache));
+	if(LOG_STATISTICS) {
+		printf("Pipeline cache: %s (%.2f KB)\n", pipeline_cache_loaded ? "loaded from disk" : "cold",
+			static_cast<double>(cache_data.size()) / 1024.0);
+	}
+}
+
+void VulkanContext::SavePipelineCache() {
+	size_t size;
+	VK_CHECK(vkGetPipelineCacheData(device, pipeline_cache, &size, nullptr));
+	std::vector<uint8_t> cache_data(size);
+	VK_CHECK(vkGetPipelineCacheData(device, pipeline_cache, &size, cache_data.data()));
+
+	const VkPhysicalDeviceProperties &properties = gpu.properties.properties;
+	PipelineCacheFileHeader header {
+		.magic = PIPELINE_CACHE_MAGIC,
+		.vendor_id = properties.vendorID,
+		.device_id = properties.deviceID,
+		.driver_version = properties.driverVersion,
+		.size = size
+	};
+	memcpy(header.pipeline_cache_uuid, properties.pipelineCacheUUID, VK_UUID_SIZE);
+
+	// Written next to the cache and moved over it, so a crash while saving leaves the old cache intact
+	std::string temp_path = std::string(PIPELINE_CACHE_PATH) + ".tmp";
+	{
+		std::ofstream file(temp_path, std::ios::binary);
+		file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char *>(cache_data.data()), size);
+		if(!file) {
+			return;
+		}
+	}
+	std::error_code error;
+	std::filesystem::rename(temp_path, PIPELINE_CACHE_PATH, error);
+}
+
 void VulkanContext::InitFrameResources() {
 	VkSemaphoreCreateInfo semaphore_info {
 		.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO
@@ -1,12 +1,25 @@
 #pragma once
+#include "rendering_backend/shader_cache.h"
 
 struct PhysicalDevice {
 	VkPhysicalDevice handle = VK_NULL_HANDLE;
 	VkPhysicalDeviceProperties2 properties;
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR raytracing_properties;
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR acceleration_structure_properties;
+	VkPhysicalDeviceVulkan12Properties vk12_properties;
 	VkSurfaceCapabilitiesKHR surface_capabilities;
+	bool supports_host_acceleration_structure_commands = false;
 	uint32_t graphics_family_idx = UINT32_MAX;
 	uint32_t compute_family_idx = UINT32_MAX;
+	// Only set for a family with transfer but neither graphics nor compute support
+	uint32_t transfer_family_idx = UINT32_MAX;
+};
+
+// Accumulated from the creation feedback of every pipeline built since startup
+struct PipelineCacheStatistics {
+	uint32_t pipeline_count = 0;
+	uint32_t cache_hits = 0;
+	double creation_ms = 0.0;
 };
 
 struct Swapchain {
@@ -39,9 +52,20 @@ public:
 	VkCommandPool command_pool = VK_NULL_HANDLE;
 	VkQueue graphics_queue = VK_NULL_HANDLE;
 	VkQueue compute_queue = VK_NULL_HANDLE;
+	// VK_NULL_HANDLE if the device has no dedicated transfer family
+	VkQueue transfer_queue = VK_NULL_HANDLE;
 
 	PhysicalDevice gpu;
 	VmaAllocator allocator;
+	// Shared by all pipeline builders, loaded from disk on startup and saved by DestroyResources
+	VkPipelineCache pipeline_cache = VK_NULL_HANDLE;
+	// Whether pipeline_cache started out with data from a previous run
+	bool pipeline_cache_loaded = false;
+	// Pipelines are built from several threads
+	std::mutex pipeline_cache_statistics_mutex;
+	PipelineCacheStatistics pipeline_cache_statistics;
+	// Owns every shader module, pipelines don't destroy the modules they were built from
+	ShaderCache shader_cache;
 	Swapchain swapchain;
 	std::array<FrameResources, MAX_FRAMES_IN_FLIGHT> frame_resources;
 
@@ -54,6 +78,8 @@ private:
 	void InitPhysicalDevice();
 	void InitLogicalDevice();
 	void InitAllocator();
+	void InitPipelineCache();
+	void SavePipelineCache();
 	void InitFrameResources();
 	void InitSwapchain();
 };
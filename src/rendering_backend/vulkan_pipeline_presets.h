@@ -7,6 +7,14 @@ inline constexpr VkPipelineVertexInputStateCreateInfo VERTEX_INPUT_STATE_DEFAULT
 	.vertexAttributeDescriptionCount = static_cast<uint32_t>(DEFAULT_VERTEX_ATTRIBUTE_DESCRIPTIONS.size()),
 	.pVertexAttributeDescriptions = DEFAULT_VERTEX_ATTRIBUTE_DESCRIPTIONS.data()
 };
+// Only the position attribute, the first of the default ones
+inline constexpr VkPipelineVertexInputStateCreateInfo VERTEX_INPUT_STATE_POSITION_ONLY {
+	.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
+	.vertexBindingDescriptionCount = 1,
+	.pVertexBindingDescriptions = &DEFAULT_VERTEX_BINDING_DESCRIPTION,
+	.vertexAttributeDescriptionCount = 1,
+	.pVertexAttributeDescriptions = DEFAULT_VERTEX_ATTRIBUTE_DESCRIPTIONS.data()
+};
 inline constexpr VkPipelineVertexInputStateCreateInfo VERTEX_INPUT_STATE_IMGUI {
 	.sType = VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO,
 	.vertexBindingDescriptionCount = 1,
@@ -38,6 +46,13 @@ inline constexpr VkPipelineDepthStencilStateCreateInfo DEPTH_STENCIL_STATE_ON {
 	.depthWriteEnable = VK_TRUE,
 	.depthCompareOp = VK_COMPARE_OP_GREATER_OR_EQUAL
 };
+// Shades only the surfaces a depth prepass left in the depth buffer
+inline constexpr VkPipelineDepthStencilStateCreateInfo DEPTH_STENCIL_STATE_EQUAL {
+	.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
+	.depthTestEnable = VK_TRUE,
+	.depthWriteEnable = VK_FALSE,
+	.depthCompareOp = VK_COMPARE_OP_EQUAL
+};
 inline constexpr VkPipelineDepthStencilStateCreateInfo DEPTH_STENCIL_STATE_OFF {
 	.sType = VK_STRUCTURE_TYPE_PIPELINE_DEPTH_STENCIL_STATE_CREATE_INFO,
 	.depthTestEnable = VK_FALSE,
@@ -5,44 +5,16 @@ inline uint32_t AlignUp(uint32_t value, uint32_t alignment) {
 	return (value + (alignment - 1)) & ~(alignment - 1);
 }
 
-inline std::vector<uint32_t> LoadShader(const char *path, VkShaderStageFlags shader_stage) {
-	std::string full_path = "data/shaders_compiled/" + std::string(path) + ".spv";
-	HANDLE file = CreateFileA(full_path.c_str(), GENERIC_READ, 0, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
-	assert(file != INVALID_HANDLE_VALUE);
-
-	DWORD file_size = GetFileSize(file, NULL);
-	assert(file_size != INVALID_FILE_SIZE);
-
-	std::vector<uint32_t> bytecode;
-	bytecode.resize(file_size / sizeof(uint32_t));
-
-	DWORD bytes_read;
-	BOOL success = ReadFile(file, bytecode.data(), file_size, &bytes_read, NULL);
-	assert(success);
-
-	CloseHandle(file);
-	return bytecode;
-}
-
-inline VkShaderModule CreateShaderModule(VkDevice device, const char *path, 
-	VkShaderStageFlags shader_stage) {
-	std::vector<uint32_t> shader_bytecode = VkUtils::LoadShader(path, shader_stage);
-	VkShaderModule shader;
-	VkShaderModuleCreateInfo shader_module_info {
-		.sType = VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO,
-		.codeSize = shader_bytecode.size() * sizeof(uint32_t),
-		.pCode = shader_bytecode.data()
-	};
-	VK_CHECK(vkCreateShaderModule(device, &shader_module_info, nullptr, &shader));
-	return shader;
+inline VkDeviceSize AlignUp(VkDeviceSize value, VkDeviceSize alignment) {
+	return (value + (alignment - 1)) & ~(alignment - 1);
 }
 
-inline VkPipelineShaderStageCreateInfo PipelineShaderStageCreateInfo(VkDevice device, const char *path,
+inline VkPipelineShaderStageCreateInfo PipelineShaderStageCreateInfo(VkShaderModule module,
 	VkShaderStageFlagBits shader_stage) {
 	return VkPipelineShaderStageCreateInfo {
 		.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO,
 		.stage = shader_stage,
-		.module = VkUtils::CreateShaderModule(device, path, shader_stage),
+		.module = module,
 		.pName = "main"
 	};
 }
@@ -50,7 +22,8 @@ inline VkPipelineShaderStageCreateInfo PipelineShaderStageCreateInfo(VkDevice de
 inline void InsertImageBarrier(VkCommandBuffer command_buffer, VkImage image,
 	VkImageAspectFlags aspect_flags, VkImageLayout old_layout, VkImageLayout new_layout,
 	VkPipelineStageFlags src_stage, VkPipelineStageFlags dst_stage,
-	VkAccessFlags src_access, VkAccessFlags dst_access) {
+	VkAccessFlags src_access, VkAccessFlags dst_access,
+	uint32_t base_mip_level = 0, uint32_t level_count = 1) {
 	VkImageMemoryBarrier image_memory_barrier {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER,
 		.srcAccessMask = src_access,
@@ -60,8 +33,8 @@ inline void InsertImageBarrier(VkCommandBuffer command_buffer, VkImage image,
 		.image = image,
 		.subresourceRange = VkImageSubresourceRange {
 			.aspectMask = aspect_flags,
-			.baseMipLevel = 0,
-			.levelCount = 1,
+			.baseMipLevel = base_mip_level,
+			.levelCount = level_count,
 			.baseArrayLayer = 0,
 			.layerCount = 1
 		}
@@ -147,8 +120,54 @@ inline uint32_t FormatStride(VkFormat format) {
 	}
 }
 
+inline bool IsBlockCompressedFormat(VkFormat format) {
+	return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+}
+
+// Bytes per 4x4 block
+inline uint32_t CompressedBlockSize(VkFormat format) {
+	switch(format) {
+	case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+	case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+	case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+	case VK_FORMAT_BC4_UNORM_BLOCK:
+	case VK_FORMAT_BC4_SNORM_BLOCK:
+		return 8;
+	default:
+		assert(IsBlockCompressedFormat(format));
+		return 16;
+	}
+}
+
+// Size of a single, tightly packed mip level
+inline VkDeviceSize ImageLevelSize(VkFormat format, uint32_t width, uint32_t height) {
+	if(IsBlockCompressedFormat(format)) {
+		return static_cast<VkDeviceSize>((width + 3) / 4) * ((height + 3) / 4) * CompressedBlockSize(format);
+	}
+	return static_cast<VkDeviceSize>(width) * height * FormatStride(format);
+}
+
+// Size of the first mip_levels levels of an image, stored back to back
+inline VkDeviceSize ImageDataSize(VkFormat format, uint32_t width, uint32_t height, uint32_t mip_levels = 1) {
+	VkDeviceSize size = 0;
+	for(uint32_t i = 0; i < mip_levels; ++i) {
+		size += ImageLevelSize(format, std::max(width >> i, 1u), std::max(height >> i, 1u));
+	}
+	return size;
+}
+
+// Number of levels in a full mip chain down to 1x1
+inline uint32_t MipLevelCount(uint32_t width, uint32_t height) {
+	uint32_t levels = 1;
+	for(uint32_t size = std::max(width, height); size > 1; size >>= 1) {
+		levels++;
+	}
+	return levels;
+}
+
 inline VkImageCreateInfo ImageCreateInfo2D(uint32_t width, uint32_t height, VkFormat format, 
-	VkImageUsageFlags usage, VkSampleCountFlagBits sample_count = VK_SAMPLE_COUNT_1_BIT) {
+	VkImageUsageFlags usage, VkSampleCountFlagBits sample_count = VK_SAMPLE_COUNT_1_BIT, uint32_t mip_levels = 1) {
 	return VkImageCreateInfo {
 		.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO,
 		.imageType = VK_IMAGE_TYPE_2D,
@@ -158,7 +177,7 @@ inline VkImageCreateInfo ImageCreateInfo2D(uint32_t width, uint32_t height, VkFo
 			.height = height,
 			.depth = 1
 		},
-		.mipLevels = 1,
+		.mipLevels = mip_levels,
 		.arrayLayers = 1,
 		.samples = sample_count,
 		.tiling = VK_IMAGE_TILING_OPTIMAL,
@@ -168,7 +187,7 @@ inline VkImageCreateInfo ImageCreateInfo2D(uint32_t width, uint32_t height, VkFo
 	};
 }
 
-inline VkImageViewCreateInfo ImageViewCreateInfo2D(VkImage image, VkFormat format) {
+inline VkImageViewCreateInfo ImageViewCreateInfo2D(VkImage image, VkFormat format, uint32_t mip_levels = 1) {
 	VkImageAspectFlags aspect_mask = VkUtils::IsDepthFormat(format) ?
 		VK_IMAGE_ASPECT_DEPTH_BIT :
 		VK_IMAGE_ASPECT_COLOR_BIT;
@@ -185,7 +204,7 @@ inline VkImageViewCreateInfo ImageViewCreateInfo2D(VkImage image, VkFormat forma
 		},
 		.subresourceRange = VkImageSubresourceRange {
 			.aspectMask = aspect_mask,
-			.levelCount = 1,
+			.levelCount = mip_levels,
 			.layerCount = 1
 		}
 	};
@@ -213,11 +232,12 @@ inline VkBufferCreateInfo BufferCreateInfo(VkDeviceSize size, VkBufferUsageFlags
 	};
 }
 
-inline MappedBuffer CreateMappedBuffer(VmaAllocator allocator, VkBufferCreateInfo buffer_info) {
+inline MappedBuffer CreateMappedBuffer(VmaAllocator allocator, VkBufferCreateInfo buffer_info,
+	VmaMemoryUsage memory_usage = VMA_MEMORY_USAGE_CPU_TO_GPU) {
 	MappedBuffer buffer;
 	VmaAllocationCreateInfo buffer_alloc_info {
 		.flags = VMA_ALLOCATION_CREATE_MAPPED_BIT,
-		.usage = VMA_MEMORY_USAGE_CPU_TO_GPU
+		.usage = memory_usage
 	};
 	vmaCreateBuffer(allocator, &buffer_info, &buffer_alloc_info,
 		&buffer.handle, &buffer.allocation, nullptr);
@@ -0,0 +1,256 @@
+#include "pch.h"
+#include "mesh_optimizer.h"
+
+namespace MeshOptimizer {
+// Simulates a FIFO cache with timestamps, a vertex is cached if it was inserted within
+// the last VERTEX_CACHE_SIZE insertions. Hits don't refresh a vertex' position.
+struct CacheSimulation {
+	std::vector<uint32_t> timestamps;
+	uint32_t timestamp = VERTEX_CACHE_SIZE + 1;
+
+	explicit CacheSimulation(size_t vertex_count) : timestamps(vertex_count, 0) {}
+
+	// Returns true on a miss
+	bool Access(uint32_t vertex) {
+		if(timestamp - timestamps[vertex] > VERTEX_CACHE_SIZE) {
+			timestamps[vertex] = timestamp++;
+			return true;
+		}
+		return false;
+	}
+
+	void Flush() {
+		timestamp += VERTEX_CACHE_SIZE + 1;
+	}
+};
+
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t *indices, size_t index_count, size_t vertex_count) {
+	CacheSimulation cache(vertex_count);
+	std::vector<uint8_t> referenced(vertex_count, 0);
+	uint32_t vertices_transformed = 0;
+	uint32_t vertices_referenced = 0;
+	for(size_t i = 0; i < index_count; ++i) {
+		vertices_transformed += cache.Access(indices[i]);
+		vertices_referenced += !referenced[indices[i]];
+		referenced[indices[i]] = 1;
+	}
+
+	size_t triangle_count = index_count / 3;
+	return VertexCacheStatistics {
+		.vertices_transformed = vertices_transformed,
+		.acmr = triangle_count ? static_cast<float>(vertices_transformed) / triangle_count : 0.0f,
+		.atvr = vertices_referenced ? static_cast<float>(vertices_transformed) / vertices_referenced : 0.0f
+	};
+}
+
+void OptimizeVertexCache(uint32_t *indices, size_t index_count, size_t vertex_count) {
+	size_t triangle_count = index_count / 3;
+	if(triangle_count == 0) {
+		return;
+	}
+
+	// Triangles adjacent to every vertex, and how many of them are yet to be emitted
+	std::vector<uint32_t> live_triangles(vertex_count, 0);
+	for(size_t i = 0; i < index_count; ++i) {
+		live_triangles[indices[i]]++;
+	}
+	std::vector<uint32_t> adjacency_offsets(vertex_count + 1, 0);
+	for(size_t v = 0; v < vertex_count; ++v) {
+		adjacency_offsets[v + 1] = adjacency_offsets[v] + live_triangles[v];
+	}
+	std::vector<uint32_t> adjacency(index_count);
+	std::vector<uint32_t> adjacency_fill(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
+	for(size_t i = 0; i < index_count; ++i) {
+		adjacency[adjacency_fill[indices[i]]++] = static_cast<uint32_t>(i / 3);
+	}
+
+	std::vector<uint32_t> cache_timestamps(vertex_count, 0);
+	uint32_t timestamp = VERTEX_CACHE_SIZE + 1;
+	std::vector<uint8_t> emitted(triangle_count, 0);
+	std::vector<uint32_t> dead_end_stack;
+	std::vector<uint32_t> candidates;
+	std::vector<uint32_t> output;
+	output.reserve(triangle_count * 3);
+
+	// Falls back to recently used vertices first, then scans the input in order
+	uint32_t input_cursor = 0;
+	auto skip_dead_end = [&]() -> int64_t {
+		while(!dead_end_stack.empty()) {
+			uint32_t vertex = dead_end_stack.back();
+			dead_end_stack.pop_back();
+			if(live_triangles[vertex] > 0) {
+				return vertex;
+			}
+		}
+		for(; input_cursor < vertex_count; ++input_cursor) {
+			if(live_triangles[input_cursor] > 0) {
+				return input_cursor;
+			}
+		}
+		return -1;
+	};
+
+	int64_t fanning_vertex = skip_dead_end();
+	while(fanning_vertex >= 0) {
+		candidates.clear();
+		for(uint32_t a = adjacency_offsets[fanning_vertex]; a < adjacency_offsets[fanning_vertex + 1]; ++a) {
+			uint32_t triangle = adjacency[a];
+			if(emitted[triangle]) {
+				continue;
+			}
+			emitted[triangle] = 1;
+			for(int k = 0; k < 3; ++k) {
+				uint32_t vertex = indices[triangle * 3 + k];
+				output.push_back(vertex);
+				dead_end_stack.push_back(vertex);
+				candidates.push_back(vertex);
+				live_triangles[vertex]--;
+				if(timestamp - cache_timestamps[vertex] > VERTEX_CACHE_SIZE) {
+					cache_timestamps[vertex] = timestamp++;
+				}
+			}
+		}
+
+		// Prefer the oldest candidate that stays in the cache while all its remaining triangles are emitted.
+		// Any candidate with live triangles wins over the dead-end stack, whatever its priority.
+		int64_t next_vertex = -1;
+		int64_t best_priority = INT64_MIN;
+		for(uint32_t vertex : candidates) {
+			if(live_triangles[vertex] == 0) {
+				continue;
+			}
+			int64_t priority = 0;
+			uint32_t age = timestamp - cache_timestamps[vertex];
+			if(age + 2 * live_triangles[vertex] <= VERTEX_CACHE_SIZE) {
+				priority = age;
+			}
+			if(priority > best_priority) {
+				best_priority = priority;
+				next_vertex = vertex;
+			}
+		}
+		fanning_vertex = next_vertex >= 0 ? next_vertex : skip_dead_end();
+	}
+
+	memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+void OptimizeOverdraw(uint32_t *indices, size_t index_count, const float *positions, size_t position_stride,
+	size_t vertex_count, float threshold) {
+	size_t triangle_count = index_count / 3;
+	if(triangle_count == 0) {
+		return;
+	}
+
+	auto position = [&](uint32_t vertex) {
+		return glm::make_vec3(reinterpret_cast<const float *>(reinterpret_cast<const uint8_t *>(positions) +
+			vertex * position_stride));
+	};
+	auto triangle_misses = [&](CacheSimulation &cache, size_t triangle) {
+		return cache.Access(indices[triangle * 3 + 0]) + cache.Access(indices[triangle * 3 + 1]) +
+			cache.Access(indices[triangle * 3 + 2]);
+	};
+
+	// Hard boundaries are where the cache optimized order had nothing cached anymore
+	std::vector<uint32_t> hard_clusters;
+	CacheSimulation cache(vertex_count);
+	for(size_t t = 0; t < triangle_count; ++t) {
+		if(triangle_misses(cache, t) == 3 || t == 0) {
+			hard_clusters.push_back(static_cast<uint32_t>(t));
+		}
+	}
+
+	// Split further wherever the running ACMR of a cluster is already within threshold of the whole cluster
+	std::vector<uint32_t> clusters;
+	for(size_t c = 0; c < hard_clusters.size(); ++c) {
+		size_t start = hard_clusters[c];
+		size_t end = c + 1 < hard_clusters.size() ? hard_clusters[c + 1] : triangle_count;
+
+		cache.Flush();
+		uint32_t cluster_misses = 0;
+		for(size_t t = start; t < end; ++t) {
+			cluster_misses += triangle_misses(cache, t);
+		}
+		float cluster_threshold = threshold * cluster_misses / (end - start);
+
+		cache.Flush();
+		clusters.push_back(static_cast<uint32_t>(start));
+		size_t split_start = start;
+		uint32_t split_misses = 0;
+		for(size_t t = start; t < end; ++t) {
+			split_misses += triangle_misses(cache, t);
+			if(t + 1 < end && static_cast<float>(split_misses) / (t + 1 - split_start) <= cluster_threshold) {
+				clusters.push_back(static_cast<uint32_t>(t + 1));
+				cache.Flush();
+				split_start = t + 1;
+				split_misses = 0;
+			}
+		}
+	}
+
+	glm::vec3 mesh_centroid(0.0f);
+	for(size_t i = 0; i < index_count; ++i) {
+		mesh_centroid += position(indices[i]);
+	}
+	mesh_centroid /= static_cast<float>(index_count);
+
+	// Clusters facing away from the mesh center are drawn first, as they are likely to occlude the rest
+	std::vector<float> sort_keys(clusters.size());
+	for(size_t c = 0; c < clusters.size(); ++c) {
+		size_t start = clusters[c];
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+
+		glm::vec3 centroid(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		for(size_t t = start; t < end; ++t) {
+			glm::vec3 p0 = position(indices[t * 3 + 0]);
+			glm::vec3 p1 = position(indices[t * 3 + 1]);
+			glm::vec3 p2 = position(indices[t * 3 + 2]);
+			glm::vec3 triangle_normal = glm::cross(p1 - p0, p2 - p0);
+			float triangle_area = glm::length(triangle_normal);
+			centroid += (p0 + p1 + p2) * (triangle_area / 3.0f);
+			normal += triangle_normal;
+			area += triangle_area;
+		}
+		centroid = area > 0.0f ? centroid / area : centroid;
+		float normal_length = glm::length(normal);
+		normal = normal_length > 0.0f ? normal / normal_length : normal;
+		sort_keys[c] = glm::dot(centroid - mesh_centroid, normal);
+	}
+
+	std::vector<uint32_t> cluster_order(clusters.size());
+	std::iota(cluster_order.begin(), cluster_order.end(), 0);
+	std::stable_sort(cluster_order.begin(), cluster_order.end(), [&](uint32_t a, uint32_t b) {
+		return sort_keys[a] > sort_keys[b];
+	});
+
+	std::vector<uint32_t> output;
+	output.reserve(triangle_count * 3);
+	for(uint32_t c : cluster_order) {
+		size_t start = clusters[c];
+		size_t end = c + 1 < clusters.size() ? clusters[c + 1] : triangle_count;
+		output.insert(output.end(), indices + start * 3, indices + end * 3);
+	}
+	memcpy(indices, output.data(), output.size() * sizeof(uint32_t));
+}
+
+std::vector<uint32_t> OptimizeVertexFetchRemap(uint32_t *indices, size_t index_count, size_t vertex_count) {
+	constexpr uint32_t UNASSIGNED = ~0u;
+	std::vector<uint32_t> remap(vertex_count, UNASSIGNED);
+	uint32_t next_vertex = 0;
+	for(size_t i = 0; i < index_count; ++i) {
+		uint32_t &new_index = remap[indices[i]];
+		if(new_index == UNASSIGNED) {
+			new_index = next_vertex++;
+		}
+		indices[i] = new_index;
+	}
+	for(uint32_t &new_index : remap) {
+		if(new_index == UNASSIGNED) {
+			new_index = next_vertex++;
+		}
+	}
+	return remap;
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Reorders the triangles and vertices of indexed triangle lists for the post-transform
+// vertex cache, overdraw and vertex fetch locality. Triangle and vertex counts are preserved,
+// so optimized geometry occupies exactly the same ranges as the input.
+namespace MeshOptimizer {
+// FIFO cache size the optimization and analysis are tuned for
+inline constexpr uint32_t VERTEX_CACHE_SIZE = 16;
+
+struct VertexCacheStatistics {
+	uint32_t vertices_transformed;
+	// Average cache miss ratio, transformed vertices per triangle
+	float acmr;
+	// Average transform to vertex ratio, transformed vertices per referenced vertex
+	float atvr;
+};
+
+VertexCacheStatistics AnalyzeVertexCache(const uint32_t *indices, size_t index_count, size_t vertex_count);
+
+// Tipsify (Sander et al. 2007)
+void OptimizeVertexCache(uint32_t *indices, size_t index_count, size_t vertex_count);
+
+// Splits vertex cache optimized triangles into clusters and sorts them front to back from the
+// outside of the mesh. threshold bounds how far the ACMR may degrade, e.g. 1.05 allows 5%.
+void OptimizeOverdraw(uint32_t *indices, size_t index_count, const float *positions, size_t position_stride,
+	size_t vertex_count, float threshold);
+
+// Renumbers vertices in order of first use and rewrites the indices. Returns the new position of
+// every vertex, unreferenced vertices are moved to the end.
+std::vector<uint32_t> OptimizeVertexFetchRemap(uint32_t *indices, size_t index_count, size_t vertex_count);
+
+template<typename T>
+void RemapVertices(std::vector<T> &vertices, const std::vector<uint32_t> &remap) {
+	std::vector<T> remapped(vertices.size());
+	for(size_t i = 0; i < vertices.size(); ++i) {
+		remapped[remap[i]] = vertices[i];
+	}
+	vertices.swap(remapped);
+}
+}
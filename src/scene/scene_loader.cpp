@@ -3,17 +3,19 @@
 
 #include "rendering_backend/resource_manager.h"
 #include "rendering_backend/vulkan_utils.h"
+#include "scene/mesh_optimizer.h"
+#include "scene/texture_cooker.h"
 
 namespace SceneLoader {
 VkFilter GetVkFilter(cgltf_int filter) {
 	switch(filter) {
-	case 0x2600:
-	case 0x2700:
-	case 0x2701:
+	case 0x2600: // NEAREST
+	case 0x2700: // NEAREST_MIPMAP_NEAREST
+	case 0x2702: // NEAREST_MIPMAP_LINEAR
 		return VK_FILTER_NEAREST;
-	case 0x2601:
-	case 0x2702:
-	case 0x2703:
+	case 0x2601: // LINEAR
+	case 0x2701: // LINEAR_MIPMAP_NEAREST
+	case 0x2703: // LINEAR_MIPMAP_LINEAR
 		return VK_FILTER_LINEAR;
 	default:
 		assert(false);
@@ -21,6 +23,18 @@ VkFilter GetVkFilter(cgltf_int filter) {
 	}
 }
 
+// Every scene texture gets a full mip chain, so minification filters without a
+// mipmap mode still interpolate between levels instead of sampling level 0.
+VkSamplerMipmapMode GetVkMipmapMode(cgltf_int min_filter) {
+	switch(min_filter) {
+	case 0x2700: // NEAREST_MIPMAP_NEAREST
+	case 0x2701: // LINEAR_MIPMAP_NEAREST
+		return VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	default:
+		return VK_SAMPLER_MIPMAP_MODE_LINEAR;
+	}
+}
+
 VkSamplerAddressMode GetVkAddressMode(cgltf_int address_mode) {
 	switch(address_mode) {
 	case 0x812F:
@@ -37,8 +51,391 @@ VkSamplerAddressMode GetVkAddressMode(cgltf_int address_mode) {
 	}
 }
 
-void ParseNode(cgltf_node &node, Scene &scene, std::unordered_map<const char *, int> &textures, 
-	std::vector<Vertex> &vertices, std::vector<uint32_t> &indices) {
+// Scene textures are block compressed on first load and read back from the cache afterwards.
+// When disabled, textures are uploaded as RGBA8 and their mips are generated on the GPU.
+constexpr bool COOK_TEXTURES = true;
+constexpr TextureCooker::CookQuality TEXTURE_COOK_QUALITY = TextureCooker::CookQuality::Normal;
+constexpr const char *COOKED_TEXTURE_DIRECTORY = "data/cooked_textures/";
+
+struct TextureToUpload {
+	cgltf_texture *texture;
+	VkFormat format;
+	TextureCooker::TextureUsage usage;
+};
+
+std::vector<uint8_t> ReadImageFile(const cgltf_image *image, const std::string &parent_path) {
+	std::vector<uint8_t> bytes;
+	if(image->uri) {
+		std::ifstream file(parent_path + image->uri, std::ios::binary | std::ios::ate);
+		if(!file.is_open()) {
+			return bytes;
+		}
+		bytes.resize(static_cast<size_t>(file.tellg()));
+		file.seekg(0);
+		file.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+	}
+	else {
+		const uint8_t *buffer = reinterpret_cast<const uint8_t *>(image->buffer_view->buffer->data) +
+			image->buffer_view->offset;
+		bytes.assign(buffer, buffer + image->buffer_view->size);
+	}
+	return bytes;
+}
+
+// Cache entries are keyed on the encoded source image, so renamed or shared files still hit
+std::string GetCookedTexturePath(const std::vector<uint8_t> &image_file, TextureCooker::TextureUsage usage) {
+	uint64_t hash = 0xcbf29ce484222325;
+	auto hash_byte = [&hash](uint8_t byte) {
+		hash ^= byte;
+		hash *= 0x100000001b3;
+	};
+	for(uint8_t byte : image_file) {
+		hash_byte(byte);
+	}
+	hash_byte(static_cast<uint8_t>(usage));
+	hash_byte(static_cast<uint8_t>(TEXTURE_COOK_QUALITY));
+	hash_byte(static_cast<uint8_t>(TextureCooker::COOKED_TEXTURE_VERSION));
+
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.tex", static_cast<unsigned long long>(hash));
+	return std::string(COOKED_TEXTURE_DIRECTORY) + name;
+}
+
+// When enabled along with LOG_STATISTICS, every scene load also decodes all geometry through the
+// per-element cgltf path and prints the timings of both paths.
+constexpr bool BENCHMARK_GEOMETRY_DECODING = false;
+
+// Triangles and vertices of every primitive are reordered for the vertex cache, overdraw and
+// vertex fetch locality. The per-primitive ACMR/ATVR before and after can be printed on load.
+constexpr bool OPTIMIZE_MESHES = true;
+constexpr bool OPTIMIZE_OVERDRAW = true;
+constexpr float OVERDRAW_ACMR_THRESHOLD = 1.05f;
+constexpr bool REPORT_MESH_OPTIMIZATION = false;
+
+// Primitives with up to this many vertices get 16-bit indices
+constexpr size_t MAX_16BIT_INDEXED_VERTICES = 1 << 16;
+
+// Full precision vertex as read from glTF, quantized into a Vertex once a primitive is decoded
+struct DecodedVertex {
+	glm::vec3 pos;
+	glm::vec3 normal;
+	glm::vec4 tangent;
+	glm::vec2 uv0;
+};
+
+// TEXCOORD_1 is skipped, no material in the renderer reads a second UV set
+struct PrimitiveAccessors {
+	cgltf_accessor *position;
+	cgltf_accessor *normal;
+	cgltf_accessor *tangent;
+	cgltf_accessor *uv0;
+};
+
+PrimitiveAccessors GetPrimitiveAccessors(const cgltf_primitive &primitive) {
+	PrimitiveAccessors accessors {};
+	for(int i = 0; i < primitive.attributes_count; ++i) {
+		cgltf_accessor *accessor = primitive.attributes[i].data;
+
+		if(primitive.attributes[i].type == cgltf_attribute_type_position) {
+			accessors.position = accessor;
+			assert(accessor->type == cgltf_type_vec3);
+		}
+		else if(primitive.attributes[i].type == cgltf_attribute_type_normal) {
+			accessors.normal = accessor;
+			assert(accessor->type == cgltf_type_vec3);
+		}
+		else if(primitive.attributes[i].type == cgltf_attribute_type_tangent) {
+			accessors.tangent = accessor;
+			assert(accessor->type == cgltf_type_vec4);
+		}
+		else if(primitive.attributes[i].type == cgltf_attribute_type_texcoord) {
+			if(primitive.attributes[i].index == 0) {
+				accessors.uv0 = accessor;
+				assert(accessor->type == cgltf_type_vec2);
+			}
+		}
+	}
+	assert(accessors.position);
+	return accessors;
+}
+
+// Returns the first element of a non-sparse accessor, or nullptr if the data isn't directly addressable.
+const uint8_t *GetAccessorData(const cgltf_accessor *accessor) {
+	if(accessor->is_sparse || !accessor->buffer_view) {
+		return nullptr;
+	}
+	const cgltf_buffer_view *view = accessor->buffer_view;
+	if(view->data) {
+		return reinterpret_cast<const uint8_t *>(view->data) + accessor->offset;
+	}
+	if(view->buffer->data) {
+		return reinterpret_cast<const uint8_t *>(view->buffer->data) + view->offset + accessor->offset;
+	}
+	return nullptr;
+}
+
+// Widens up to four normalized integer components to float. The scale factors match
+// cgltf_accessor_read_float so both decoding paths produce bit-identical results.
+__m128 LoadNormalizedElement(const uint8_t *element, cgltf_component_type component_type, uint32_t components) {
+	switch(component_type) {
+	case cgltf_component_type_r_8u: {
+		uint32_t packed = 0;
+		memcpy(&packed, element, components);
+		__m128i v = _mm_cvtsi32_si128(packed);
+		v = _mm_unpacklo_epi16(_mm_unpacklo_epi8(v, _mm_setzero_si128()), _mm_setzero_si128());
+		return _mm_div_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(255.0f));
+	}
+	case cgltf_component_type_r_8: {
+		uint32_t packed = 0;
+		memcpy(&packed, element, components);
+		__m128i v = _mm_cvtsi32_si128(packed);
+		// Replicate each byte into the top of its lane, then shift down arithmetically to sign extend
+		v = _mm_unpacklo_epi8(v, v);
+		v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 24);
+		return _mm_div_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(127.0f));
+	}
+	case cgltf_component_type_r_16u: {
+		uint64_t packed = 0;
+		memcpy(&packed, element, components * sizeof(uint16_t));
+		__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&packed));
+		v = _mm_unpacklo_epi16(v, _mm_setzero_si128());
+		return _mm_div_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(65535.0f));
+	}
+	case cgltf_component_type_r_16: {
+		uint64_t packed = 0;
+		memcpy(&packed, element, components * sizeof(uint16_t));
+		__m128i v = _mm_loadl_epi64(reinterpret_cast<const __m128i *>(&packed));
+		v = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+		return _mm_div_ps(_mm_cvtepi32_ps(v), _mm_set1_ps(32767.0f));
+	}
+	default:
+		assert(false);
+		return _mm_setzero_ps();
+	}
+}
+
+template<size_t N>
+void CopyStridedElements(const uint8_t *src, size_t src_stride, uint8_t *dst, size_t dst_stride, size_t count) {
+	for(size_t i = 0; i < count; ++i) {
+		memcpy(dst + i * dst_stride, src + i * src_stride, N);
+	}
+}
+
+// Converts a whole float or normalized integer accessor into a strided float destination.
+// Returns false if the accessor isn't covered by the bulk path and has to go through cgltf.
+bool BulkReadFloats(const cgltf_accessor *accessor, uint32_t components, float *dst, size_t dst_stride) {
+	const uint8_t *src = GetAccessorData(accessor);
+	if(!src || cgltf_num_components(accessor->type) != components) {
+		return false;
+	}
+
+	uint8_t *out = reinterpret_cast<uint8_t *>(dst);
+	if(accessor->component_type == cgltf_component_type_r_32f) {
+		switch(components) {
+		case 2: CopyStridedElements<8>(src, accessor->stride, out, dst_stride, accessor->count); return true;
+		case 3: CopyStridedElements<12>(src, accessor->stride, out, dst_stride, accessor->count); return true;
+		case 4: CopyStridedElements<16>(src, accessor->stride, out, dst_stride, accessor->count); return true;
+		default: return false;
+		}
+	}
+
+	// Unnormalized integer attributes (KHR_mesh_quantization) and 32-bit integers are left to cgltf
+	if(!accessor->normalized || accessor->component_type == cgltf_component_type_r_32u) {
+		return false;
+	}
+
+	alignas(16) float converted[4];
+	for(size_t i = 0; i < accessor->count; ++i) {
+		_mm_store_ps(converted, LoadNormalizedElement(src + i * accessor->stride, accessor->component_type, components));
+		memcpy(out + i * dst_stride, converted, components * sizeof(float));
+	}
+	return true;
+}
+
+void DecodeAttribute(const cgltf_accessor *accessor, uint32_t components, float *dst) {
+	if(!accessor || BulkReadFloats(accessor, components, dst, sizeof(DecodedVertex))) {
+		return;
+	}
+	uint8_t *out = reinterpret_cast<uint8_t *>(dst);
+	for(int i = 0; i < accessor->count; ++i) {
+		cgltf_accessor_read_float(accessor, i, reinterpret_cast<cgltf_float *>(out + i * sizeof(DecodedVertex)), components);
+	}
+}
+
+// Decodes all attributes of a primitive into a presized, zero-initialized vertex range.
+void DecodeVertices(const PrimitiveAccessors &accessors, DecodedVertex *dst) {
+	DecodeAttribute(accessors.position, 3, glm::value_ptr(dst->pos));
+	DecodeAttribute(accessors.normal, 3, glm::value_ptr(dst->normal));
+	DecodeAttribute(accessors.tangent, 4, glm::value_ptr(dst->tangent));
+	DecodeAttribute(accessors.uv0, 2, glm::value_ptr(dst->uv0));
+}
+
+// Maps a direction onto the [-1, 1] square of an octahedron unfolded around +Z
+glm::vec2 EncodeOctahedral(glm::vec3 v) {
+	float l1_norm = std::abs(v.x) + std::abs(v.y) + std::abs(v.z);
+	if(l1_norm == 0.0f) {
+		return glm::vec2(0.0f);
+	}
+	glm::vec2 encoded = glm::vec2(v) / l1_norm;
+	if(v.z < 0.0f) {
+		encoded = (1.0f - glm::abs(glm::vec2(encoded.y, encoded.x))) *
+			glm::vec2(encoded.x >= 0.0f ? 1.0f : -1.0f, encoded.y >= 0.0f ? 1.0f : -1.0f);
+	}
+	return encoded;
+}
+
+// Inverse of decode_tangent in glsl_common.h
+uint32_t PackTangent(glm::vec4 tangent) {
+	glm::vec2 encoded = glm::clamp(EncodeOctahedral(glm::vec3(tangent)), -1.0f, 1.0f);
+	uint32_t x = static_cast<uint16_t>(static_cast<int16_t>(std::round(encoded.x * 32767.0f)));
+	uint32_t y = static_cast<uint32_t>(static_cast<int32_t>(std::round(encoded.y * 16383.0f))) & 0x7FFF;
+	return x | (y << 16) | (tangent.w < 0.0f ? 0x80000000u : 0u);
+}
+
+void QuantizeVertices(const DecodedVertex *src, size_t count, Vertex *dst) {
+	for(size_t i = 0; i < count; ++i) {
+		dst[i] = Vertex {
+			.pos = src[i].pos,
+			.normal = glm::packSnorm2x16(EncodeOctahedral(src[i].normal)),
+			.tangent = PackTangent(src[i].tangent),
+			.uv0 = glm::packHalf2x16(src[i].uv0)
+		};
+	}
+}
+
+// Widens 8 and 16-bit index accessors to 32-bit, 16 and 8 indices at a time.
+void DecodeIndices(const cgltf_accessor *accessor, uint32_t *dst) {
+	const uint8_t *src = GetAccessorData(accessor);
+	size_t component_size = accessor->component_type == cgltf_component_type_r_8u ? 1 :
+		accessor->component_type == cgltf_component_type_r_16u ? 2 : 4;
+	if(!src || accessor->stride != component_size) {
+		for(int i = 0; i < accessor->count; ++i) {
+			dst[i] = static_cast<uint32_t>(cgltf_accessor_read_index(accessor, i));
+		}
+		return;
+	}
+
+	size_t count = accessor->count;
+	size_t i = 0;
+	__m128i zero = _mm_setzero_si128();
+	switch(accessor->component_type) {
+	case cgltf_component_type_r_8u:
+		for(; i + 16 <= count; i += 16) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i));
+			__m128i lo = _mm_unpacklo_epi8(v, zero);
+			__m128i hi = _mm_unpackhi_epi8(v, zero);
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi16(lo, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), _mm_unpackhi_epi16(lo, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 8), _mm_unpacklo_epi16(hi, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 12), _mm_unpackhi_epi16(hi, zero));
+		}
+		for(; i < count; ++i) {
+			dst[i] = src[i];
+		}
+		break;
+	case cgltf_component_type_r_16u:
+		for(; i + 8 <= count; i += 8) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(src + i * sizeof(uint16_t)));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i), _mm_unpacklo_epi16(v, zero));
+			_mm_storeu_si128(reinterpret_cast<__m128i *>(dst + i + 4), _mm_unpackhi_epi16(v, zero));
+		}
+		for(; i < count; ++i) {
+			uint16_t index;
+			memcpy(&index, src + i * sizeof(uint16_t), sizeof(uint16_t));
+			dst[i] = index;
+		}
+		break;
+	case cgltf_component_type_r_32u:
+		memcpy(dst, src, count * sizeof(uint32_t));
+		break;
+	default:
+		assert(false && "Unsupported index component type");
+	}
+}
+
+// Per-element decoding through cgltf, used as the baseline in BenchmarkGeometryDecoding.
+void DecodeVerticesReference(const PrimitiveAccessors &accessors, DecodedVertex *dst) {
+	for(int i = 0; i < accessors.position->count; ++i) {
+		DecodedVertex v {};
+		cgltf_accessor_read_float(accessors.position, i, glm::value_ptr(v.pos), 3);
+		if(accessors.normal) {
+			cgltf_accessor_read_float(accessors.normal, i, glm::value_ptr(v.normal), 3);
+		}
+		if(accessors.tangent) {
+			cgltf_accessor_read_float(accessors.tangent, i, glm::value_ptr(v.tangent), 4);
+		}
+		if(accessors.uv0) {
+			cgltf_accessor_read_float(accessors.uv0, i, glm::value_ptr(v.uv0), 2);
+		}
+		dst[i] = v;
+	}
+}
+
+void BenchmarkGeometryDecoding(const cgltf_data *data) {
+	size_t vertex_count = 0;
+	size_t index_count = 0;
+	for(int i = 0; i < data->meshes_count; ++i) {
+		for(int j = 0; j < data->meshes[i].primitives_count; ++j) {
+			vertex_count += GetPrimitiveAccessors(data->meshes[i].primitives[j]).position->count;
+			index_count += data->meshes[i].primitives[j].indices->count;
+		}
+	}
+
+	std::vector<DecodedVertex> reference_vertices(vertex_count);
+	std::vector<uint32_t> reference_indices(index_count);
+	std::vector<DecodedVertex> bulk_vertices(vertex_count);
+	std::vector<uint32_t> bulk_indices(index_count);
+
+	auto decode_all = [&](bool bulk, DecodedVertex *vertices, uint32_t *indices) {
+		auto start = std::chrono::high_resolution_clock::now();
+		for(int i = 0; i < data->meshes_count; ++i) {
+			for(int j = 0; j < data->meshes[i].primitives_count; ++j) {
+				const cgltf_primitive &primitive = data->meshes[i].primitives[j];
+				PrimitiveAccessors accessors = GetPrimitiveAccessors(primitive);
+				if(bulk) {
+					DecodeVertices(accessors, vertices);
+					DecodeIndices(primitive.indices, indices);
+				}
+				else {
+					DecodeVerticesReference(accessors, vertices);
+					for(int k = 0; k < primitive.indices->count; ++k) {
+						indices[k] = static_cast<uint32_t>(cgltf_accessor_read_index(primitive.indices, k));
+					}
+				}
+				vertices += accessors.position->count;
+				indices += primitive.indices->count;
+			}
+		}
+		return std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+	};
+
+	double reference_ms = decode_all(false, reference_vertices.data(), reference_indices.data());
+	double bulk_ms = decode_all(true, bulk_vertices.data(), bulk_indices.data());
+
+	bool identical = !memcmp(reference_vertices.data(), bulk_vertices.data(), vertex_count * sizeof(DecodedVertex)) &&
+		!memcmp(reference_indices.data(), bulk_indices.data(), index_count * sizeof(uint32_t));
+	printf("Geometry decoding (%zu vertices, %zu indices): per-element %.2f ms, bulk %.2f ms (%.1fx)%s\n",
+		vertex_count, index_count, reference_ms, bulk_ms, reference_ms / bulk_ms,
+		identical ? "" : ", OUTPUT MISMATCH");
+}
+
+// A primitive's accessors and the slices of the global vertex and index arrays it decodes into.
+// index_offset is in 16-bit units, like Primitive::index_offset.
+struct PrimitiveDecodeJob {
+	PrimitiveAccessors accessors;
+	cgltf_accessor *indices;
+	uint32_t vertex_offset;
+	uint32_t index_offset;
+	VkIndexType index_type;
+};
+
+// Builds the scene description for a node. The first node referencing a glTF mesh assigns its
+// primitives their geometry offsets by advancing vertex_count and index_count (in 16-bit units),
+// later nodes only add an instance. The geometry itself is decoded later in parallel.
+// Materials are added to scene.materials once per distinct contents, material_indices is keyed on their bytes.
+void ParseNode(cgltf_node &node, Scene &scene, std::unordered_map<const char *, int> &textures,
+	std::unordered_map<const cgltf_mesh *, uint32_t> &mesh_indices, std::unordered_map<std::string, uint32_t> &material_indices,
+	std::vector<PrimitiveDecodeJob> &decode_jobs, uint32_t &vertex_count, uint32_t &index_count) {
 
 	if(node.camera) {
 		assert(node.camera->type == cgltf_camera_type_perspective);
@@ -106,76 +503,42 @@ void ParseNode(cgltf_node &node, Scene &scene, std::unordered_map<const char *,
 	glm::mat4 transform;
 	cgltf_node_transform_world(&node, glm::value_ptr(transform));
 
-	Mesh mesh;
+	auto mesh_index = mesh_indices.find(node.mesh);
+	if(mesh_index != mesh_indices.end()) {
+		scene.meshes[mesh_index->second].instance_transforms.push_back(transform);
+		return;
+	}
+	mesh_indices[node.mesh] = static_cast<uint32_t>(scene.meshes.size());
+
+	Mesh mesh {
+		.instance_transforms = { transform }
+	};
 	for(int i = 0; i < node.mesh->primitives_count; ++i) {
 		cgltf_primitive *primitive = &node.mesh->primitives[i];
 		assert(primitive->type == cgltf_primitive_type_triangles);
 
-		uint32_t vertex_offset = static_cast<uint32_t>(vertices.size()); 
-		uint32_t index_offset = static_cast<uint32_t>(indices.size()); 
-
-		cgltf_accessor *position_accessor = nullptr;
-		cgltf_accessor *normal_accessor = nullptr;
-		cgltf_accessor *tangent_accessor = nullptr;
-		cgltf_accessor *uv0_accessor = nullptr;
-		cgltf_accessor *uv1_accessor = nullptr;
-
-		for(int j = 0; j < primitive->attributes_count; ++j) {
-			cgltf_accessor *accessor = primitive->attributes[j].data;
+		PrimitiveAccessors accessors = GetPrimitiveAccessors(*primitive);
+		assert(primitive->indices);
 
-			if(primitive->attributes[j].type == cgltf_attribute_type_position) {
-				position_accessor = accessor;
-				assert(accessor->type == cgltf_type_vec3);
-			}
-			else if(primitive->attributes[j].type == cgltf_attribute_type_normal) {
-				normal_accessor = accessor;
-				assert(accessor->type == cgltf_type_vec3);
-			}
-			else if(primitive->attributes[j].type == cgltf_attribute_type_tangent) {
-				tangent_accessor = accessor;
-				assert(accessor->type == cgltf_type_vec4);
-			}
-			else if(primitive->attributes[j].type == cgltf_attribute_type_texcoord) {
-				if(primitive->attributes[j].index == 0) {
-					uv0_accessor = accessor;
-				}
-				else if(primitive->attributes[j].index == 1) {
-					uv1_accessor = accessor;
-				}
-				assert(accessor->type == cgltf_type_vec2);
-			}
+		VkIndexType index_type = accessors.position->count <= MAX_16BIT_INDEXED_VERTICES ?
+			VK_INDEX_TYPE_UINT16 : VK_INDEX_TYPE_UINT32;
+		if(index_type == VK_INDEX_TYPE_UINT32) {
+			// Keep 32-bit index ranges 4-byte aligned
+			index_count = (index_count + 1) & ~1u;
 		}
 
-		assert(position_accessor);
-		for(int j = 0; j < position_accessor->count; ++j) {
-			Vertex v {};
-			cgltf_accessor_read_float(position_accessor, j, 
-				reinterpret_cast<cgltf_float *>(glm::value_ptr(v.pos)), 3);
-			if(normal_accessor) {
-				cgltf_accessor_read_float(normal_accessor, j, 
-					reinterpret_cast<cgltf_float *>(glm::value_ptr(v.normal)), 3);
-			}
-			if(tangent_accessor) {
-				cgltf_accessor_read_float(tangent_accessor, j,
-					reinterpret_cast<cgltf_float *>(glm::value_ptr(v.tangent)), 4);
-			}
-			if(uv0_accessor) {
-				cgltf_accessor_read_float(uv0_accessor, j, 
-					reinterpret_cast<cgltf_float *>(glm::value_ptr(v.uv0)), 2);
-			}
-			if(uv1_accessor) {
-				cgltf_accessor_read_float(uv1_accessor, j, 
-					reinterpret_cast<cgltf_float *>(glm::value_ptr(v.uv1)), 2);
-			}
-			vertices.emplace_back(v);
-		}
+		uint32_t vertex_offset = vertex_count;
+		uint32_t index_offset = index_count;
+		vertex_count += static_cast<uint32_t>(accessors.position->count);
+		index_count += static_cast<uint32_t>(primitive->indices->count) * (index_type == VK_INDEX_TYPE_UINT32 ? 2 : 1);
 
-		assert(primitive->indices);
-
-		for(int j = 0; j < primitive->indices->count; ++j) {
-			uint32_t index = static_cast<uint32_t>(cgltf_accessor_read_index(primitive->indices, j));
-			indices.emplace_back(index);
-		}
+		decode_jobs.push_back(PrimitiveDecodeJob {
+			.accessors = accessors,
+			.indices = primitive->indices,
+			.vertex_offset = vertex_offset,
+			.index_offset = index_offset,
+			.index_type = index_type
+		});
 
 		Material material {
 			.base_color = glm::vec4(1.0f),
@@ -211,19 +574,35 @@ void ParseNode(cgltf_node &node, Scene &scene, std::unordered_map<const char *,
 			material.normal_map = textures[primitive->material->normal_texture.texture->image->name];
 
 			// TODO: Handle case of no vertex tangents, but normal map present
-			assert(tangent_accessor);
+			assert(accessors.tangent);
 		}
+		// Blending isn't supported, blended materials drop their fully transparent texels. Opaque materials
+		// never discard, so the opaque depth passes and the ray traced geometry see the same surfaces.
 		if(primitive->material->alpha_mode == cgltf_alpha_mode_mask) {
 			material.alpha_mask = 1;
 			material.alpha_cutoff = primitive->material->alpha_cutoff;
 		}
+		else if(primitive->material->alpha_mode == cgltf_alpha_mode_blend) {
+			material.alpha_mask = 1;
+			material.alpha_cutoff = FLT_MIN;
+		}
+
+		// glTF materials often differ only by name, so primitives share materials by contents
+		std::string material_key(reinterpret_cast<const char *>(&material), sizeof(Material));
+		auto [material_index, inserted] = material_indices.try_emplace(material_key,
+			static_cast<uint32_t>(scene.materials.size()));
+		if(inserted) {
+			scene.materials.push_back(material);
+		}
 
 		mesh.primitives.push_back(Primitive {
-			.transform = transform,
-			.material = material,
+			.transform = 0,
+			.material = material_index->second,
 			.vertex_offset = vertex_offset,
+			.vertex_count = static_cast<uint32_t>(accessors.position->count),
 			.index_offset = index_offset,
-			.index_count = static_cast<uint32_t>(primitive->indices->count)
+			.index_count = static_cast<uint32_t>(primitive->indices->count),
+			.index_type = static_cast<uint32_t>(index_type)
 		});
 	}
 
@@ -238,7 +617,7 @@ void ParseglTF(ResourceManager &resource_manager, const char *path, cgltf_data *
 
 	// Collect all textures from model, and associate the correct format to them.
 	// This is instead of doing the SRGB to linear conversion in the shaders.
-	std::vector<std::pair<cgltf_texture *, VkFormat>> textures_to_upload;
+	std::vector<TextureToUpload> textures_to_upload;
 	std::unordered_set<cgltf_texture *> texture_set;
 	for(int i = 0; i < data->meshes_count; ++i) {
 		for(int j = 0; j < data->meshes[i].primitives_count; ++j) {
@@ -246,72 +625,184 @@ void ParseglTF(ResourceManager &resource_manager, const char *path, cgltf_data *
 				cgltf_pbr_metallic_roughness *metallic_roughness = &data->meshes[i].primitives[j].material->pbr_metallic_roughness;
 				if(metallic_roughness->base_color_texture.texture && 
 					!texture_set.contains(metallic_roughness->base_color_texture.texture)) {
-					textures_to_upload.emplace_back(std::make_pair(
-						metallic_roughness->base_color_texture.texture,
-						VK_FORMAT_R8G8B8A8_SRGB
-					));
+					textures_to_upload.push_back(TextureToUpload {
+						.texture = metallic_roughness->base_color_texture.texture,
+						.format = VK_FORMAT_R8G8B8A8_SRGB,
+						.usage = TextureCooker::TextureUsage::BaseColor
+					});
 					texture_set.insert(metallic_roughness->base_color_texture.texture);
 				}
 				if(metallic_roughness->metallic_roughness_texture.texture &&
 					!texture_set.contains(metallic_roughness->metallic_roughness_texture.texture)) {
-					textures_to_upload.emplace_back(std::make_pair(
-						metallic_roughness->metallic_roughness_texture.texture,
-						VK_FORMAT_R8G8B8A8_UNORM
-					));
+					textures_to_upload.push_back(TextureToUpload {
+						.texture = metallic_roughness->metallic_roughness_texture.texture,
+						.format = VK_FORMAT_R8G8B8A8_UNORM,
+						.usage = TextureCooker::TextureUsage::MetallicRoughness
+					});
 					texture_set.insert(metallic_roughness->metallic_roughness_texture.texture);
 				}
 			}
 
 			if(data->meshes[i].primitives[j].material->normal_texture.texture &&
 				!texture_set.contains(data->meshes[i].primitives[j].material->normal_texture.texture)) {
-				textures_to_upload.emplace_back(std::make_pair(
-					data->meshes[i].primitives[j].material->normal_texture.texture,
-					VK_FORMAT_R8G8B8A8_UNORM
-				));
+				textures_to_upload.push_back(TextureToUpload {
+					.texture = data->meshes[i].primitives[j].material->normal_texture.texture,
+					.format = VK_FORMAT_R8G8B8A8_UNORM,
+					.usage = TextureCooker::TextureUsage::NormalMap
+				});
 				texture_set.insert(data->meshes[i].primitives[j].material->normal_texture.texture);
 			}
 		}
 	}
 
-	std::unordered_map<const char *, int> textures;
-	#pragma omp parallel for
+	if(COOK_TEXTURES) {
+		std::filesystem::create_directories(COOKED_TEXTURE_DIRECTORY);
+	}
+
+	// Decoding and cooking run on the OpenMP workers while the resource manager's uploader thread
+	// batches the images into staging memory and submits them in the background.
+	std::vector<uint32_t> texture_indices(textures_to_upload.size());
+	resource_manager.BeginTextureUploads();
+	#pragma omp parallel for schedule(dynamic)
 	for(int i = 0; i < textures_to_upload.size(); ++i) {
-		auto &[texture, format] = textures_to_upload[i];
-		int _, x, y;
-		uint8_t *image_data;
-		if(texture->image->uri) {
-			std::string texture_path = parent_path + texture->image->uri;
-			image_data = stbi_load(texture_path.c_str(), &x, &y, &_, STBI_rgb_alpha);
+		auto &[texture, format, usage] = textures_to_upload[i];
+		std::vector<uint8_t> image_file = ReadImageFile(texture->image, parent_path);
+		assert(!image_file.empty());
+
+		TextureCooker::CookedTexture cooked_texture;
+		if(COOK_TEXTURES) {
+			std::string cooked_path = GetCookedTexturePath(image_file, usage);
+			if(!TextureCooker::LoadCookedTexture(cooked_path.c_str(), cooked_texture)) {
+				int _, x, y;
+				uint8_t *image_data = stbi_load_from_memory(image_file.data(), static_cast<int>(image_file.size()),
+					&x, &y, &_, STBI_rgb_alpha);
+				assert(image_data);
+				cooked_texture = TextureCooker::CookTexture(image_data, static_cast<uint32_t>(x),
+					static_cast<uint32_t>(y), usage, TEXTURE_COOK_QUALITY);
+				TextureCooker::SaveCookedTexture(cooked_path.c_str(), cooked_texture);
+				stbi_image_free(image_data);
+			}
 		}
 		else {
-			uint64_t size = texture->image->buffer_view->size;
-			uint64_t offset = texture->image->buffer_view->offset;
-			uint8_t *buffer = reinterpret_cast<uint8_t *>(texture->image->buffer_view->buffer->data) + offset;
-			image_data = stbi_load_from_memory(buffer, static_cast<int>(size), &x, &y, &_, STBI_rgb_alpha);
+			int _, x, y;
+			uint8_t *image_data = stbi_load_from_memory(image_file.data(), static_cast<int>(image_file.size()),
+				&x, &y, &_, STBI_rgb_alpha);
+			assert(image_data);
+			cooked_texture = TextureCooker::CookedTexture {
+				.format = format,
+				.width = static_cast<uint32_t>(x),
+				.height = static_cast<uint32_t>(y),
+				.mip_levels = 1,
+				.data = image_data
+			};
 		}
-		assert(image_data);
 
 		SamplerInfo sampler_info {
 			.mag_filter = GetVkFilter(texture->sampler->mag_filter),
 			.min_filter = GetVkFilter(texture->sampler->min_filter),
 			.address_mode_u = GetVkAddressMode(texture->sampler->wrap_s),
-			.address_mode_v = GetVkAddressMode(texture->sampler->wrap_t)
+			.address_mode_v = GetVkAddressMode(texture->sampler->wrap_t),
+			.mipmap_mode = GetVkMipmapMode(texture->sampler->min_filter)
 		};
 
-		uint32_t image_idx;
-		#pragma omp critical
-		{
-			image_idx = resource_manager.UploadTextureFromData(x, y, image_data, format, &sampler_info);
-			textures[texture->image->name] = image_idx;
-			free(image_data);
-		}
-		resource_manager.TagImage(image_idx, texture->image->name);
+		resource_manager.EnqueueTextureUpload(TextureUploadRequest {
+			.width = cooked_texture.width,
+			.height = cooked_texture.height,
+			.data = cooked_texture.data,
+			.format = cooked_texture.format,
+			.sampler_info = sampler_info,
+			.name = texture->image->name,
+			.texture_idx = &texture_indices[i],
+			.mip_levels = cooked_texture.mip_levels,
+			.components = COOK_TEXTURES ? TextureCooker::GetComponentMapping(usage) : VkComponentMapping {}
+		});
+	}
+	resource_manager.EndTextureUploads();
+
+	std::unordered_map<const char *, int> textures;
+	for(int i = 0; i < textures_to_upload.size(); ++i) {
+		textures[textures_to_upload[i].texture->image->name] = GetBindlessIndex(texture_indices[i]);
+	}
+
+	if(LOG_STATISTICS && BENCHMARK_GEOMETRY_DECODING) {
+		BenchmarkGeometryDecoding(data);
 	}
 
-	std::vector<Vertex> vertices;
-	std::vector<uint32_t> indices;
+	// The nodes are walked serially to lay out the geometry, which keeps the Scene and the
+	// vertex/index order identical to a fully serial load. All decoding then happens in parallel,
+	// every primitive writing only to its own preassigned slice.
+	std::vector<PrimitiveDecodeJob> decode_jobs;
+	std::unordered_map<const cgltf_mesh *, uint32_t> mesh_indices;
+	std::unordered_map<std::string, uint32_t> material_indices;
+	uint32_t vertex_count = 0;
+	uint32_t index_count = 0;
 	for(int i = 0; i < data->nodes_count; ++i) {
-		ParseNode(data->nodes[i], scene, textures, vertices, indices);
+		ParseNode(data->nodes[i], scene, textures, mesh_indices, material_indices, decode_jobs, vertex_count, index_count);
+	}
+	if(LOG_STATISTICS) {
+		printf("Materials: %zu unique of %zu glTF materials\n", scene.materials.size(), data->materials_count);
+	}
+
+	std::vector<Vertex> vertices(vertex_count);
+	std::vector<uint16_t> indices(index_count);
+	std::vector<std::pair<MeshOptimizer::VertexCacheStatistics, MeshOptimizer::VertexCacheStatistics>>
+		optimization_statistics(decode_jobs.size());
+	#pragma omp parallel for schedule(dynamic)
+	for(int i = 0; i < decode_jobs.size(); ++i) {
+		PrimitiveDecodeJob &job = decode_jobs[i];
+		size_t primitive_vertex_count = job.accessors.position->count;
+		std::vector<DecodedVertex> decoded_vertices(primitive_vertex_count);
+		DecodeVertices(job.accessors, decoded_vertices.data());
+
+		std::vector<uint32_t> decoded_indices(job.indices->count);
+		DecodeIndices(job.indices, decoded_indices.data());
+
+		// Only reorders within the primitive, so its offsets and counts are unaffected
+		if(OPTIMIZE_MESHES && !decoded_indices.empty()) {
+			optimization_statistics[i].first = MeshOptimizer::AnalyzeVertexCache(decoded_indices.data(),
+				decoded_indices.size(), primitive_vertex_count);
+			MeshOptimizer::OptimizeVertexCache(decoded_indices.data(), decoded_indices.size(), primitive_vertex_count);
+			if(OPTIMIZE_OVERDRAW) {
+				MeshOptimizer::OptimizeOverdraw(decoded_indices.data(), decoded_indices.size(),
+					glm::value_ptr(decoded_vertices[0].pos), sizeof(DecodedVertex), primitive_vertex_count,
+					OVERDRAW_ACMR_THRESHOLD);
+			}
+			std::vector<uint32_t> remap = MeshOptimizer::OptimizeVertexFetchRemap(decoded_indices.data(),
+				decoded_indices.size(), primitive_vertex_count);
+			MeshOptimizer::RemapVertices(decoded_vertices, remap);
+			optimization_statistics[i].second = MeshOptimizer::AnalyzeVertexCache(decoded_indices.data(),
+				decoded_indices.size(), primitive_vertex_count);
+		}
+
+		QuantizeVertices(decoded_vertices.data(), primitive_vertex_count, vertices.data() + job.vertex_offset);
+		if(job.index_type == VK_INDEX_TYPE_UINT32) {
+			memcpy(indices.data() + job.index_offset, decoded_indices.data(), decoded_indices.size() * sizeof(uint32_t));
+		}
+		else {
+			std::transform(decoded_indices.begin(), decoded_indices.end(), indices.begin() + job.index_offset,
+				[](uint32_t index) { return static_cast<uint16_t>(index); });
+		}
+	}
+
+	if(OPTIMIZE_MESHES) {
+		uint32_t triangle_count = 0;
+		uint32_t transformed_before = 0;
+		uint32_t transformed_after = 0;
+		for(int i = 0; i < decode_jobs.size(); ++i) {
+			auto &[before, after] = optimization_statistics[i];
+			if(LOG_STATISTICS && REPORT_MESH_OPTIMIZATION) {
+				printf("Primitive %d (%zu triangles): ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", i,
+					decode_jobs[i].indices->count / 3, before.acmr, after.acmr, before.atvr, after.atvr);
+			}
+			triangle_count += static_cast<uint32_t>(decode_jobs[i].indices->count / 3);
+			transformed_before += before.vertices_transformed;
+			transformed_after += after.vertices_transformed;
+		}
+		if(LOG_STATISTICS && triangle_count > 0) {
+			printf("Mesh optimization: ACMR %.3f -> %.3f over %u triangles\n",
+				static_cast<float>(transformed_before) / triangle_count,
+				static_cast<float>(transformed_after) / triangle_count, triangle_count);
+		}
 	}
 
 	uint32_t num_directional_lights = 0;
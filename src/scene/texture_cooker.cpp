@@ -0,0 +1,663 @@
+#include "pch.h"
+#include "texture_cooker.h"
+
+#include "rendering_backend/vulkan_utils.h"
+
+namespace TextureCooker {
+inline constexpr uint32_t COOKED_TEXTURE_MAGIC = 0x58545248; // "HRTX"
+
+struct CookedTextureHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_levels;
+	uint64_t size;
+};
+
+// BC7 4-bit index interpolation weights, out of 64
+inline constexpr std::array<uint32_t, 16> BC7_WEIGHTS = {
+	0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64
+};
+
+static float SrgbToLinear(float c) {
+	return c <= 0.04045f ? c / 12.92f : powf((c + 0.055f) / 1.055f, 2.4f);
+}
+
+static float LinearToSrgb(float c) {
+	return c <= 0.0031308f ? c * 12.92f : 1.055f * powf(c, 1.0f / 2.4f) - 0.055f;
+}
+
+static uint8_t ToUnorm8(float c) {
+	return static_cast<uint8_t>(std::clamp(c * 255.0f + 0.5f, 0.0f, 255.0f));
+}
+
+// 2x2 box filter down to the next mip level. Odd dimensions clamp at the edge.
+// Base color is averaged in linear space, normals are renormalized after averaging.
+static std::vector<uint8_t> Downsample(const std::vector<uint8_t> &src, uint32_t width, uint32_t height,
+	uint32_t dst_width, uint32_t dst_height, TextureUsage usage) {
+	static const std::array<float, 256> srgb_to_linear = [] {
+		std::array<float, 256> table;
+		for(int i = 0; i < 256; ++i) {
+			table[i] = SrgbToLinear(i / 255.0f);
+		}
+		return table;
+	}();
+
+	std::vector<uint8_t> dst(static_cast<size_t>(dst_width) * dst_height * 4);
+	for(uint32_t y = 0; y < dst_height; ++y) {
+		uint32_t y0 = std::min(y * 2, height - 1);
+		uint32_t y1 = std::min(y * 2 + 1, height - 1);
+		for(uint32_t x = 0; x < dst_width; ++x) {
+			uint32_t x0 = std::min(x * 2, width - 1);
+			uint32_t x1 = std::min(x * 2 + 1, width - 1);
+			const uint8_t *texels[4] = {
+				&src[(static_cast<size_t>(y0) * width + x0) * 4],
+				&src[(static_cast<size_t>(y0) * width + x1) * 4],
+				&src[(static_cast<size_t>(y1) * width + x0) * 4],
+				&src[(static_cast<size_t>(y1) * width + x1) * 4]
+			};
+			uint8_t *out = &dst[(static_cast<size_t>(y) * dst_width + x) * 4];
+
+			if(usage == TextureUsage::BaseColor) {
+				for(int c = 0; c < 3; ++c) {
+					float sum = 0.0f;
+					for(const uint8_t *texel : texels) {
+						sum += srgb_to_linear[texel[c]];
+					}
+					out[c] = ToUnorm8(LinearToSrgb(sum * 0.25f));
+				}
+			}
+			else if(usage == TextureUsage::NormalMap) {
+				glm::vec3 n(0.0f);
+				for(const uint8_t *texel : texels) {
+					n += glm::vec3(texel[0], texel[1], texel[2]) / 127.5f - 1.0f;
+				}
+				n = glm::length(n) > 0.0f ? glm::normalize(n) : glm::vec3(0.0f, 0.0f, 1.0f);
+				for(int c = 0; c < 3; ++c) {
+					out[c] = ToUnorm8(n[c] * 0.5f + 0.5f);
+				}
+			}
+			else {
+				for(int c = 0; c < 3; ++c) {
+					out[c] = static_cast<uint8_t>((texels[0][c] + texels[1][c] + texels[2][c] + texels[3][c] + 2) / 4);
+				}
+			}
+			out[3] = static_cast<uint8_t>((texels[0][3] + texels[1][3] + texels[2][3] + texels[3][3] + 2) / 4);
+		}
+	}
+	return dst;
+}
+
+// Gathers a 4x4 block, clamping at the image edge for levels smaller than a block
+static void FetchBlock(const std::vector<uint8_t> &rgba, uint32_t width, uint32_t height,
+	uint32_t block_x, uint32_t block_y, uint8_t block[16][4]) {
+	for(uint32_t y = 0; y < 4; ++y) {
+		uint32_t sy = std::min(block_y * 4 + y, height - 1);
+		for(uint32_t x = 0; x < 4; ++x) {
+			uint32_t sx = std::min(block_x * 4 + x, width - 1);
+			memcpy(block[y * 4 + x], &rgba[(static_cast<size_t>(sy) * width + sx) * 4], 4);
+		}
+	}
+}
+
+// Endpoints spanning the block along its principal axis, or its bounding box for CookQuality::Fast
+static void FitEndpoints(const float texels[16][4], uint32_t channels, CookQuality quality, float e0[4], float e1[4]) {
+	float min[4] = { 255.0f, 255.0f, 255.0f, 255.0f };
+	float max[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+	float mean[4] = {};
+	for(int i = 0; i < 16; ++i) {
+		for(uint32_t c = 0; c < channels; ++c) {
+			min[c] = std::min(min[c], texels[i][c]);
+			max[c] = std::max(max[c], texels[i][c]);
+			mean[c] += texels[i][c] / 16.0f;
+		}
+	}
+
+	if(quality == CookQuality::Fast) {
+		memcpy(e0, min, sizeof(min));
+		memcpy(e1, max, sizeof(max));
+		return;
+	}
+
+	float covariance[4][4] = {};
+	for(int i = 0; i < 16; ++i) {
+		for(uint32_t a = 0; a < channels; ++a) {
+			for(uint32_t b = 0; b < channels; ++b) {
+				covariance[a][b] += (texels[i][a] - mean[a]) * (texels[i][b] - mean[b]);
+			}
+		}
+	}
+
+	// Power iteration, starting from the bounding box diagonal
+	float axis[4] = {};
+	for(uint32_t c = 0; c < channels; ++c) {
+		axis[c] = max[c] - min[c];
+	}
+	for(int iteration = 0; iteration < 8; ++iteration) {
+		float next[4] = {};
+		float length = 0.0f;
+		for(uint32_t a = 0; a < channels; ++a) {
+			for(uint32_t b = 0; b < channels; ++b) {
+				next[a] += covariance[a][b] * axis[b];
+			}
+			length = std::max(length, fabsf(next[a]));
+		}
+		if(length == 0.0f) {
+			break;
+		}
+		for(uint32_t c = 0; c < channels; ++c) {
+			axis[c] = next[c] / length;
+		}
+	}
+
+	float t_min = FLT_MAX;
+	float t_max = -FLT_MAX;
+	float axis_length_squared = 0.0f;
+	for(uint32_t c = 0; c < channels; ++c) {
+		axis_length_squared += axis[c] * axis[c];
+	}
+	if(axis_length_squared == 0.0f) {
+		memcpy(e0, mean, sizeof(mean));
+		memcpy(e1, mean, sizeof(mean));
+		return;
+	}
+	for(int i = 0; i < 16; ++i) {
+		float t = 0.0f;
+		for(uint32_t c = 0; c < channels; ++c) {
+			t += (texels[i][c] - mean[c]) * axis[c];
+		}
+		t /= axis_length_squared;
+		t_min = std::min(t_min, t);
+		t_max = std::max(t_max, t);
+	}
+	for(uint32_t c = 0; c < 4; ++c) {
+		e0[c] = std::clamp(mean[c] + axis[c] * t_min, 0.0f, 255.0f);
+		e1[c] = std::clamp(mean[c] + axis[c] * t_max, 0.0f, 255.0f);
+	}
+}
+
+// Least squares endpoints for fixed interpolation weights (texel ~ e0 * (1 - w) + e1 * w).
+// Returns false if the weights are degenerate.
+static bool RefineEndpoints(const float texels[16][4], const float weights[16], uint32_t channels, float e0[4], float e1[4]) {
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[4] = {}, bx[4] = {};
+	for(int i = 0; i < 16; ++i) {
+		float a = 1.0f - weights[i];
+		float b = weights[i];
+		aa += a * a;
+		ab += a * b;
+		bb += b * b;
+		for(uint32_t c = 0; c < channels; ++c) {
+			ax[c] += a * texels[i][c];
+			bx[c] += b * texels[i][c];
+		}
+	}
+	float determinant = aa * bb - ab * ab;
+	if(fabsf(determinant) < 1e-6f) {
+		return false;
+	}
+	for(uint32_t c = 0; c < channels; ++c) {
+		e0[c] = std::clamp((ax[c] * bb - bx[c] * ab) / determinant, 0.0f, 255.0f);
+		e1[c] = std::clamp((bx[c] * aa - ax[c] * ab) / determinant, 0.0f, 255.0f);
+	}
+	return true;
+}
+
+static uint32_t RefinementIterations(CookQuality quality) {
+	switch(quality) {
+	case CookQuality::Fast: return 0;
+	case CookQuality::Normal: return 1;
+	case CookQuality::High: return 4;
+	default: return 0;
+	}
+}
+
+struct BC7Endpoint {
+	uint32_t color[4]; // 7-bit
+	uint32_t p_bit;
+};
+
+// Picks the shared p-bit that reconstructs the 8-bit endpoint with the least error
+static BC7Endpoint QuantizeBC7Endpoint(const float endpoint[4]) {
+	BC7Endpoint best {};
+	float best_error = FLT_MAX;
+	for(uint32_t p = 0; p < 2; ++p) {
+		BC7Endpoint candidate { .p_bit = p };
+		float error = 0.0f;
+		for(int c = 0; c < 4; ++c) {
+			int q = static_cast<int>(roundf((endpoint[c] - p) * 0.5f));
+			candidate.color[c] = static_cast<uint32_t>(std::clamp(q, 0, 127));
+			float reconstructed = static_cast<float>((candidate.color[c] << 1) | p);
+			error += (reconstructed - endpoint[c]) * (reconstructed - endpoint[c]);
+		}
+		if(error < best_error) {
+			best_error = error;
+			best = candidate;
+		}
+	}
+	return best;
+}
+
+static float AssignBC7Indices(const float texels[16][4], const BC7Endpoint &e0, const BC7Endpoint &e1, uint32_t indices[16]) {
+	float palette[16][4];
+	for(int i = 0; i < 16; ++i) {
+		for(int c = 0; c < 4; ++c) {
+			uint32_t a = (e0.color[c] << 1) | e0.p_bit;
+			uint32_t b = (e1.color[c] << 1) | e1.p_bit;
+			palette[i][c] = static_cast<float>(((64 - BC7_WEIGHTS[i]) * a + BC7_WEIGHTS[i] * b + 32) >> 6);
+		}
+	}
+
+	float total_error = 0.0f;
+	for(int i = 0; i < 16; ++i) {
+		float best_error = FLT_MAX;
+		for(uint32_t j = 0; j < 16; ++j) {
+			float error = 0.0f;
+			for(int c = 0; c < 4; ++c) {
+				float d = texels[i][c] - palette[j][c];
+				error += d * d;
+			}
+			if(error < best_error) {
+				best_error = error;
+				indices[i] = j;
+			}
+		}
+		total_error += best_error;
+	}
+	return total_error;
+}
+
+struct BitWriter {
+	uint8_t *out;
+	uint32_t position;
+
+	void Write(uint32_t value, uint32_t bits) {
+		for(uint32_t i = 0; i < bits; ++i, ++position) {
+			out[position >> 3] |= static_cast<uint8_t>(((value >> i) & 1) << (position & 7));
+		}
+	}
+};
+
+// BC7 mode 6: one subset, RGBA 7.7.7.7 endpoints with a p-bit each, 4-bit indices
+static void EncodeBC7Block(const uint8_t block[16][4], CookQuality quality, uint8_t out[16]) {
+	float texels[16][4];
+	for(int i = 0; i < 16; ++i) {
+		for(int c = 0; c < 4; ++c) {
+			texels[i][c] = block[i][c];
+		}
+	}
+
+	float e0[4], e1[4];
+	FitEndpoints(texels, 4, quality, e0, e1);
+	BC7Endpoint q0 = QuantizeBC7Endpoint(e0);
+	BC7Endpoint q1 = QuantizeBC7Endpoint(e1);
+	uint32_t indices[16];
+	float error = AssignBC7Indices(texels, q0, q1, indices);
+
+	for(uint32_t iteration = 0; iteration < RefinementIterations(quality) && error > 0.0f; ++iteration) {
+		float weights[16];
+		for(int i = 0; i < 16; ++i) {
+			weights[i] = BC7_WEIGHTS[indices[i]] / 64.0f;
+		}
+		if(!RefineEndpoints(texels, weights, 4, e0, e1)) {
+			break;
+		}
+		BC7Endpoint r0 = QuantizeBC7Endpoint(e0);
+		BC7Endpoint r1 = QuantizeBC7Endpoint(e1);
+		uint32_t refined_indices[16];
+		float refined_error = AssignBC7Indices(texels, r0, r1, refined_indices);
+		if(refined_error >= error) {
+			break;
+		}
+		error = refined_error;
+		q0 = r0;
+		q1 = r1;
+		memcpy(indices, refined_indices, sizeof(indices));
+	}
+
+	// The anchor index is stored with an implicit 0 MSB, so swap the endpoints if it is set
+	if(indices[0] & 0x8) {
+		std::swap(q0, q1);
+		for(uint32_t &index : indices) {
+			index = 15 - index;
+		}
+	}
+
+	memset(out, 0, 16);
+	BitWriter writer { .out = out, .position = 0 };
+	writer.Write(1 << 6, 7);
+	for(int c = 0; c < 4; ++c) {
+		writer.Write(q0.color[c], 7);
+		writer.Write(q1.color[c], 7);
+	}
+	writer.Write(q0.p_bit, 1);
+	writer.Write(q1.p_bit, 1);
+	writer.Write(indices[0], 3);
+	for(int i = 1; i < 16; ++i) {
+		writer.Write(indices[i], 4);
+	}
+}
+
+static uint16_t PackRGB565(const float color[3]) {
+	uint32_t r = static_cast<uint32_t>(std::clamp(roundf(color[0] * 31.0f / 255.0f), 0.0f, 31.0f));
+	uint32_t g = static_cast<uint32_t>(std::clamp(roundf(color[1] * 63.0f / 255.0f), 0.0f, 63.0f));
+	uint32_t b = static_cast<uint32_t>(std::clamp(roundf(color[2] * 31.0f / 255.0f), 0.0f, 31.0f));
+	return static_cast<uint16_t>((r << 11) | (g << 5) | b);
+}
+
+static void UnpackRGB565(uint16_t packed, float color[3]) {
+	uint32_t r = (packed >> 11) & 31;
+	uint32_t g = (packed >> 5) & 63;
+	uint32_t b = packed & 31;
+	color[0] = static_cast<float>((r << 3) | (r >> 2));
+	color[1] = static_cast<float>((g << 2) | (g >> 4));
+	color[2] = static_cast<float>((b << 3) | (b >> 2));
+}
+
+static float AssignBC1Indices(const float texels[16][4], uint16_t c0, uint16_t c1, uint32_t indices[16]) {
+	float palette[4][3];
+	UnpackRGB565(c0, palette[0]);
+	UnpackRGB565(c1, palette[1]);
+	for(int c = 0; c < 3; ++c) {
+		palette[2][c] = (2.0f * palette[0][c] + palette[1][c]) / 3.0f;
+		palette[3][c] = (palette[0][c] + 2.0f * palette[1][c]) / 3.0f;
+	}
+
+	float total_error = 0.0f;
+	for(int i = 0; i < 16; ++i) {
+		float best_error = FLT_MAX;
+		for(uint32_t j = 0; j < 4; ++j) {
+			float error = 0.0f;
+			for(int c = 0; c < 3; ++c) {
+				float d = texels[i][c] - palette[j][c];
+				error += d * d;
+			}
+			if(error < best_error) {
+				best_error = error;
+				indices[i] = j;
+			}
+		}
+		total_error += best_error;
+	}
+	return total_error;
+}
+
+// BC1 in four color mode, only used for fully opaque blocks
+static void EncodeBC1Block(const uint8_t block[16][4], CookQuality quality, uint8_t out[8]) {
+	float texels[16][4];
+	for(int i = 0; i < 16; ++i) {
+		for(int c = 0; c < 4; ++c) {
+			texels[i][c] = block[i][c];
+		}
+	}
+
+	float e0[4], e1[4];
+	FitEndpoints(texels, 3, quality, e0, e1);
+	// Four color mode requires c0 > c1, so the larger endpoint goes first
+	uint16_t c0 = std::max(PackRGB565(e0), PackRGB565(e1));
+	uint16_t c1 = std::min(PackRGB565(e0), PackRGB565(e1));
+	uint32_t indices[16] = {};
+	float error = c0 == c1 ? 0.0f : AssignBC1Indices(texels, c0, c1, indices);
+
+	static constexpr float BC1_WEIGHTS[4] = { 0.0f, 1.0f, 1.0f / 3.0f, 2.0f / 3.0f };
+	for(uint32_t iteration = 0; iteration < RefinementIterations(quality) && c0 != c1 && error > 0.0f; ++iteration) {
+		float weights[16];
+		for(int i = 0; i < 16; ++i) {
+			weights[i] = BC1_WEIGHTS[indices[i]];
+		}
+		if(!RefineEndpoints(texels, weights, 3, e0, e1)) {
+			break;
+		}
+		uint16_t r0 = std::max(PackRGB565(e0), PackRGB565(e1));
+		uint16_t r1 = std::min(PackRGB565(e0), PackRGB565(e1));
+		if(r0 == r1) {
+			break;
+		}
+		uint32_t refined_indices[16];
+		float refined_error = AssignBC1Indices(texels, r0, r1, refined_indices);
+		if(refined_error >= error) {
+			break;
+		}
+		error = refined_error;
+		c0 = r0;
+		c1 = r1;
+		memcpy(indices, refined_indices, sizeof(indices));
+	}
+
+	uint32_t packed_indices = 0;
+	if(c0 != c1) {
+		for(int i = 0; i < 16; ++i) {
+			packed_indices |= indices[i] << (i * 2);
+		}
+	}
+	memcpy(out, &c0, 2);
+	memcpy(out + 2, &c1, 2);
+	memcpy(out + 4, &packed_indices, 4);
+}
+
+static float AssignBC4Indices(const float values[16], uint32_t r0, uint32_t r1, uint32_t indices[16]) {
+	float palette[8];
+	palette[0] = static_cast<float>(r0);
+	palette[1] = static_cast<float>(r1);
+	for(uint32_t i = 2; i < 8; ++i) {
+		palette[i] = ((8 - i) * r0 + (i - 1) * r1) / 7.0f;
+	}
+
+	float total_error = 0.0f;
+	for(int i = 0; i < 16; ++i) {
+		float best_error = FLT_MAX;
+		for(uint32_t j = 0; j < 8; ++j) {
+			float error = (values[i] - palette[j]) * (values[i] - palette[j]);
+			if(error < best_error) {
+				best_error = error;
+				indices[i] = j;
+			}
+		}
+		total_error += best_error;
+	}
+	return total_error;
+}
+
+// BC4 in eight value mode (r0 > r1) for a single channel of the block
+static void EncodeBC4Block(const uint8_t block[16][4], uint32_t channel, CookQuality quality, uint8_t out[8]) {
+	float values[16][4] = {};
+	uint32_t min = 255;
+	uint32_t max = 0;
+	for(int i = 0; i < 16; ++i) {
+		values[i][0] = block[i][channel];
+		min = std::min<uint32_t>(min, block[i][channel]);
+		max = std::max<uint32_t>(max, block[i][channel]);
+	}
+
+	uint32_t r0 = max;
+	uint32_t r1 = min;
+	uint32_t indices[16] = {};
+	float flat_values[16];
+	for(int i = 0; i < 16; ++i) {
+		flat_values[i] = values[i][0];
+	}
+	float error = r0 == r1 ? 0.0f : AssignBC4Indices(flat_values, r0, r1, indices);
+
+	static constexpr float BC4_WEIGHTS[8] = {
+		0.0f, 1.0f, 1.0f / 7.0f, 2.0f / 7.0f, 3.0f / 7.0f, 4.0f / 7.0f, 5.0f / 7.0f, 6.0f / 7.0f
+	};
+	for(uint32_t iteration = 0; iteration < RefinementIterations(quality) && r0 != r1 && error > 0.0f; ++iteration) {
+		float weights[16];
+		for(int i = 0; i < 16; ++i) {
+			weights[i] = BC4_WEIGHTS[indices[i]];
+		}
+		float e0[4], e1[4];
+		if(!RefineEndpoints(values, weights, 1, e0, e1)) {
+			break;
+		}
+		uint32_t q0 = static_cast<uint32_t>(roundf(e0[0]));
+		uint32_t q1 = static_cast<uint32_t>(roundf(e1[0]));
+		if(q0 <= q1) {
+			break;
+		}
+		uint32_t refined_indices[16];
+		float refined_error = AssignBC4Indices(flat_values, q0, q1, refined_indices);
+		if(refined_error >= error) {
+			break;
+		}
+		error = refined_error;
+		r0 = q0;
+		r1 = q1;
+		memcpy(indices, refined_indices, sizeof(indices));
+	}
+
+	uint64_t packed_indices = 0;
+	for(int i = 0; i < 16; ++i) {
+		packed_indices |= static_cast<uint64_t>(indices[i]) << (i * 3);
+	}
+	out[0] = static_cast<uint8_t>(r0);
+	out[1] = static_cast<uint8_t>(r1);
+	memcpy(out + 2, &packed_indices, 6);
+}
+
+// BC5 stores two BC4 channels, either the tangent space XY of a normal map or
+// the roughness (G) and metalness (B) of a metallic-roughness map
+static void EncodeBC5Block(const uint8_t block[16][4], TextureUsage usage, CookQuality quality, uint8_t out[16]) {
+	uint32_t first_channel = usage == TextureUsage::MetallicRoughness ? 1 : 0;
+	EncodeBC4Block(block, first_channel, quality, out);
+	EncodeBC4Block(block, first_channel + 1, quality, out + 8);
+}
+
+static void EncodeLevel(const std::vector<uint8_t> &rgba, uint32_t width, uint32_t height,
+	VkFormat format, TextureUsage usage, CookQuality quality, uint8_t *dst) {
+	uint32_t blocks_x = (width + 3) / 4;
+	uint32_t blocks_y = (height + 3) / 4;
+	uint32_t block_size = VkUtils::CompressedBlockSize(format);
+
+	// Runs serially when a scene loader worker is already cooking another texture
+	#pragma omp parallel for schedule(dynamic)
+	for(int block_y = 0; block_y < static_cast<int>(blocks_y); ++block_y) {
+		for(uint32_t block_x = 0; block_x < blocks_x; ++block_x) {
+			uint8_t block[16][4];
+			FetchBlock(rgba, width, height, block_x, block_y, block);
+			uint8_t *out = dst + (static_cast<size_t>(block_y) * blocks_x + block_x) * block_size;
+			switch(format) {
+			case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+				EncodeBC1Block(block, quality, out);
+				break;
+			case VK_FORMAT_BC5_UNORM_BLOCK:
+				EncodeBC5Block(block, usage, quality, out);
+				break;
+			case VK_FORMAT_BC7_SRGB_BLOCK:
+				EncodeBC7Block(block, quality, out);
+				break;
+			default:
+				assert(false && "Unsupported cooked texture format");
+			}
+		}
+	}
+}
+
+CookedTexture CookTexture(const uint8_t *rgba, uint32_t width, uint32_t height,
+	TextureUsage usage, CookQuality quality) {
+	VkFormat format = VK_FORMAT_BC5_UNORM_BLOCK;
+	if(usage == TextureUsage::BaseColor) {
+		// BC1 is only considered for the fast preset, and only when there's no alpha to preserve
+		bool opaque = true;
+		for(size_t i = 0; i < static_cast<size_t>(width) * height && opaque; ++i) {
+			opaque = rgba[i * 4 + 3] == 255;
+		}
+		format = quality == CookQuality::Fast && opaque ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_BC7_SRGB_BLOCK;
+	}
+
+	CookedTexture texture {
+		.format = format,
+		.width = width,
+		.height = height,
+		.mip_levels = VkUtils::MipLevelCount(width, height)
+	};
+	texture.size = VkUtils::ImageDataSize(format, width, height, texture.mip_levels);
+	texture.data = reinterpret_cast<uint8_t *>(malloc(texture.size));
+
+	std::vector<uint8_t> level(rgba, rgba + static_cast<size_t>(width) * height * 4);
+	uint32_t level_width = width;
+	uint32_t level_height = height;
+	uint8_t *dst = texture.data;
+	for(uint32_t i = 0; i < texture.mip_levels; ++i) {
+		EncodeLevel(level, level_width, level_height, format, usage, quality, dst);
+		dst += VkUtils::ImageLevelSize(format, level_width, level_height);
+
+		if(i + 1 < texture.mip_levels) {
+			uint32_t next_width = std::max(level_width / 2, 1u);
+			uint32_t next_height = std::max(level_height / 2, 1u);
+			level = Downsample(level, level_width, level_height, next_width, next_height, usage);
+			level_width = next_width;
+			level_height = next_height;
+		}
+	}
+	return texture;
+}
+
+bool LoadCookedTexture(const char *path, CookedTexture &texture) {
+	std::ifstream file(path, std::ios::binary);
+	if(!file) {
+		return false;
+	}
+
+	CookedTextureHeader header;
+	if(!file.read(reinterpret_cast<char *>(&header), sizeof(header)) ||
+		header.magic != COOKED_TEXTURE_MAGIC || header.version != COOKED_TEXTURE_VERSION) {
+		return false;
+	}
+
+	texture = CookedTexture {
+		.format = static_cast<VkFormat>(header.format),
+		.width = header.width,
+		.height = header.height,
+		.mip_levels = header.mip_levels,
+		.data = reinterpret_cast<uint8_t *>(malloc(header.size)),
+		.size = header.size
+	};
+	if(!file.read(reinterpret_cast<char *>(texture.data), header.size)) {
+		free(texture.data);
+		texture.data = nullptr;
+		return false;
+	}
+	return true;
+}
+
+void SaveCookedTexture(const char *path, const CookedTexture &texture) {
+	CookedTextureHeader header {
+		.magic = COOKED_TEXTURE_MAGIC,
+		.version = COOKED_TEXTURE_VERSION,
+		.format = static_cast<uint32_t>(texture.format),
+		.width = texture.width,
+		.height = texture.height,
+		.mip_levels = texture.mip_levels,
+		.size = texture.size
+	};
+	std::ofstream file(path, std::ios::binary);
+	file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char *>(texture.data), texture.size);
+}
+
+VkComponentMapping GetComponentMapping(TextureUsage usage) {
+	switch(usage) {
+	case TextureUsage::MetallicRoughness:
+		// Roughness and metalness are cooked into R and G, shaders read them from G and B
+		return VkComponentMapping {
+			.r = VK_COMPONENT_SWIZZLE_ONE,
+			.g = VK_COMPONENT_SWIZZLE_R,
+			.b = VK_COMPONENT_SWIZZLE_G,
+			.a = VK_COMPONENT_SWIZZLE_ONE
+		};
+	case TextureUsage::NormalMap:
+		// Z is reconstructed in the shaders
+		return VkComponentMapping {
+			.r = VK_COMPONENT_SWIZZLE_R,
+			.g = VK_COMPONENT_SWIZZLE_G,
+			.b = VK_COMPONENT_SWIZZLE_ONE,
+			.a = VK_COMPONENT_SWIZZLE_ONE
+		};
+	default:
+		return VkComponentMapping {};
+	}
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+// Converts RGBA8 source images into block-compressed textures with a full mip chain,
+// and caches the results on disk so they only have to be encoded once.
+namespace TextureCooker {
+// Bump whenever the encoders change, so stale cache entries get re-cooked
+inline constexpr uint32_t COOKED_TEXTURE_VERSION = 1;
+
+enum class TextureUsage {
+	BaseColor,
+	NormalMap,
+	MetallicRoughness
+};
+
+enum class CookQuality {
+	Fast,
+	Normal,
+	High
+};
+
+// All mip levels of a texture, tightly packed from the largest to the smallest.
+// data is allocated with malloc and owned by whoever holds the texture.
+struct CookedTexture {
+	VkFormat format;
+	uint32_t width;
+	uint32_t height;
+	uint32_t mip_levels;
+	uint8_t *data;
+	uint64_t size;
+};
+
+CookedTexture CookTexture(const uint8_t *rgba, uint32_t width, uint32_t height,
+	TextureUsage usage, CookQuality quality);
+
+bool LoadCookedTexture(const char *path, CookedTexture &texture);
+void SaveCookedTexture(const char *path, const CookedTexture &texture);
+
+// View swizzle that presents the cooked channels the way the shaders expect them
+VkComponentMapping GetComponentMapping(TextureUsage usage);
+}